@@ -7,20 +7,72 @@
 
 #include <dwarfstack.h>
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+#include <windows.h>
 
 
-static uint64_t prevAddr = 0;
+// output of one request, or stdout if NULL
+typedef struct out_buffer
+{
+  char *data;
+  size_t size,alloc;
+} out_buffer;
+
+static void output( out_buffer *out,const char *format,... )
+{
+  va_list args;
+  va_start( args,format );
+
+  if( !out )
+  {
+    vprintf( format,args );
+    va_end( args );
+    return;
+  }
+
+  va_list copy;
+  va_copy( copy,args );
+  int len = vsnprintf( NULL,0,format,copy );
+  va_end( copy );
+
+  if( len>0 && out->size+len+1>out->alloc )
+  {
+    size_t newAlloc = out->alloc ? out->alloc*2 : 1024;
+    while( newAlloc<out->size+len+1 ) newAlloc *= 2;
+    char *newData = realloc( out->data,newAlloc );
+    if( newData )
+    {
+      out->data = newData;
+      out->alloc = newAlloc;
+    }
+  }
+  if( len>0 && out->size+len+1<=out->alloc )
+  {
+    vsnprintf( out->data+out->size,len+1,format,args );
+    out->size += len;
+  }
+
+  va_end( args );
+}
+
+typedef struct print_state
+{
+  int count;
+  uint64_t prevAddr;
+  out_buffer *out;
+} print_state;
 
 static void stdoutPrint(
     uint64_t addr,const wchar_t *filename,int lineno,const char *funcname,
     void *context,int columnno )
 {
-  int *count = context;
-  uint64_t tAddr = addr ? addr : prevAddr;
+  print_state *state = context;
+  out_buffer *out = state->out;
+  uint64_t tAddr = addr ? addr : state->prevAddr;
   int addrSize = tAddr>0xffffffff ? 16 : 8;
   switch( lineno )
   {
@@ -30,26 +82,347 @@ static void stdoutPrint(
 
     case DWST_NO_DBG_SYM:
     case DWST_NO_SRC_FILE:
-      printf( "    stack %02d: 0x%0*I64X (%ls)\n",
-          (*count)++,addrSize,addr,filename );
+      output( out,"    stack %02d: 0x%0*I64X (%ls)\n",
+          state->count++,addrSize,addr,filename );
       break;
 
     default:
       if( addr )
-        printf( "    stack %02d: 0x%0*I64X",(*count)++,addrSize,addr );
+        output( out,"    stack %02d: 0x%0*I64X",
+            state->count++,addrSize,addr );
       else
-        printf( "                %*s",addrSize,"" );
-      printf( " (%ls:%d",filename,lineno );
+        output( out,"                %*s",addrSize,"" );
+      output( out," (%ls:%d",filename,lineno );
       if( columnno>0 )
-        printf( ":%d",columnno );
-      printf( ")" );
+        output( out,":%d",columnno );
+      output( out,")" );
       if( funcname )
-        printf( " [%s]",funcname );
-      printf( "\n" );
+        output( out," [%s]",funcname );
+      output( out,"\n" );
       break;
   }
 
-  if( addr ) prevAddr = addr;
+  if( addr ) state->prevAddr = addr;
+}
+
+
+// maximum number of requests resolved together
+#define MAX_BATCH 256
+// maximum number of cached image handles
+#define MAX_IMAGES 16
+
+typedef struct image_entry
+{
+  wchar_t *name;
+  dwstImage *image;
+  unsigned lastUse;
+} image_entry;
+
+static image_entry images[MAX_IMAGES];
+static unsigned useCount = 0;
+
+// get the cached handle of the image, or open it,
+// closing the least recently used one if all are in use
+static dwstImage *openImage( const wchar_t *name )
+{
+  int i;
+  int lru = 0;
+  for( i=0; i<MAX_IMAGES; i++ )
+  {
+    if( images[i].name && !wcscmp(images[i].name,name) )
+    {
+      images[i].lastUse = ++useCount;
+      return( images[i].image );
+    }
+    if( !images[i].name ||
+        (images[lru].name && images[i].lastUse<images[lru].lastUse) )
+      lru = i;
+  }
+
+  dwstImage *image = dwstOpenFileW( name );
+  if( !image ) return( NULL );
+
+  image_entry *entry = &images[lru];
+  if( entry->name )
+  {
+    dwstCloseImage( entry->image );
+    free( entry->name );
+  }
+  entry->name = wcsdup( name );
+  entry->image = image;
+  entry->lastUse = ++useCount;
+  if( !entry->name )
+  {
+    dwstCloseImage( image );
+    entry->image = NULL;
+    return( NULL );
+  }
+
+  return( image );
+}
+
+typedef struct request
+{
+  wchar_t *line;
+  const wchar_t *image;
+  uint64_t base;
+  uint64_t *addr;
+  int addrCount;
+  int done;
+  print_state state;
+  out_buffer out;
+} request;
+
+// read a line of any length, without the line break
+static wchar_t *readLine( void )
+{
+  size_t size = 0;
+  size_t alloc = 256;
+  wchar_t *line = malloc( alloc*sizeof(wchar_t) );
+  if( !line ) return( NULL );
+
+  while( fgetws(line+size,(int)(alloc-size),stdin) )
+  {
+    size += wcslen( line+size );
+    if( size && line[size-1]=='\n' ) break;
+
+    if( size+1>=alloc )
+    {
+      wchar_t *newLine = realloc( line,alloc*2*sizeof(wchar_t) );
+      if( !newLine ) break;
+      line = newLine;
+      alloc *= 2;
+    }
+  }
+
+  if( !size )
+  {
+    free( line );
+    return( NULL );
+  }
+
+  while( size && (line[size-1]=='\n' || line[size-1]=='\r') )
+    line[--size] = 0;
+
+  return( line );
+}
+
+// split the request line into image, base address and addresses,
+// returns 0 for an empty line, or -1 if it can't be parsed
+static int parseRequest( request *req )
+{
+  wchar_t *p = req->line;
+  while( *p==' ' || *p=='\t' ) p++;
+  if( !*p ) return( 0 );
+
+  // quoted image locations may contain spaces
+  wchar_t *end;
+  if( *p=='"' )
+  {
+    p++;
+    end = wcschr( p,'"' );
+    if( !end ) return( -1 );
+  }
+  else
+    end = p + wcscspn( p,L" \t" );
+  req->image = p;
+  p = *end ? end + 1 : end;
+  *end = 0;
+
+  size_t maxCount = wcslen( p )/2 + 1;
+  req->addr = malloc( maxCount*sizeof(uint64_t) );
+  if( !req->addr ) return( -1 );
+
+  while( 1 )
+  {
+    while( *p==' ' || *p=='\t' ) p++;
+    if( !*p ) break;
+
+    if( p[0]=='-' && p[1]=='b' )
+      req->base = wcstoull( p+2,&end,16 );
+    else
+    {
+      uint64_t addr = wcstoull( p,&end,16 );
+      // every reported frame of an address starts with the address,
+      // so 0 can't be told apart from inlined frames
+      if( addr ) req->addr[req->addrCount++] = addr;
+    }
+    if( end==p ) end = p + wcscspn( p,L" \t" );
+    p = end;
+  }
+
+  return( 1 );
+}
+
+// frames of the addresses of several requests
+typedef struct batch_context
+{
+  request **reqs;
+  int reqCount;
+  // request and address of the current frame
+  int req;
+  int idx;
+} batch_context;
+
+static void batchPrint(
+    uint64_t addr,const wchar_t *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  batch_context *batch = context;
+  if( lineno==DWST_BASE_ADDR ) return;
+
+  // the first frame of each address has it set,
+  // but addresses without a covering function have no frames
+  if( addr )
+  {
+    int req = batch->req;
+    int idx = batch->idx + 1;
+    for( ; req<batch->reqCount; req++,idx=0 )
+    {
+      request *r = batch->reqs[req];
+      for( ; idx<r->addrCount && r->addr[idx]!=addr; idx++ );
+      if( idx<r->addrCount ) break;
+    }
+    if( req<batch->reqCount )
+    {
+      batch->req = req;
+      batch->idx = idx;
+    }
+  }
+
+  stdoutPrint( addr,filename,lineno,funcname,
+      &batch->reqs[batch->req]->state,columnno );
+}
+
+// resolve all requests of the same image and base address together
+static void resolveBatch( request *reqs,int count )
+{
+  request *group[MAX_BATCH];
+  uint64_t *addr = NULL;
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    if( reqs[i].done ) continue;
+
+    int groupCount = 0;
+    int addrCount = 0;
+    int j;
+    for( j=i; j<count; j++ )
+    {
+      if( reqs[j].done || reqs[j].base!=reqs[i].base ||
+          wcscmp(reqs[j].image,reqs[i].image) )
+        continue;
+
+      group[groupCount++] = &reqs[j];
+      addrCount += reqs[j].addrCount;
+      reqs[j].done = 1;
+    }
+
+    dwstImage *image = openImage( reqs[i].image );
+    if( !image )
+    {
+      for( j=0; j<groupCount; j++ )
+        output( &group[j]->out,"    can't open %ls\n",group[j]->image );
+      continue;
+    }
+    if( !addrCount ) continue;
+
+    uint64_t *newAddr = realloc( addr,addrCount*sizeof(uint64_t) );
+    if( !newAddr ) continue;
+    addr = newAddr;
+    addrCount = 0;
+    for( j=0; j<groupCount; j++ )
+    {
+      memcpy( addr+addrCount,group[j]->addr,
+          group[j]->addrCount*sizeof(uint64_t) );
+      addrCount += group[j]->addrCount;
+    }
+
+    batch_context batch = { group,groupCount,0,-1 };
+    dwstOfImageW( image,reqs[i].base,addr,addrCount,&batchPrint,&batch );
+  }
+  free( addr );
+}
+
+// check if more requests can be read without waiting
+static int inputPending( void )
+{
+  HANDLE in = GetStdHandle( STD_INPUT_HANDLE );
+  DWORD type = GetFileType( in );
+  if( type==FILE_TYPE_DISK ) return( 1 );
+
+  DWORD avail = 0;
+  if( type==FILE_TYPE_PIPE && PeekNamedPipe(in,NULL,0,NULL,&avail,NULL) )
+    return( avail>0 );
+
+  return( 0 );
+}
+
+// read requests from stdin, and write one result block per request
+static int serve( void )
+{
+  request reqs[MAX_BATCH];
+  int eof = 0;
+  while( !eof )
+  {
+    // wait for the first request, and take all which are already there
+    int count = 0;
+    do
+    {
+      wchar_t *line = readLine();
+      if( !line )
+      {
+        eof = 1;
+        break;
+      }
+
+      request *req = &reqs[count];
+      memset( req,0,sizeof(request) );
+      req->line = line;
+      req->state.out = &req->out;
+      int parsed = parseRequest( req );
+      if( parsed<0 )
+      {
+        // the result block still has to follow, or the reader would
+        // wait for it forever
+        output( &req->out,"    can't parse request\n" );
+        req->done = 1;
+      }
+      if( parsed )
+        count++;
+      else
+      {
+        free( req->addr );
+        free( line );
+      }
+    } while( !count || (count<MAX_BATCH && inputPending()) );
+
+    resolveBatch( reqs,count );
+
+    // an empty line ends each block
+    int i;
+    for( i=0; i<count; i++ )
+    {
+      if( reqs[i].out.size )
+        fwrite( reqs[i].out.data,1,reqs[i].out.size,stdout );
+      printf( "\n" );
+      fflush( stdout );
+
+      free( reqs[i].out.data );
+      free( reqs[i].addr );
+      free( reqs[i].line );
+    }
+  }
+
+  int i;
+  for( i=0; i<MAX_IMAGES; i++ )
+  {
+    if( !images[i].name ) continue;
+    dwstCloseImage( images[i].image );
+    free( images[i].name );
+  }
+
+  return( 0 );
 }
 
 static void usage( const wchar_t *exe )
@@ -61,10 +434,17 @@ static void usage( const wchar_t *exe )
 
   printf( "Usage: %ls [executable] [option] [addr(s)]\n",exe );
   printf( " -b<base>                    Set base address\n" );
+  printf( "   or: %ls -s\n",exe );
+  printf( " -s                          Read requests from stdin,\n" );
+  printf( "                             one per line:"
+      " [executable] [option] [addr(s)]\n" );
 }
 
 int wmain( int argc,wchar_t **argv )
 {
+  if( argc==2 && !wcscmp(argv[1],L"-s") )
+    return( serve() );
+
   if( argc<3 )
   {
     usage( argv[0] );
@@ -92,8 +472,8 @@ int wmain( int argc,wchar_t **argv )
     return( 1 );
   }
 
-  int count = 0;
-  dwstOfFileW( argv[1],base,addr,addrCount,&stdoutPrint,&count );
+  print_state state = { 0,0,NULL };
+  dwstOfFileW( argv[1],base,addr,addrCount,&stdoutPrint,&state );
 
   return( 0 );
 }
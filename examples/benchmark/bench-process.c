@@ -0,0 +1,225 @@
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#include <dwarfstack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
+
+
+#define MAX_MODULES 16
+
+typedef struct code_range
+{
+  uintptr_t start;
+  uintptr_t size;
+} code_range;
+
+// first executable section of the loaded module
+static int moduleCode( HMODULE mod,code_range *range )
+{
+  const IMAGE_DOS_HEADER *dos = (const IMAGE_DOS_HEADER*)mod;
+  const IMAGE_NT_HEADERS *nt =
+    (const IMAGE_NT_HEADERS*)( (const char*)mod + dos->e_lfanew );
+  const IMAGE_SECTION_HEADER *sec = IMAGE_FIRST_SECTION( nt );
+  int i;
+  for( i=0; i<nt->FileHeader.NumberOfSections; i++ )
+  {
+    if( !(sec[i].Characteristics&IMAGE_SCN_MEM_EXECUTE) ||
+        !sec[i].Misc.VirtualSize )
+      continue;
+
+    range->start = (uintptr_t)mod + sec[i].VirtualAddress;
+    range->size = sec[i].Misc.VirtualSize;
+    return( 1 );
+  }
+
+  return( 0 );
+}
+
+static void countFrames(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  (void)addr;
+  (void)filename;
+  (void)funcname;
+  (void)columnno;
+
+  int *frames = context;
+  if( lineno>0 ) (*frames)++;
+}
+
+static double now( void )
+{
+  LARGE_INTEGER count,freq;
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &freq );
+  return( (double)count.QuadPart/freq.QuadPart );
+}
+
+// look up every stack separately
+static double runStacks( uintptr_t *addr,int stacks,int depth,int repeat,
+    int *frames )
+{
+  double start = now();
+  int r,s;
+  for( r=0; r<repeat; r++ )
+    for( s=0; s<stacks; s++ )
+      dwstOfProcess( addr+s*depth,depth,countFrames,frames );
+  return( now() - start );
+}
+
+// strings of the results are only file names and labels
+static void jsonString( FILE *f,const char *str )
+{
+  fputc( '"',f );
+  for( ; *str; str++ )
+  {
+    if( *str=='"' || *str=='\\' )
+      fputc( '\\',f );
+    if( (unsigned char)*str<0x20 )
+      fprintf( f,"\\u%04x",*str );
+    else
+      fputc( *str,f );
+  }
+  fputc( '"',f );
+}
+
+int main( int argc,char **argv )
+{
+  const char *resultName = NULL;
+  const char *label = "";
+  const char *names[MAX_MODULES];
+  int moduleCount = 0;
+  int depth = 64;
+  int stacks = 1000;
+  int repeat = 10;
+  int a;
+  for( a=1; a<argc; a++ )
+  {
+    if( argv[a][0]=='-' && argv[a][1]=='o' && argv[a][2] )
+      resultName = argv[a] + 2;
+    else if( argv[a][0]=='-' && argv[a][1]=='l' )
+      label = argv[a] + 2;
+    else if( argv[a][0]=='-' && argv[a][1]=='d' )
+      depth = atoi( argv[a]+2 );
+    else if( argv[a][0]=='-' && argv[a][1]=='s' )
+      stacks = atoi( argv[a]+2 );
+    else if( argv[a][0]=='-' && argv[a][1]=='r' )
+      repeat = atoi( argv[a]+2 );
+    else if( moduleCount<MAX_MODULES )
+      names[moduleCount++] = argv[a];
+  }
+
+  if( !moduleCount )
+  {
+    printf( "Usage: %s [option(s)] [module(s)]\n",argv[0] );
+    printf( " -d<depth>                   Frames per stack (64)\n" );
+    printf( " -s<stacks>                  Number of stacks (1000)\n" );
+    printf( " -r<repetitions>             Repetitions (10)\n" );
+    printf( " -o<results>                 Append results as JSON line\n" );
+    printf( " -l<label>                   Label of the results\n" );
+    return( 1 );
+  }
+  if( depth<1 ) depth = 1;
+  if( stacks<1 ) stacks = 1;
+  if( repeat<1 ) repeat = 1;
+
+  // the modules are only mapped, none of their code runs
+  code_range ranges[MAX_MODULES];
+  int m;
+  for( m=0; m<moduleCount; m++ )
+  {
+    HMODULE mod = LoadLibraryExA( names[m],NULL,DONT_RESOLVE_DLL_REFERENCES );
+    if( !mod || !moduleCode(mod,&ranges[m]) )
+    {
+      printf( "can't load %s\n",names[m] );
+      return( 1 );
+    }
+  }
+
+  // every stack alternates between the modules,
+  // and the same frames again, sorted by module
+  int count = stacks*depth;
+  uintptr_t *interleaved = malloc( count*sizeof(uintptr_t) );
+  uintptr_t *grouped = malloc( count*sizeof(uintptr_t) );
+  if( !interleaved || !grouped ) return( 1 );
+  srand( 1 );
+  int s,i;
+  for( s=0; s<stacks; s++ )
+  {
+    uintptr_t *stack = interleaved + s*depth;
+    for( i=0; i<depth; i++ )
+    {
+      code_range *range = &ranges[i%moduleCount];
+      uintptr_t offs = ((uintptr_t)rand()<<15 ^ rand()) % range->size;
+      stack[i] = range->start + offs;
+    }
+
+    int pos = 0;
+    for( m=0; m<moduleCount; m++ )
+      for( i=m; i<depth; i+=moduleCount )
+        grouped[s*depth+pos++] = stack[i];
+  }
+
+  int frames = 0;
+
+  // opens the modules
+  double start = now();
+  dwstOfProcess( interleaved,depth,countFrames,&frames );
+  double firstTime = now() - start;
+
+  // both orders decode the same tables
+  runStacks( interleaved,stacks,depth,1,&frames );
+
+  double interleavedTime = runStacks( interleaved,stacks,depth,repeat,&frames );
+  double groupedTime = runStacks( grouped,stacks,depth,repeat,&frames );
+
+  double interleavedNs = interleavedTime*1e9/((double)count*repeat);
+  double groupedNs = groupedTime*1e9/((double)count*repeat);
+
+  printf( "modules:              %d\n",moduleCount );
+  for( m=0; m<moduleCount; m++ )
+    printf( "                      %s\n",names[m] );
+  printf( "stacks:               %d x %d frames\n",stacks,depth );
+  printf( "first stack:          %.3f ms\n",firstTime*1e3 );
+  printf( "interleaved:          %.1f ns/frame\n",interleavedNs );
+  printf( "grouped:              %.1f ns/frame\n",groupedNs );
+  printf( "resolved frames:      %d\n",frames );
+
+  if( resultName )
+  {
+    FILE *f = fopen( resultName,"a" );
+    if( !f )
+    {
+      printf( "can't write %s\n",resultName );
+      return( 1 );
+    }
+
+    fprintf( f,"{\"label\":" );
+    jsonString( f,label );
+    fprintf( f,",\"modules\":[" );
+    for( m=0; m<moduleCount; m++ )
+    {
+      if( m ) fputc( ',',f );
+      jsonString( f,names[m] );
+    }
+    fprintf( f,"],\"stacks\":%d,\"depth\":%d,\"repetitions\":%d",
+        stacks,depth,repeat );
+    fprintf( f,",\"first_stack_ms\":%.4f",firstTime*1e3 );
+    fprintf( f,",\"interleaved_ns\":%.2f",interleavedNs );
+    fprintf( f,",\"grouped_ns\":%.2f",groupedNs );
+    fprintf( f,",\"frames\":%d}\n",frames );
+    fclose( f );
+  }
+
+  free( grouped );
+  free( interleaved );
+
+  return( 0 );
+}
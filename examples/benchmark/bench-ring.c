@@ -0,0 +1,221 @@
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#include <dwarfstack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+#define MAX_THREADS 64
+
+typedef struct producer_data
+{
+  dwstRing *ring;
+  int id;
+  int count;
+  int pushed;
+} producer_data;
+
+typedef struct consumer_data
+{
+  dwstRing *ring;
+  int *done;
+  int threadCount;
+  int drained;
+  int errors;
+  // next expected record of each producer
+  uint64_t next[MAX_THREADS];
+} consumer_data;
+
+// the content of a record follows from its producer and sequence
+static void fillRecord( dwstRingRecord *record,int id,uint64_t seq )
+{
+  int count = (int)( seq%DWST_MAX_FRAMES ) + 1;
+  record->threadId = id;
+  record->time = seq;
+  record->stack.count = count;
+  record->stack.moduleCount = 1;
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    record->stack.addr[i] = (uintptr_t)( seq*31 + i );
+    record->stack.module[i] = 0;
+  }
+  record->stack.modules[0].base = id;
+  record->stack.modules[0].timestamp = (uint32_t)seq;
+  record->stack.modules[0].sizeOfImage = count;
+}
+
+static int checkRecord( const dwstRingRecord *record )
+{
+  dwstRingRecord expected;
+  fillRecord( &expected,(int)record->threadId,record->time );
+  int count = expected.stack.count;
+  return( record->stack.count==count &&
+      record->stack.moduleCount==1 &&
+      !memcmp(record->stack.addr,expected.stack.addr,
+        count*sizeof(uintptr_t)) &&
+      !memcmp(record->stack.module,expected.stack.module,count) &&
+      !memcmp(record->stack.modules,expected.stack.modules,
+        sizeof(dwstModuleId)) );
+}
+
+#ifdef _WIN32
+static DWORD WINAPI producerThread( LPVOID arg )
+#else
+static void *producerThread( void *arg )
+#endif
+{
+  producer_data *data = arg;
+  dwstRingRecord record;
+  int i;
+  for( i=0; i<data->count; i++ )
+  {
+    fillRecord( &record,data->id,data->pushed );
+    if( dwstRingPush(data->ring,&record) )
+      data->pushed++;
+  }
+  return( 0 );
+}
+
+static int drainRing( consumer_data *data,dwstRingRecord *records,int size )
+{
+  int count = dwstRingDrain( data->ring,records,size );
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    // records of each producer arrive in order
+    uint64_t id = records[i].threadId;
+    if( id>=(uint64_t)data->threadCount ||
+        records[i].time!=data->next[id]++ ||
+        !checkRecord(&records[i]) )
+      data->errors++;
+  }
+  data->drained += count;
+  return( count );
+}
+
+#ifdef _WIN32
+static DWORD WINAPI consumerThread( LPVOID arg )
+#else
+static void *consumerThread( void *arg )
+#endif
+{
+  consumer_data *data = arg;
+  dwstRingRecord records[64];
+  while( !__atomic_load_n(data->done,__ATOMIC_ACQUIRE) )
+    drainRing( data,records,64 );
+  while( drainRing(data,records,64) );
+  return( 0 );
+}
+
+static double now( void )
+{
+#ifdef _WIN32
+  LARGE_INTEGER count,freq;
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &freq );
+  return( (double)count.QuadPart/freq.QuadPart );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC,&ts );
+  return( ts.tv_sec + ts.tv_nsec*1e-9 );
+#endif
+}
+
+int main( int argc,char **argv )
+{
+  int threadCount = argc>1 ? atoi( argv[1] ) : 8;
+  int count = argc>2 ? atoi( argv[2] ) : 1000000;
+  int capacity = argc>3 ? atoi( argv[3] ) : 4096;
+  if( threadCount<1 ) threadCount = 1;
+  if( threadCount>MAX_THREADS ) threadCount = MAX_THREADS;
+  if( count<1 ) count = 1;
+
+  dwstRing *ring = dwstRingCreate( capacity );
+  if( !ring )
+  {
+    printf( "can't create ring of %d records\n",capacity );
+    return( 1 );
+  }
+
+  producer_data producers[MAX_THREADS];
+  consumer_data consumer;
+  int done = 0;
+  memset( &consumer,0,sizeof(consumer) );
+  consumer.ring = ring;
+  consumer.done = &done;
+  consumer.threadCount = threadCount;
+
+  int t;
+  for( t=0; t<threadCount; t++ )
+  {
+    producers[t].ring = ring;
+    producers[t].id = t;
+    producers[t].count = count;
+    producers[t].pushed = 0;
+  }
+
+  double start = now();
+#ifdef _WIN32
+  HANDLE threads[MAX_THREADS];
+  HANDLE consumerHandle = CreateThread( NULL,0,consumerThread,&consumer,
+      0,NULL );
+  for( t=0; t<threadCount; t++ )
+    threads[t] = CreateThread( NULL,0,producerThread,&producers[t],0,NULL );
+  WaitForMultipleObjects( threadCount,threads,TRUE,INFINITE );
+  double pushTime = now() - start;
+  __atomic_store_n( &done,1,__ATOMIC_RELEASE );
+  WaitForSingleObject( consumerHandle,INFINITE );
+  for( t=0; t<threadCount; t++ )
+    CloseHandle( threads[t] );
+  CloseHandle( consumerHandle );
+#else
+  pthread_t threads[MAX_THREADS];
+  pthread_t consumerHandle;
+  pthread_create( &consumerHandle,NULL,consumerThread,&consumer );
+  for( t=0; t<threadCount; t++ )
+    pthread_create( &threads[t],NULL,producerThread,&producers[t] );
+  for( t=0; t<threadCount; t++ )
+    pthread_join( threads[t],NULL );
+  double pushTime = now() - start;
+  __atomic_store_n( &done,1,__ATOMIC_RELEASE );
+  pthread_join( consumerHandle,NULL );
+#endif
+
+  uint64_t attempts = (uint64_t)count*threadCount;
+  uint64_t pushed = 0;
+  for( t=0; t<threadCount; t++ )
+    pushed += producers[t].pushed;
+  uint64_t dropped = dwstRingDropped( ring );
+
+  dwstRingFree( ring );
+
+  int ok = !consumer.errors && (uint64_t)consumer.drained==pushed &&
+    pushed+dropped==attempts;
+
+  printf( "producers:            %d\n",threadCount );
+  printf( "capacity:             %d\n",capacity );
+  printf( "push:                 %.1f ns\n",
+      pushTime*1e9*threadCount/attempts );
+  printf( "pushed:               %llu\n",(unsigned long long)pushed );
+  printf( "dropped:              %llu (%.2f%%)\n",(unsigned long long)dropped,
+      dropped*100.0/attempts );
+  printf( "drained:              %d\n",consumer.drained );
+  printf( "errors:               %d\n",consumer.errors );
+  printf( "%s\n",ok ? "ok" : "FAILED" );
+
+  return( !ok );
+}
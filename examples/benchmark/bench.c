@@ -0,0 +1,404 @@
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#include <dwarfstack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+#define MAX_THREADS 64
+
+typedef struct code_range
+{
+  uint64_t start;
+  uint64_t size;
+} code_range;
+
+static uint64_t readLE( const unsigned char *p,int size )
+{
+  uint64_t v = 0;
+  while( size-- ) v = v<<8 | p[size];
+  return( v );
+}
+
+// find the executable sections of the image
+static int readCodeRanges( const char *name,code_range *ranges,int size )
+{
+  FILE *f = fopen( name,"rb" );
+  if( !f ) return( 0 );
+
+  int count = 0;
+  unsigned char dos[64];
+  unsigned char nt[24+240];
+  if( fread(dos,sizeof(dos),1,f)==1 && readLE(dos,2)==0x5a4d &&
+      !fseek(f,(long)readLE(dos+0x3c,4),SEEK_SET) &&
+      fread(nt,sizeof(nt),1,f)==1 && readLE(nt,4)==0x4550 )
+  {
+    // PE32+ (0x20b) has a 64bit ImageBase
+    uint64_t imageBase;
+    if( readLE(nt+24,2)==0x20b )
+      imageBase = readLE( nt+24+24,8 );
+    else
+      imageBase = readLE( nt+24+28,4 );
+
+    int sectionCount = (int)readLE( nt+6,2 );
+    long sections = (long)readLE( dos+0x3c,4 ) + 24 + (long)readLE( nt+20,2 );
+    int i;
+    unsigned char sec[40];
+    for( i=0; i<sectionCount && count<size &&
+        !fseek(f,sections+i*sizeof(sec),SEEK_SET) &&
+        fread(sec,sizeof(sec),1,f)==1; i++ )
+    {
+      // IMAGE_SCN_MEM_EXECUTE
+      uint64_t virtualSize = readLE( sec+8,4 );
+      if( !(readLE(sec+36,4)&0x20000000) || !virtualSize )
+        continue;
+
+      ranges[count].start = imageBase + readLE( sec+12,4 );
+      ranges[count].size = virtualSize;
+      count++;
+    }
+  }
+
+  fclose( f );
+
+  return( count );
+}
+
+static void countFrames(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  (void)addr;
+  (void)filename;
+  (void)funcname;
+  (void)columnno;
+
+  int *frames = context;
+  if( lineno>0 ) (*frames)++;
+}
+
+static void countStacks( const char *stack,uint64_t weight,void *context )
+{
+  (void)stack;
+  (void)weight;
+
+  int *stacks = context;
+  (*stacks)++;
+}
+
+typedef struct thread_data
+{
+  dwstImage *image;
+  uint64_t *addr;
+  int count;
+  int repeat;
+  int frames;
+} thread_data;
+
+#ifdef _WIN32
+static DWORD WINAPI lookupThread( LPVOID arg )
+#else
+static void *lookupThread( void *arg )
+#endif
+{
+  thread_data *data = arg;
+  int r;
+  for( r=0; r<data->repeat; r++ )
+    dwstOfImage( data->image,0,data->addr,data->count,
+        countFrames,&data->frames );
+  return( 0 );
+}
+
+static double now( void )
+{
+#ifdef _WIN32
+  LARGE_INTEGER count,freq;
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &freq );
+  return( (double)count.QuadPart/freq.QuadPart );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC,&ts );
+  return( ts.tv_sec + ts.tv_nsec*1e-9 );
+#endif
+}
+
+static int processorCount( void )
+{
+#ifdef _WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo( &si );
+  return( si.dwNumberOfProcessors );
+#else
+  return( (int)sysconf(_SC_NPROCESSORS_ONLN) );
+#endif
+}
+
+// peak resident memory of the process in KiB
+static uint64_t peakRss( void )
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if( !GetProcessMemoryInfo(GetCurrentProcess(),&pmc,sizeof(pmc)) )
+    return( 0 );
+  return( pmc.PeakWorkingSetSize/1024 );
+#else
+  struct rusage ru;
+  if( getrusage(RUSAGE_SELF,&ru) ) return( 0 );
+  return( ru.ru_maxrss );
+#endif
+}
+
+static double runThreads( thread_data *data,int threadCount )
+{
+  double start = now();
+  int t;
+#ifdef _WIN32
+  HANDLE threads[MAX_THREADS];
+  for( t=0; t<threadCount; t++ )
+    threads[t] = CreateThread( NULL,0,lookupThread,&data[t],0,NULL );
+  WaitForMultipleObjects( threadCount,threads,TRUE,INFINITE );
+  for( t=0; t<threadCount; t++ )
+    CloseHandle( threads[t] );
+#else
+  pthread_t threads[MAX_THREADS];
+  for( t=0; t<threadCount; t++ )
+    pthread_create( &threads[t],NULL,lookupThread,&data[t] );
+  for( t=0; t<threadCount; t++ )
+    pthread_join( threads[t],NULL );
+#endif
+  return( now() - start );
+}
+
+// strings of the results are only file names and labels
+static void jsonString( FILE *f,const char *str )
+{
+  fputc( '"',f );
+  for( ; *str; str++ )
+  {
+    if( *str=='"' || *str=='\\' )
+      fputc( '\\',f );
+    if( (unsigned char)*str<0x20 )
+      fprintf( f,"\\u%04x",*str );
+    else
+      fputc( *str,f );
+  }
+  fputc( '"',f );
+}
+
+int main( int argc,char **argv )
+{
+  const char *resultName = NULL;
+  const char *label = "";
+  const char *args[4] = { NULL,NULL,NULL,NULL };
+  int argCount = 0;
+  int a;
+  for( a=1; a<argc; a++ )
+  {
+    if( argv[a][0]=='-' && argv[a][1]=='o' && argv[a][2] )
+      resultName = argv[a] + 2;
+    else if( argv[a][0]=='-' && argv[a][1]=='l' )
+      label = argv[a] + 2;
+    else if( argCount<4 )
+      args[argCount++] = argv[a];
+  }
+
+  if( !argCount )
+  {
+    printf( "Usage: %s [option(s)] [executable] [address count] "
+        "[repetitions] [max threads]\n",argv[0] );
+    printf( " -o<results>                 Append results as JSON line\n" );
+    printf( " -l<label>                   Label of the results\n" );
+    return( 1 );
+  }
+
+  const char *name = args[0];
+  int count = args[1] ? atoi( args[1] ) : 10000;
+  int repeat = args[2] ? atoi( args[2] ) : 10;
+  int maxThreads = args[3] ? atoi( args[3] ) : 0;
+  if( count<1 ) count = 1;
+  if( repeat<1 ) repeat = 1;
+  if( maxThreads<1 ) maxThreads = processorCount();
+  if( maxThreads>MAX_THREADS ) maxThreads = MAX_THREADS;
+
+  code_range ranges[16];
+  int rangeCount = readCodeRanges( name,ranges,16 );
+  if( !rangeCount )
+  {
+    printf( "no code sections found in %s\n",name );
+    return( 1 );
+  }
+
+  uint64_t codeSize = 0;
+  int r;
+  for( r=0; r<rangeCount; r++ )
+    codeSize += ranges[r].size;
+
+  // random addresses, evenly distributed over all code sections
+  uint64_t *addr = malloc( count*sizeof(uint64_t) );
+  if( !addr ) return( 1 );
+  srand( 1 );
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    uint64_t offs = ((uint64_t)rand()<<15 ^ rand()) % codeSize;
+    for( r=0; offs>=ranges[r].size; r++ )
+      offs -= ranges[r].size;
+    addr[i] = ranges[r].start + offs;
+  }
+
+  int frames = 0;
+  double start = now();
+  dwstImage *image = dwstOpenFile( name );
+  double openTime = now() - start;
+  if( !image )
+  {
+    printf( "can't open %s\n",name );
+    return( 1 );
+  }
+
+  start = now();
+  dwstOfImage( image,0,addr,1,countFrames,&frames );
+  double firstLookupTime = now() - start;
+
+  start = now();
+  dwstOfImage( image,0,addr,count,countFrames,&frames );
+  double firstTime = now() - start;
+
+  // one address per call
+  start = now();
+  for( r=0; r<repeat; r++ )
+    for( i=0; i<count; i++ )
+      dwstOfImage( image,0,addr+i,1,countFrames,&frames );
+  double steadyTime = now() - start;
+
+  // all addresses in one call
+  start = now();
+  for( r=0; r<repeat; r++ )
+    dwstOfImage( image,0,addr,count,countFrames,&frames );
+  double batchTime = now() - start;
+
+  // sampled stacks of the same addresses, each of them repeated
+  int depth = count<8 ? count : 8;
+  int paths = count/depth;
+  int sampleCount = count*repeat;
+  dwstSample *samples = malloc( sampleCount*sizeof(dwstSample) );
+  if( !samples ) return( 1 );
+  for( i=0; i<sampleCount; i++ )
+  {
+    samples[i].addr = addr + rand()%paths*depth;
+    samples[i].count = depth;
+    samples[i].weight = 1;
+  }
+  int stacks = 0;
+  start = now();
+  dwstFoldImage( image,0,samples,sampleCount,countStacks,&stacks );
+  double foldTime = now() - start;
+  free( samples );
+
+  // all threads look up the same addresses in the shared handle
+  int threadCounts[8];
+  double threadTimes[8];
+  int threadRuns = 0;
+  int threadCount;
+  for( threadCount=1; threadRuns<8; threadCount*=2 )
+  {
+    if( threadCount>maxThreads ) threadCount = maxThreads;
+
+    thread_data data[MAX_THREADS];
+    int t;
+    for( t=0; t<threadCount; t++ )
+    {
+      data[t].image = image;
+      data[t].addr = addr;
+      data[t].count = count;
+      data[t].repeat = repeat;
+      data[t].frames = 0;
+    }
+    threadTimes[threadRuns] = runThreads( data,threadCount );
+    threadCounts[threadRuns++] = threadCount;
+
+    if( threadCount==maxThreads ) break;
+  }
+
+  dwstCloseImage( image );
+
+  start = now();
+  dwstOfFile( name,0,addr,1,countFrames,&frames );
+  double fileTime = now() - start;
+
+  uint64_t rss = peakRss();
+
+  double firstNs = firstTime*1e9/count;
+  double steadyNs = steadyTime*1e9/((double)count*repeat);
+  double batchRate = (double)count*repeat/batchTime;
+  double foldNs = foldTime*1e9/sampleCount;
+
+  printf( "image:                %s\n",name );
+  printf( "addresses:            %d\n",count );
+  printf( "open:                 %.3f ms\n",openTime*1e3 );
+  printf( "first lookup:         %.3f ms\n",firstLookupTime*1e3 );
+  printf( "first pass:           %.1f ns/address\n",firstNs );
+  printf( "steady state:         %.1f ns/address\n",steadyNs );
+  printf( "batch:                %.0f addresses/s\n",batchRate );
+  printf( "fold:                 %.1f ns/sample, %d stacks\n",foldNs,stacks );
+  for( r=0; r<threadRuns; r++ )
+    printf( "%2d thread(s):         %.1f ns/address, %.2fx\n",
+        threadCounts[r],
+        threadTimes[r]*1e9/((double)count*repeat*threadCounts[r]),
+        threadCounts[r]*threadTimes[0]/threadTimes[r] );
+  printf( "dwstOfFile (1 addr):  %.3f ms\n",fileTime*1e3 );
+  printf( "peak RSS:             %llu KiB\n",(unsigned long long)rss );
+  printf( "resolved frames:      %d\n",frames );
+
+  if( resultName )
+  {
+    FILE *f = fopen( resultName,"a" );
+    if( !f )
+    {
+      printf( "can't write %s\n",resultName );
+      free( addr );
+      return( 1 );
+    }
+
+    fprintf( f,"{\"label\":" );
+    jsonString( f,label );
+    fprintf( f,",\"image\":" );
+    jsonString( f,name );
+    fprintf( f,",\"addresses\":%d,\"repetitions\":%d",count,repeat );
+    fprintf( f,",\"open_ms\":%.4f",openTime*1e3 );
+    fprintf( f,",\"first_lookup_ms\":%.4f",firstLookupTime*1e3 );
+    fprintf( f,",\"first_pass_ns\":%.2f",firstNs );
+    fprintf( f,",\"steady_ns\":%.2f",steadyNs );
+    fprintf( f,",\"batch_per_s\":%.0f",batchRate );
+    fprintf( f,",\"fold_ns\":%.2f,\"folded_stacks\":%d",foldNs,stacks );
+    fprintf( f,",\"threads\":[" );
+    for( r=0; r<threadRuns; r++ )
+      fprintf( f,"%s{\"count\":%d,\"ns\":%.2f}",r?",":"",threadCounts[r],
+          threadTimes[r]*1e9/((double)count*repeat*threadCounts[r]) );
+    fprintf( f,"]" );
+    fprintf( f,",\"file_ms\":%.4f",fileTime*1e3 );
+    fprintf( f,",\"peak_rss_kib\":%llu",(unsigned long long)rss );
+    fprintf( f,",\"frames\":%d}\n",frames );
+    fclose( f );
+  }
+
+  free( addr );
+
+  return( 0 );
+}
@@ -0,0 +1,87 @@
+
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// large C++ program with deep inline chains, benchmark fixture:
+// every work<I>() contains a chain of INLINE_DEPTH inlined step<>() calls,
+// and the standard containers add the usual library inlining on top
+
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+#ifndef FUNC_COUNT
+#define FUNC_COUNT 1024
+#endif
+#ifndef INLINE_DEPTH
+#define INLINE_DEPTH 8
+#endif
+
+
+namespace fixture {
+
+template<int I,int D>
+struct step
+{
+  __attribute__((always_inline))
+  static inline unsigned apply( unsigned x,std::vector<unsigned> &trace )
+  {
+    x = x*2654435761u + I*31 + D;
+    if( (x&0xff)==D ) trace.push_back( x );
+    return( step<I,D-1>::apply(x ^ (x>>15),trace) );
+  }
+};
+
+template<int I>
+struct step<I,0>
+{
+  __attribute__((always_inline))
+  static inline unsigned apply( unsigned x,std::vector<unsigned> &trace )
+  {
+    trace.push_back( x );
+    return( x );
+  }
+};
+
+template<int I>
+__attribute__((noinline))
+unsigned work( unsigned x,std::map<std::string,unsigned> &results )
+{
+  std::vector<unsigned> trace;
+  unsigned r = step<I,INLINE_DEPTH>::apply( x,trace );
+  results[std::to_string(I)] += r + (unsigned)trace.size();
+  return( r );
+}
+
+typedef unsigned work_func( unsigned,std::map<std::string,unsigned>& );
+
+template<int... I>
+static work_func *const *workTable( std::integer_sequence<int,I...> )
+{
+  static work_func *const table[] = { &work<I>... };
+  return( table );
+}
+
+}
+
+
+int main( int argc,char ** )
+{
+  fixture::work_func *const *table =
+    fixture::workTable( std::make_integer_sequence<int,FUNC_COUNT>() );
+
+  std::map<std::string,unsigned> results;
+  unsigned x = argc;
+  for( int i=0; i<FUNC_COUNT; i++ )
+    x = table[i]( x,results );
+
+  std::printf( "%u %u\n",x,(unsigned)results.size() );
+
+  return( 0 );
+}
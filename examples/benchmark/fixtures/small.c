@@ -0,0 +1,71 @@
+
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// small C program, benchmark fixture
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct item
+{
+  char name[32];
+  int value;
+} item;
+
+static int cmpItem( const void *a,const void *b )
+{
+  const item *ia = a;
+  const item *ib = b;
+  if( ia->value!=ib->value ) return( ia->value<ib->value ? -1 : 1 );
+  return( strcmp(ia->name,ib->name) );
+}
+
+static inline int scramble( int x )
+{
+  x ^= x<<13;
+  x ^= x>>17;
+  x ^= x<<5;
+  return( x );
+}
+
+static void fillItems( item *items,int count )
+{
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    items[i].value = scramble( i+1 ) & 0xffff;
+    snprintf( items[i].name,sizeof(items[i].name),"item-%d",i );
+  }
+}
+
+static int sumItems( const item *items,int count )
+{
+  int sum = 0;
+  int i;
+  for( i=0; i<count; i++ )
+    sum += items[i].value;
+  return( sum );
+}
+
+int main( int argc,char **argv )
+{
+  int count = argc>1 ? atoi( argv[1] ) : 100;
+  if( count<1 ) count = 1;
+
+  item *items = malloc( count*sizeof(item) );
+  if( !items ) return( 1 );
+
+  fillItems( items,count );
+  qsort( items,count,sizeof(item),cmpItem );
+  printf( "%s %d\n",items[0].name,sumItems(items,count) );
+
+  free( items );
+
+  return( 0 );
+}
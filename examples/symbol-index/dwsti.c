@@ -0,0 +1,255 @@
+
+//          Copyright Hannes Domani 2026.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file ../LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#include <dwarfstack.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+
+#define MAX_THREADS 64
+
+typedef struct index_job
+{
+  const char *name;
+  const char *indexName;
+  int ok;
+  double time;
+  dwstIndexStats stats;
+} index_job;
+
+typedef struct job_queue
+{
+  index_job *jobs;
+  int count;
+  atomic_int next;
+} job_queue;
+
+static double now( void )
+{
+#ifdef _WIN32
+  LARGE_INTEGER count,freq;
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &freq );
+  return( (double)count.QuadPart/freq.QuadPart );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC,&ts );
+  return( ts.tv_sec + ts.tv_nsec*1e-9 );
+#endif
+}
+
+static void buildIndex( index_job *job )
+{
+  double start = now();
+
+  // an existing index is replaced, so it must not be mapped
+  dwstImage *image = dwstOpenFileNoIndex( job->name );
+  if( image )
+  {
+    job->ok = dwstWriteIndex( image,job->indexName,&job->stats );
+    dwstCloseImage( image );
+  }
+
+  job->time = now() - start;
+}
+
+// each worker takes the next image until all are done
+#ifdef _WIN32
+static DWORD WINAPI indexThread( LPVOID arg )
+#else
+static void *indexThread( void *arg )
+#endif
+{
+  job_queue *queue = arg;
+  int j;
+  while( (j=atomic_fetch_add(&queue->next,1))<queue->count )
+    buildIndex( &queue->jobs[j] );
+  return( 0 );
+}
+
+static int processorCount( void )
+{
+#ifdef _WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo( &si );
+  return( si.dwNumberOfProcessors );
+#else
+  return( (int)sysconf(_SC_NPROCESSORS_ONLN) );
+#endif
+}
+
+static void runJobs( job_queue *queue,int threadCount )
+{
+  if( threadCount>queue->count ) threadCount = queue->count;
+  if( threadCount<=1 )
+  {
+    indexThread( queue );
+    return;
+  }
+
+  // without any other thread, the remaining jobs are done here
+  int t,started = 0;
+#ifdef _WIN32
+  HANDLE threads[MAX_THREADS];
+  for( t=0; t<threadCount; t++ )
+  {
+    threads[started] = CreateThread( NULL,0,indexThread,queue,0,NULL );
+    if( threads[started] ) started++;
+  }
+  if( !started ) indexThread( queue );
+  if( started )
+    WaitForMultipleObjects( started,threads,TRUE,INFINITE );
+  for( t=0; t<started; t++ )
+    CloseHandle( threads[t] );
+#else
+  pthread_t threads[MAX_THREADS];
+  for( t=0; t<threadCount; t++ )
+  {
+    if( !pthread_create(&threads[started],NULL,indexThread,queue) )
+      started++;
+  }
+  if( !started ) indexThread( queue );
+  for( t=0; t<started; t++ )
+    pthread_join( threads[t],NULL );
+#endif
+}
+
+static void usage( const char *exe )
+{
+  const char *delim = strrchr( exe,'/' );
+  if( delim ) exe = delim + 1;
+  delim = strrchr( exe,'\\' );
+  if( delim ) exe = delim + 1;
+
+  printf( "Usage: %s [option(s)] [executable(s)]\n",exe );
+  printf( " -j<threads>                 Number of worker threads\n" );
+  printf( " -o<index>                   Index location (single executable)\n" );
+  printf( " -q                          Only report failures\n" );
+  printf( "The index is written next to the executable (<executable>.dwsti),"
+      "\nwhere dwstOpenFile() finds it.\n" );
+}
+
+int main( int argc,char **argv )
+{
+  int threadCount = 0;
+  const char *indexName = NULL;
+  int quiet = 0;
+
+  index_job *jobs = calloc( argc,sizeof(index_job) );
+  if( !jobs ) return( 1 );
+  int jobCount = 0;
+  int i;
+  for( i=1; i<argc; i++ )
+  {
+    if( argv[i][0]=='-' && argv[i][1]=='j' )
+      threadCount = atoi( argv[i]+2 );
+    else if( argv[i][0]=='-' && argv[i][1]=='o' && argv[i][2] )
+      indexName = argv[i] + 2;
+    else if( argv[i][0]=='-' && argv[i][1]=='q' )
+      quiet = 1;
+    else
+      jobs[jobCount++].name = argv[i];
+  }
+
+  if( !jobCount || (indexName && jobCount>1) )
+  {
+    usage( argv[0] );
+    free( jobs );
+    return( 1 );
+  }
+  jobs[0].indexName = indexName;
+
+  if( threadCount<1 ) threadCount = processorCount();
+  if( threadCount>MAX_THREADS ) threadCount = MAX_THREADS;
+
+  job_queue queue;
+  queue.jobs = jobs;
+  queue.count = jobCount;
+  atomic_init( &queue.next,0 );
+
+  double start = now();
+  runJobs( &queue,threadCount );
+  double wallTime = now() - start;
+
+  int failed = 0;
+  double buildTime = 0;
+  dwstIndexStats total;
+  memset( &total,0,sizeof(total) );
+  for( i=0; i<jobCount; i++ )
+  {
+    const index_job *job = &jobs[i];
+    if( !job->ok )
+    {
+      printf( "%s: can't write index\n",job->name );
+      failed++;
+      continue;
+    }
+
+    const dwstIndexStats *st = &job->stats;
+    buildTime += job->time;
+    total.debugSize += st->debugSize;
+    total.indexSize += st->indexSize;
+    total.cuCount += st->cuCount;
+    total.rangeCount += st->rangeCount;
+    total.lineCount += st->lineCount;
+    total.fileCount += st->fileCount;
+    total.nodeCount += st->nodeCount;
+    total.inlineCount += st->inlineCount;
+    total.stringSize += st->stringSize;
+    if( quiet ) continue;
+
+    printf( "%s:\n",job->name );
+    printf( "  build time:         %.3f ms\n",job->time*1e3 );
+    printf( "  debug information:  %llu bytes\n",
+        (unsigned long long)st->debugSize );
+    printf( "  index:              %llu bytes",
+        (unsigned long long)st->indexSize );
+    if( st->debugSize )
+      printf( " (%.1f%%)",100.0*st->indexSize/st->debugSize );
+    printf( "\n" );
+    printf( "  CUs:                %d (%d address ranges)\n",
+        st->cuCount,st->rangeCount );
+    printf( "  line rows:          %d\n",st->lineCount );
+    printf( "  source files:       %d\n",st->fileCount );
+    printf( "  functions:          %d (%d address ranges)\n",
+        st->nodeCount,st->inlineCount );
+    printf( "  strings:            %llu bytes\n",
+        (unsigned long long)st->stringSize );
+  }
+
+  if( !quiet && jobCount>1 )
+  {
+    printf( "total (%d of %d images, %d threads):\n",
+        jobCount-failed,jobCount,
+        threadCount<jobCount ? threadCount : jobCount );
+    printf( "  wall time:          %.3f ms\n",wallTime*1e3 );
+    printf( "  build time:         %.3f ms\n",buildTime*1e3 );
+    printf( "  debug information:  %llu bytes\n",
+        (unsigned long long)total.debugSize );
+    printf( "  index:              %llu bytes",
+        (unsigned long long)total.indexSize );
+    if( total.debugSize )
+      printf( " (%.1f%%)",100.0*total.indexSize/total.debugSize );
+    printf( "\n" );
+    printf( "  line rows:          %d\n",total.lineCount );
+    printf( "  functions:          %d\n",total.nodeCount );
+  }
+
+  free( jobs );
+
+  return( failed ? 1 : 0 );
+}
@@ -20,10 +20,13 @@
 #ifndef __DWARFSTACK_H__
 #define __DWARFSTACK_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 
-#if defined(DWST_STATIC)
+#if !defined(_WIN32)
+#define EXPORT __attribute__((visibility("default")))
+#elif defined(DWST_STATIC)
 #define EXPORT
 #elif defined(DWST_SHARED)
 #define EXPORT __declspec(dllexport)
@@ -95,11 +98,189 @@ EXPORT int dwstOfFileW(
     dwstCallbackW *callbackFunc,void *callbackContext );
 
 
+// dwstImage: handle of an opened executable
+//   (keeps the parsed debug information alive between lookups)
+typedef struct dwstImage dwstImage;
+
+// dwstOpenFile(): open executable for repeated lookups
+//   name:              executable location
+//   returns NULL on failure
+//   (executables without debug information can still be opened,
+//    all their lookups report DWST_NO_DBG_SYM)
+EXPORT dwstImage *dwstOpenFile(
+    const char *name );
+
+EXPORT dwstImage *dwstOpenFileW(
+    const wchar_t *name );
+
+
+// dwstOfImage(): stack information of opened executable
+//   image:             handle of dwstOpenFile()
+//   imageBase:         used image base address
+//   addr:              stack addresses
+//   count:             number of addresses
+//   callbackFunc:      callback function
+//   callbackContext:   user-provided pointer (context)
+//      (the funcname pointers of the callback stay valid
+//       until dwstCloseImage(),
+//       and multiple threads can look up the same handle concurrently)
+EXPORT int dwstOfImage(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext );
+
+EXPORT int dwstOfImageW(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallbackW *callbackFunc,void *callbackContext );
+
+
+// dwstFuncCallback(): callback function of dwstAddrOfFunc()
+//   low:               start address of function
+//   high:              end address of function (exclusive)
+//   filename:          source file location of declaration (or NULL)
+//   lineno:            line number of declaration (or 0)
+//   funcname:          function name
+//   context:           user-provided pointer (callbackContext)
+//      (functions with non-contiguous code report each address range)
+typedef void dwstFuncCallback(
+    uint64_t low,uint64_t high,const char *filename,int lineno,
+    const char *funcname,void *context );
+
+typedef void dwstFuncCallbackW(
+    uint64_t low,uint64_t high,const wchar_t *filename,int lineno,
+    const char *funcname,void *context );
+
+// dwstAddrOfFunc(): address ranges of function in opened executable
+//   image:             handle of dwstOpenFile()
+//   imageBase:         used image base address
+//   funcname:          function name, either as reported in the callback
+//                      of dwstOfImage(), or without scope and parameters
+//   callbackFunc:      callback function
+//   callbackContext:   user-provided pointer (context)
+//   returns number of reported address ranges
+EXPORT int dwstAddrOfFunc(
+    dwstImage *image,uint64_t imageBase,const char *funcname,
+    dwstFuncCallback *callbackFunc,void *callbackContext );
+
+EXPORT int dwstAddrOfFuncW(
+    dwstImage *image,uint64_t imageBase,const char *funcname,
+    dwstFuncCallbackW *callbackFunc,void *callbackContext );
+
+
+// dwstIndexStats: statistics of dwstWriteIndex()
+typedef struct dwstIndexStats
+{
+  uint64_t debugSize;   // size of the debug information sections
+  uint64_t indexSize;   // size of the written index
+  int cuCount;          // compilation units
+  int rangeCount;       // address ranges of compilation units
+  int lineCount;        // line table rows
+  int fileCount;        // source files
+  int nodeCount;        // functions and inlined subroutines
+  int inlineCount;      // address ranges of functions
+  uint64_t stringSize;  // size of the string table
+} dwstIndexStats;
+
+// dwstWriteIndex(): write symbol index of opened executable
+//   image:             handle of dwstOpenFile()
+//   name:              index location, or NULL for the default location
+//                      next to the executable (<executable>.dwsti)
+//   stats:             statistics of the index (or NULL)
+//   returns 1 on success
+//      (dwstOpenFile() uses the index at the default location instead
+//       of the debug information if it matches the executable,
+//       then lookups need no parsing at all,
+//       only dwstAddrOfFunc() still reads the debug information)
+EXPORT int dwstWriteIndex(
+    dwstImage *image,const char *name,dwstIndexStats *stats );
+
+EXPORT int dwstWriteIndexW(
+    dwstImage *image,const wchar_t *name,dwstIndexStats *stats );
+
+// dwstOpenFileNoIndex(): open executable without its symbol index
+//   name:              executable location
+//   returns NULL on failure
+//      (always uses the debug information, so the index at the default
+//       location isn't mapped and dwstWriteIndex() can replace it)
+EXPORT dwstImage *dwstOpenFileNoIndex(
+    const char *name );
+
+EXPORT dwstImage *dwstOpenFileNoIndexW(
+    const wchar_t *name );
+
+
+// dwstStats: work done by lookups
+//   (times are in nanoseconds, only the reading of the
+//    debug information is timed, not the lookups themselves)
+typedef struct dwstStats
+{
+  uint64_t calls;          // lookup calls
+  uint64_t addresses;      // looked up addresses
+  uint64_t cusExamined;    // compilation units searched for an address
+  uint64_t cuHits;         // CU tables which were already decoded
+  uint64_t cuMisses;       // CU tables decoded by the lookup
+  uint64_t cuEvictions;    // CU tables freed to stay within the budget
+  uint64_t lineRows;       // decoded line table rows
+  uint64_t diesVisited;    // DIEs visited while building inline trees
+  uint64_t offdieCalls;    // DIEs read by their offset
+  uint64_t bytesInflated;  // decompressed bytes of debug sections
+  uint64_t demangleCalls;  // demangled function names
+  uint64_t nameHits;       // function names found in the name cache
+  uint64_t nameMisses;     // function names read from their DIE
+  uint64_t openTime;       // opening and reading the CU ranges
+  uint64_t lineTime;       // decoding line tables
+  uint64_t fileTime;       // reading source file tables
+  uint64_t inlineTime;     // building inline trees
+  uint64_t nameTime;       // reading and demangling function names
+} dwstStats;
+
+// dwstLastStats(): statistics of the last lookup of the calling thread
+//   stats:             statistics of the last dwstOfFile() or dwstOfImage()
+//      (for dwstOfFile() they include opening the executable)
+EXPORT void dwstLastStats(
+    dwstStats *stats );
+
+// dwstImageStats(): statistics of opened executable
+//   image:             handle of dwstOpenFile()
+//   stats:             statistics of all lookups since dwstOpenFile()
+//   returns 1 on success
+//      (dwstAddrOfFunc() and dwstWriteIndex() add the tables
+//       they decode, but don't count as lookup calls)
+EXPORT int dwstImageStats(
+    dwstImage *image,dwstStats *stats );
+
+
+// dwstSetCacheBudget(): limit memory of the decoded CU tables
+//   image:             handle of dwstOpenFile(),
+//                      or NULL for the limit of all handles together
+//   budget:            maximum size in bytes, or 0 for no limit (default)
+//      (the least recently used line, file and inline tables are freed
+//       when the limit is exceeded, and decoded again when needed,
+//       tables used by running lookups are kept)
+EXPORT void dwstSetCacheBudget(
+    dwstImage *image,size_t budget );
+
+// dwstCacheSize(): memory of the decoded CU tables
+//   image:             handle of dwstOpenFile(), or NULL for all handles
+//   returns size in bytes
+EXPORT size_t dwstCacheSize(
+    dwstImage *image );
+
+
+// dwstCloseImage(): close handle of dwstOpenFile()
+//   image:             handle of dwstOpenFile()
+EXPORT void dwstCloseImage(
+    dwstImage *image );
+
+
 // dwstOfProcess(): stack information of current process
 //   addr:              stack addresses
 //   count:             number of addresses
 //   callbackFunc:      callback function
 //   callbackContext:   user-provided pointer (context)
+//      (all addresses of a module are looked up together,
+//       but the callbacks are still in the order of the addresses)
 EXPORT int dwstOfProcess(
     uintptr_t *addr,int count,
     dwstCallback *callbackFunc,void *callbackContext );
@@ -134,6 +315,346 @@ EXPORT int dwstOfExceptionW(
     dwstCallbackW *callbackFunc,void *callbackContext );
 
 
+// DWST_MAX_FRAMES: maximum number of addresses of a raw stack
+#define DWST_MAX_FRAMES         32
+
+// DWST_NO_MODULE: address is not in a loaded module
+#define DWST_NO_MODULE          0xff
+
+// dwstModuleId: identity of a loaded module
+typedef struct dwstModuleId
+{
+  uintptr_t base;          // load address
+  uint32_t timestamp;      // TimeDateStamp of the PE header
+  uint32_t sizeOfImage;    // SizeOfImage of the PE header
+} dwstModuleId;
+
+// dwstRawStack: stack addresses, not yet resolved
+//   (the module identities tell if the addresses still belong
+//    to the same executables when they are resolved later)
+typedef struct dwstRawStack
+{
+  int count;                              // number of addresses
+  int moduleCount;                        // number of modules
+  uintptr_t addr[DWST_MAX_FRAMES];        // stack addresses
+  uint8_t module[DWST_MAX_FRAMES];        // module of each address,
+                                          // or DWST_NO_MODULE
+  dwstModuleId modules[DWST_MAX_FRAMES];  // modules of the addresses
+} dwstRawStack;
+
+// dwstCaptureLocation(): raw stack of current location
+//   stack:             buffer of the stack
+//   returns number of addresses
+//      (only the addresses and their modules are recorded,
+//       the stack is resolved with dwstOfRawStack() or a dwstQueue)
+EXPORT int dwstCaptureLocation(
+    dwstRawStack *stack );
+
+// dwstCaptureException(): raw stack of exception
+//   context:           ContextRecord of exception
+//   stack:             buffer of the stack
+//   returns number of addresses
+EXPORT int dwstCaptureException(
+    void *context,dwstRawStack *stack );
+
+// dwstOfRawStack(): stack information of raw stack
+//   stack:             stack of dwstCaptureLocation()
+//   callbackFunc:      callback function
+//   callbackContext:   user-provided pointer (context)
+//      (addresses of modules which were unloaded since the capture
+//       are skipped)
+EXPORT int dwstOfRawStack(
+    const dwstRawStack *stack,
+    dwstCallback *callbackFunc,void *callbackContext );
+
+EXPORT int dwstOfRawStackW(
+    const dwstRawStack *stack,
+    dwstCallbackW *callbackFunc,void *callbackContext );
+
+
+// dwstQueue: raw stacks waiting to be resolved
+typedef struct dwstQueue dwstQueue;
+
+// dwstQueueCreate(): create queue for deferred resolving of raw stacks
+//   callbackFunc:      callback function
+//   worker:            1 to resolve the stacks on a worker thread,
+//                      0 to resolve them only with dwstQueueFlush()
+//   returns NULL on failure
+//      (the callbacks of the stacks are never called concurrently,
+//       and in the order the stacks were added)
+EXPORT dwstQueue *dwstQueueCreate(
+    dwstCallback *callbackFunc,int worker );
+
+EXPORT dwstQueue *dwstQueueCreateW(
+    dwstCallbackW *callbackFunc,int worker );
+
+// dwstQueuePush(): add raw stack to queue
+//   queue:             handle of dwstQueueCreate()
+//   stack:             stack of dwstCaptureLocation(), it's copied
+//   callbackContext:   user-provided pointer (context)
+//                      of the callbacks of this stack
+//   returns 1 on success
+EXPORT int dwstQueuePush(
+    dwstQueue *queue,const dwstRawStack *stack,void *callbackContext );
+
+// dwstQueueFlush(): resolve the queued stacks in the calling thread
+//   queue:             handle of dwstQueueCreate()
+//   returns number of resolved stacks
+EXPORT int dwstQueueFlush(
+    dwstQueue *queue );
+
+// dwstQueueFree(): resolve the remaining stacks, and free queue
+//   queue:             handle of dwstQueueCreate()
+EXPORT void dwstQueueFree(
+    dwstQueue *queue );
+
+
+// dwstRingRecord: raw stack of a thread
+typedef struct dwstRingRecord
+{
+  uint64_t threadId;       // id of the capturing thread
+  uint64_t time;           // capture time in nanoseconds (monotonic)
+  dwstRawStack stack;      // captured stack
+} dwstRingRecord;
+
+// dwstRing: fixed-size ring of raw stacks, filled by any number
+//   of threads without locks, and drained by one thread
+typedef struct dwstRing dwstRing;
+
+// dwstRingCreate(): create ring
+//   capacity:          number of records, rounded up to a power of 2
+//   returns NULL on failure
+EXPORT dwstRing *dwstRingCreate(
+    int capacity );
+
+// dwstRingPush(): add record to ring
+//   ring:              handle of dwstRingCreate()
+//   record:            record, it's copied
+//   returns 0 if the ring is full, then the record is dropped
+EXPORT int dwstRingPush(
+    dwstRing *ring,const dwstRingRecord *record );
+
+// dwstRingCapture(): add raw stack of current location to ring
+//   ring:              handle of dwstRingCreate()
+//   returns number of addresses, or 0 if the ring is full
+//      (the stack is captured directly into the ring)
+EXPORT int dwstRingCapture(
+    dwstRing *ring );
+
+// dwstRingDrain(): take the oldest records out of the ring
+//   ring:              handle of dwstRingCreate()
+//   records:           buffer of the records
+//   size:              maximum number of records
+//   returns number of records
+//      (only one thread may drain the ring at a time)
+EXPORT int dwstRingDrain(
+    dwstRing *ring,dwstRingRecord *records,int size );
+
+// dwstRingResolve(): resolve the records of the ring
+//   ring:              handle of dwstRingCreate()
+//   maxCount:          maximum number of records, or 0 for all
+//   callbackFunc:      callback function
+//   returns number of resolved records
+//      (the context of the callback is the const dwstRingRecord*,
+//       only valid during the callback)
+EXPORT int dwstRingResolve(
+    dwstRing *ring,int maxCount,dwstCallback *callbackFunc );
+
+EXPORT int dwstRingResolveW(
+    dwstRing *ring,int maxCount,dwstCallbackW *callbackFunc );
+
+// dwstRingDropped(): number of records dropped because the ring was full
+//   ring:              handle of dwstRingCreate()
+EXPORT uint64_t dwstRingDropped(
+    dwstRing *ring );
+
+// dwstRingFree(): free ring
+//   ring:              handle of dwstRingCreate()
+EXPORT void dwstRingFree(
+    dwstRing *ring );
+
+
+// dwstStackTable: unique raw stacks with their number of occurrences
+//   (frames shared by several stacks are resolved only once,
+//    a table must not be used by multiple threads at the same time)
+typedef struct dwstStackTable dwstStackTable;
+
+// dwstStackCount: unique stack of dwstStackTableCounts()
+typedef struct dwstStackCount
+{
+  int id;                  // id of dwstStackTableAdd()
+  uint64_t count;          // number of occurrences
+} dwstStackCount;
+
+// dwstStackTableCreate(): create table
+//   returns NULL on failure
+EXPORT dwstStackTable *dwstStackTableCreate( void );
+
+// dwstStackTableAdd(): add occurrence of raw stack
+//   table:             handle of dwstStackTableCreate()
+//   stack:             stack of dwstCaptureLocation()
+//   returns id of the stack, or -1 on failure
+//      (equal stacks get the same id, the ids of new stacks
+//       are counted up from 0)
+EXPORT int dwstStackTableAdd(
+    dwstStackTable *table,const dwstRawStack *stack );
+
+// dwstStackTableCounts(): occurrences of the unique stacks
+//   table:             handle of dwstStackTableCreate()
+//   counts:            buffer of the counts (or NULL)
+//   size:              maximum number of counts
+//   returns number of unique stacks
+EXPORT int dwstStackTableCounts(
+    dwstStackTable *table,dwstStackCount *counts,int size );
+
+// dwstStackTableFrames(): stack information of unique stack
+//   table:             handle of dwstStackTableCreate()
+//   id:                id of dwstStackTableAdd()
+//   callbackFunc:      callback function
+//   callbackContext:   user-provided pointer (context)
+//   returns number of resolved addresses
+//      (all frames added since the last call are resolved together,
+//       and the results are kept, so later calls only replay them)
+EXPORT int dwstStackTableFrames(
+    dwstStackTable *table,int id,
+    dwstCallback *callbackFunc,void *callbackContext );
+
+EXPORT int dwstStackTableFramesW(
+    dwstStackTable *table,int id,
+    dwstCallbackW *callbackFunc,void *callbackContext );
+
+// dwstStackTableFree(): free table
+//   table:             handle of dwstStackTableCreate()
+EXPORT void dwstStackTableFree(
+    dwstStackTable *table );
+
+
+// dwstReadMemory(): callback function of dwstUnwindImage()
+//   addr:              address in the unwound thread
+//   buffer:            buffer of the read bytes
+//   size:              number of bytes
+//   context:           user-provided pointer (readContext)
+//   returns nonzero on success
+typedef int dwstReadMemory(
+    uint64_t addr,void *buffer,size_t size,void *context );
+
+// DWST_UNWIND_REGS: number of registers of dwstUnwindRegs
+#define DWST_UNWIND_REGS        32
+
+// dwstUnwindRegs: registers of a frame, by DWARF register number
+//   i386:              eax=0 ecx=1 edx=2 ebx=3 esp=4 ebp=5 esi=6 edi=7
+//   x86-64:            rax=0 rdx=1 rcx=2 rbx=3 rsi=4 rdi=5 rbp=6 rsp=7
+//                      r8-r15=8-15
+//   arm64:             x0-x30=0-30 sp=31
+typedef struct dwstUnwindRegs
+{
+  uint64_t pc;                     // instruction pointer
+  uint64_t reg[DWST_UNWIND_REGS];  // register values
+  uint32_t valid;                  // bit mask of the known registers
+} dwstUnwindRegs;
+
+// dwstUnwindImage(): unwind frame with the call frame information
+//   image:             handle of dwstOpenFile()
+//   imageBase:         used image base address
+//   regs:              registers of the frame, replaced with the ones
+//                      of the caller
+//   caller:            nonzero if regs->pc is a return address
+//                      (all frames except the interrupted one)
+//   readFunc:          callback function to read the stack memory
+//   readContext:       user-provided pointer (context)
+//   returns 1 on success, or 0 if the address has no rules
+//      (of .eh_frame or .debug_frame), or it's the outermost frame
+//      (x86-64 images are unwound with the unwind codes of .pdata/.xdata,
+//       the call frame information is only used where they are missing)
+EXPORT int dwstUnwindImage(
+    dwstImage *image,uint64_t imageBase,
+    dwstUnwindRegs *regs,int caller,
+    dwstReadMemory *readFunc,void *readContext );
+
+// dwstUnwindStack(): stack addresses of all frames in the executable
+//   image:             handle of dwstOpenFile()
+//   imageBase:         used image base address
+//   regs:              registers of the interrupted frame
+//   addr:              buffer of the stack addresses
+//   size:              maximum number of addresses
+//   readFunc:          callback function to read the stack memory
+//   readContext:       user-provided pointer (context)
+//   returns number of addresses
+//      (the return addresses are decremented to be inside the call,
+//       so they can be used with dwstOfImage())
+EXPORT int dwstUnwindStack(
+    dwstImage *image,uint64_t imageBase,
+    const dwstUnwindRegs *regs,
+    uint64_t *addr,int size,
+    dwstReadMemory *readFunc,void *readContext );
+
+// dwstUnwindStats: work done by unwinding
+typedef struct dwstUnwindStats
+{
+  uint64_t frames;         // unwound frames
+  uint64_t hits;           // frames with an already compiled FDE
+  uint64_t misses;         // FDEs compiled by the unwinding
+  uint64_t evictions;      // FDEs freed to stay within the budget
+  uint64_t fdes;           // currently compiled FDEs
+  uint64_t cacheSize;      // memory of the compiled FDEs in bytes
+} dwstUnwindStats;
+
+// dwstUnwindCacheStats(): statistics of the unwinding of an executable
+//   image:             handle of dwstOpenFile()
+//   stats:             statistics of all unwound frames since dwstOpenFile()
+//   returns 1 on success
+EXPORT int dwstUnwindCacheStats(
+    dwstImage *image,dwstUnwindStats *stats );
+
+// dwstSetUnwindBudget(): limit memory of the compiled unwind rules
+//   image:             handle of dwstOpenFile()
+//   budget:            maximum size in bytes, or 0 for no limit (default)
+//      (the rules of an FDE are compiled into a table of address ranges
+//       when it's first used, the least recently used ones are freed
+//       when the limit is exceeded)
+EXPORT void dwstSetUnwindBudget(
+    dwstImage *image,size_t budget );
+
+
+// dwstSample: sampled stack of dwstFoldImage()
+typedef struct dwstSample
+{
+  const uint64_t *addr;    // stack addresses, the innermost first
+  int count;               // number of addresses
+  uint64_t weight;         // weight of the sample (e.g. 1 or its duration)
+} dwstSample;
+
+// dwstFoldCallback(): callback function of dwstFoldImage()
+//   stack:             function names, from the outermost to the innermost,
+//                      separated by ';' (inlined functions are
+//                      separate entries, unknown ones are '[module]')
+//   weight:            summed weight of the samples with this stack
+//   context:           user-provided pointer (callbackContext)
+//      (print "%s %llu\n" for the folded format of flamegraph.pl)
+typedef void dwstFoldCallback(
+    const char *stack,uint64_t weight,void *context );
+
+// dwstFoldImage(): folded stacks of samples of opened executable
+//   image:             handle of dwstOpenFile()
+//   imageBase:         used image base address
+//   samples:           sampled stacks
+//   count:             number of samples
+//   callbackFunc:      callback function, once for each unique stack
+//   callbackContext:   user-provided pointer (context)
+//   returns number of unique stacks
+//      (each address is looked up only once, and the callbacks
+//       are in the order of the first sample of each stack)
+EXPORT int dwstFoldImage(
+    dwstImage *image,uint64_t imageBase,
+    const dwstSample *samples,int count,
+    dwstFoldCallback *callbackFunc,void *callbackContext );
+
+// dwstFoldProcess(): folded stacks of samples of current process
+EXPORT int dwstFoldProcess(
+    const dwstSample *samples,int count,
+    dwstFoldCallback *callbackFunc,void *callbackContext );
+
+
 // dwstExceptionDialog(): show dialog on unhandled exception
 //   extraInfo:         extra information shown in dialog
 //      (for example see examples/exception-dialog/)
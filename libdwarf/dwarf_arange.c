@@ -0,0 +1,560 @@
+/*
+  Reduced reading of .debug_aranges for dwarfstack.
+
+  This is not the dwarf_arange.c of libdwarf 0.3.0, but a
+  rewrite based on it: the aranges of all sets are collected
+  in a malloc'd array instead of a Dwarf_Chain list, and only
+  dwarf_get_aranges(), dwarf_get_arange(),
+  dwarf_get_cu_die_offset(), dwarf_get_arange_cu_header_offset()
+  and dwarf_get_arange_info_b() are provided
+  (dwarf_get_arange_info() is left out).
+  The original copyright and license of libdwarf apply.
+
+Copyright (C) 2000 Silicon Graphics, Inc.  All Rights Reserved.
+Portions Copyright (C) 2011 David Anderson. All Rights Reserved.
+
+  This program is free software; you can redistribute it
+  and/or modify it under the terms of version 2.1 of the
+  GNU Lesser General Public License as published by the Free
+  Software Foundation.
+
+  This program is distributed in the hope that it would be
+  useful, but WITHOUT ANY WARRANTY; without even the implied
+  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  Further, this software is distributed without any warranty
+  that it is free of the rightful claim of any third person
+  regarding infringement or the like.  Any license provided
+  herein, whether implied or otherwise, applies only to this
+  software file.  Patent licenses, if any, provided herein
+  do not apply to combinations of this program with other
+  software, or any other product whatsoever.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this program; if not, write the
+  Free Software Foundation, Inc., 51 Franklin Street - Fifth
+  Floor, Boston MA 02110-1301, USA.
+
+*/
+
+#include "config.h"
+#include <stdio.h>
+#if defined(_WIN32) && defined(HAVE_STDAFX_H)
+#include "stdafx.h"
+#endif /* HAVE_STDAFX_H */
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h> /* malloc() free() */
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+#include "libdwarf_private.h"
+#include "dwarf.h"
+#include "libdwarf.h"
+#include "dwarf_base_types.h"
+#include "dwarf_opaque.h"
+#include "dwarf_alloc.h"
+#include "dwarf_error.h"
+#include "dwarf_util.h"
+#include "dwarf_arange.h"
+
+/*  The aranges are collected into a malloc'd array of
+    pointers first, its final size is only known once the
+    whole section has been read. */
+static void
+free_aranges_chain(Dwarf_Debug dbg,
+    Dwarf_Arange *chain, Dwarf_Unsigned count)
+{
+    Dwarf_Unsigned i = 0;
+
+    for (i = 0; i < count; ++i) {
+        dwarf_dealloc(dbg,chain[i],DW_DLA_ARANGE);
+    }
+    free(chain);
+}
+
+/*  Reads every set of .debug_aranges.
+    The aranges are returned as a malloc'd array of
+    DW_DLA_ARANGE entries.  The (0,0) tuple terminating
+    a set is not returned. */
+static int
+_dwarf_get_aranges_list(Dwarf_Debug dbg,
+    Dwarf_Arange **chain_out,
+    Dwarf_Unsigned *chain_count_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Small *arange_ptr = 0;
+    Dwarf_Small *arange_ptr_start = 0;
+    Dwarf_Small *end_aranges = 0;
+    Dwarf_Unsigned section_size = 0;
+    Dwarf_Arange *chain = 0;
+    Dwarf_Unsigned chain_count = 0;
+    Dwarf_Unsigned chain_alloc = 0;
+
+    section_size = dbg->de_debug_aranges.dss_size;
+    arange_ptr = dbg->de_debug_aranges.dss_data;
+    arange_ptr_start = arange_ptr;
+    end_aranges = arange_ptr + section_size;
+
+    while (arange_ptr < end_aranges) {
+        /*  Length of current set of aranges.
+            This is local length, which begins just
+            after the length field itself. */
+        Dwarf_Unsigned area_length = 0;
+        Dwarf_Unsigned version = 0;
+        Dwarf_Unsigned info_offset = 0;
+        Dwarf_Small address_size = 0;
+        Dwarf_Small segment_sel_size = 0;
+        Dwarf_Unsigned tuple_size = 0;
+        Dwarf_Unsigned header_size = 0;
+        Dwarf_Unsigned remainder = 0;
+        int local_length_size = 0;
+        int local_extension_size = 0;
+        Dwarf_Small *header_ptr = arange_ptr;
+        Dwarf_Small *end_this_arange = 0;
+        int res = 0;
+
+        res = _dwarf_read_area_length_ck_wrapper(dbg,
+            &area_length,&arange_ptr,&local_length_size,
+            &local_extension_size,section_size,end_aranges,
+            error);
+        if (res != DW_DLV_OK) {
+            free_aranges_chain(dbg,chain,chain_count);
+            return res;
+        }
+        if (area_length > (Dwarf_Unsigned)(end_aranges -
+            arange_ptr)) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error_string(dbg, error,
+                DW_DLE_ARANGES_HEADER_ERROR,
+                "DW_DLE_ARANGES_HEADER_ERROR: "
+                "the set length runs off the end of the section");
+            return DW_DLV_ERROR;
+        }
+        end_this_arange = arange_ptr + area_length;
+
+        res = _dwarf_read_unaligned_ck_wrapper(dbg,
+            &version,arange_ptr,DWARF_HALF_SIZE,
+            end_this_arange,error);
+        if (res != DW_DLV_OK) {
+            free_aranges_chain(dbg,chain,chain_count);
+            return res;
+        }
+        arange_ptr += DWARF_HALF_SIZE;
+        if (version != DW_ARANGES_VERSION2) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error(dbg, error, DW_DLE_VERSION_STAMP_ERROR);
+            return DW_DLV_ERROR;
+        }
+
+        res = _dwarf_read_unaligned_ck_wrapper(dbg,
+            &info_offset,arange_ptr,local_length_size,
+            end_this_arange,error);
+        if (res != DW_DLV_OK) {
+            free_aranges_chain(dbg,chain,chain_count);
+            return res;
+        }
+        arange_ptr += local_length_size;
+        if (info_offset >= dbg->de_debug_info.dss_size) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error(dbg, error, DW_DLE_ARANGE_OFFSET_BAD);
+            return DW_DLV_ERROR;
+        }
+
+        if (arange_ptr + 2 > end_this_arange) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error(dbg, error, DW_DLE_ARANGE_DECODE_ERROR);
+            return DW_DLV_ERROR;
+        }
+        address_size = *(Dwarf_Small *) arange_ptr;
+        arange_ptr += sizeof(Dwarf_Small);
+        segment_sel_size = *(Dwarf_Small *) arange_ptr;
+        arange_ptr += sizeof(Dwarf_Small);
+        if (address_size == 0 ||
+            address_size > sizeof(Dwarf_Addr)) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error(dbg, error, DW_DLE_ADDRESS_SIZE_ERROR);
+            return DW_DLV_ERROR;
+        }
+        if (segment_sel_size > sizeof(Dwarf_Unsigned)) {
+            free_aranges_chain(dbg,chain,chain_count);
+            _dwarf_error(dbg, error, DW_DLE_SEGMENT_SIZE_BAD);
+            return DW_DLV_ERROR;
+        }
+
+        /*  The first tuple following the header in each set
+            begins at an offset that is a multiple of the size
+            of a single tuple. */
+        tuple_size = 2*address_size + segment_sel_size;
+        header_size = arange_ptr - header_ptr;
+        remainder = header_size % tuple_size;
+        if (remainder) {
+            arange_ptr += tuple_size - remainder;
+        }
+
+        while (arange_ptr + tuple_size <= end_this_arange) {
+            Dwarf_Unsigned segment_selector = 0;
+            Dwarf_Addr range_address = 0;
+            Dwarf_Unsigned range_length = 0;
+            Dwarf_Arange arange = 0;
+
+            if (segment_sel_size) {
+                res = _dwarf_read_unaligned_ck_wrapper(dbg,
+                    &segment_selector,arange_ptr,segment_sel_size,
+                    end_this_arange,error);
+                if (res != DW_DLV_OK) {
+                    free_aranges_chain(dbg,chain,chain_count);
+                    return res;
+                }
+                arange_ptr += segment_sel_size;
+            }
+            res = _dwarf_read_unaligned_ck_wrapper(dbg,
+                &range_address,arange_ptr,address_size,
+                end_this_arange,error);
+            if (res != DW_DLV_OK) {
+                free_aranges_chain(dbg,chain,chain_count);
+                return res;
+            }
+            arange_ptr += address_size;
+            res = _dwarf_read_unaligned_ck_wrapper(dbg,
+                &range_length,arange_ptr,address_size,
+                end_this_arange,error);
+            if (res != DW_DLV_OK) {
+                free_aranges_chain(dbg,chain,chain_count);
+                return res;
+            }
+            arange_ptr += address_size;
+
+            if (!range_address && !range_length &&
+                !segment_selector) {
+                /*  End of this set.  Any bytes left are
+                    padding. */
+                break;
+            }
+
+            arange = (Dwarf_Arange)
+                _dwarf_get_alloc(dbg, DW_DLA_ARANGE, 1);
+            if (!arange) {
+                free_aranges_chain(dbg,chain,chain_count);
+                _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+                return DW_DLV_ERROR;
+            }
+            arange->ar_segment_selector = segment_selector;
+            arange->ar_segment_selector_size = segment_sel_size;
+            arange->ar_address = range_address;
+            arange->ar_length = range_length;
+            arange->ar_info_offset = info_offset;
+            arange->ar_dbg = dbg;
+
+            if (chain_count == chain_alloc) {
+                Dwarf_Unsigned new_alloc =
+                    chain_alloc ? chain_alloc*2 : 64;
+                Dwarf_Arange *new_chain = (Dwarf_Arange *)
+                    realloc(chain,new_alloc*sizeof(Dwarf_Arange));
+
+                if (!new_chain) {
+                    dwarf_dealloc(dbg,arange,DW_DLA_ARANGE);
+                    free_aranges_chain(dbg,chain,chain_count);
+                    _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+                    return DW_DLV_ERROR;
+                }
+                chain = new_chain;
+                chain_alloc = new_alloc;
+            }
+            chain[chain_count++] = arange;
+        }
+        arange_ptr = end_this_arange;
+    }
+    if (arange_ptr != end_aranges ||
+        arange_ptr < arange_ptr_start) {
+        free_aranges_chain(dbg,chain,chain_count);
+        _dwarf_error(dbg, error, DW_DLE_ARANGE_DECODE_ERROR);
+        return DW_DLV_ERROR;
+    }
+    *chain_out = chain;
+    *chain_count_out = chain_count;
+    return DW_DLV_OK;
+}
+
+/*  This function returns the count of the number of
+    aranges in the .debug_aranges section.  It sets
+    aranges to point to a block of Dwarf_Arange's
+    describing the arange's.  It returns DW_DLV_ERROR
+    on error.
+    The aranges are read by _dwarf_get_aranges_list(),
+    like the ones of _dwarf_get_aranges_addr_offsets(). */
+int
+dwarf_get_aranges(Dwarf_Debug dbg,
+    Dwarf_Arange ** aranges,
+    Dwarf_Signed * returned_count, Dwarf_Error * error)
+{
+    Dwarf_Arange *arange_block = 0;
+    Dwarf_Arange *chain = 0;
+    Dwarf_Unsigned chain_count = 0;
+    Dwarf_Unsigned i = 0;
+    int res = DW_DLV_ERROR;
+
+    if (!dbg) {
+        _dwarf_error(NULL, error, DW_DLE_DBG_NULL);
+        return DW_DLV_ERROR;
+    }
+    if (!dbg->de_debug_aranges.dss_size) {
+        /* We don't have such a section at all. */
+        return DW_DLV_NO_ENTRY;
+    }
+    res = _dwarf_load_section(dbg, &dbg->de_debug_aranges, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    /*  aranges refer to the CUs of .debug_info. */
+    res = _dwarf_load_debug_info(dbg, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    res = _dwarf_get_aranges_list(dbg,&chain,&chain_count,error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    if (!chain_count) {
+        free(chain);
+        return DW_DLV_NO_ENTRY;
+    }
+
+    arange_block = (Dwarf_Arange *)
+        _dwarf_get_alloc(dbg, DW_DLA_LIST, chain_count);
+    if (arange_block == NULL) {
+        free_aranges_chain(dbg,chain,chain_count);
+        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+        return DW_DLV_ERROR;
+    }
+    for (i = 0; i < chain_count; ++i) {
+        arange_block[i] = chain[i];
+    }
+    free(chain);
+    *aranges = arange_block;
+    *returned_count = (Dwarf_Signed)chain_count;
+    return DW_DLV_OK;
+}
+
+/*  This function returns DW_DLV_OK if it succeeds
+    and DW_DLV_ERR or DW_DLV_OK otherwise.
+    count is set to the number of addresses in the
+    .debug_aranges section.
+    For each address, the corresponding element in
+    an array is set to the address itself(aranges) and
+    the section offset (offsets). */
+int
+_dwarf_get_aranges_addr_offsets(Dwarf_Debug dbg,
+    Dwarf_Addr ** addrs,
+    Dwarf_Off ** offsets,
+    Dwarf_Signed * count,
+    Dwarf_Error * error)
+{
+    Dwarf_Addr *arange_addrs = 0;
+    Dwarf_Off *arange_offsets = 0;
+    Dwarf_Arange *chain = 0;
+    Dwarf_Unsigned chain_count = 0;
+    Dwarf_Unsigned i = 0;
+    int res = DW_DLV_ERROR;
+
+    if (!dbg) {
+        _dwarf_error(NULL, error, DW_DLE_DBG_NULL);
+        return DW_DLV_ERROR;
+    }
+    if (!dbg->de_debug_aranges.dss_size) {
+        /* We don't have such a section at all. */
+        return DW_DLV_NO_ENTRY;
+    }
+    res = _dwarf_load_section(dbg, &dbg->de_debug_aranges, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    res = _dwarf_load_debug_info(dbg, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    res = _dwarf_get_aranges_list(dbg,&chain,&chain_count,error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    if (!chain_count) {
+        free(chain);
+        return DW_DLV_NO_ENTRY;
+    }
+
+    arange_addrs = (Dwarf_Addr *)
+        _dwarf_get_alloc(dbg, DW_DLA_ADDR, chain_count);
+    if (arange_addrs == NULL) {
+        free_aranges_chain(dbg,chain,chain_count);
+        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+        return DW_DLV_ERROR;
+    }
+    arange_offsets = (Dwarf_Off *)
+        _dwarf_get_alloc(dbg, DW_DLA_ADDR, chain_count);
+    if (arange_offsets == NULL) {
+        free_aranges_chain(dbg,chain,chain_count);
+        dwarf_dealloc(dbg,arange_addrs,DW_DLA_ADDR);
+        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+        return DW_DLV_ERROR;
+    }
+    for (i = 0; i < chain_count; ++i) {
+        arange_addrs[i] = chain[i]->ar_address;
+        arange_offsets[i] = chain[i]->ar_info_offset;
+    }
+    free_aranges_chain(dbg,chain,chain_count);
+    *count = (Dwarf_Signed)chain_count;
+    *addrs = arange_addrs;
+    *offsets = arange_offsets;
+    return DW_DLV_OK;
+}
+
+/*  This function takes a pointer to a block
+    of Dwarf_Arange's, and a count of the
+    length of the block.  It checks if the
+    given address is within the range of an
+    address range in the block.  If yes, it
+    returns the appropriate Dwarf_Arange.
+    If no, it returns DW_DLV_NO_ENTRY;
+    On error it returns DW_DLV_ERROR.  */
+int
+dwarf_get_arange(Dwarf_Arange * aranges,
+    Dwarf_Unsigned arange_count,
+    Dwarf_Addr address,
+    Dwarf_Arange * returned_arange, Dwarf_Error * error)
+{
+    Dwarf_Arange curr_arange = 0;
+    Dwarf_Unsigned i = 0;
+
+    if (!aranges) {
+        _dwarf_error(NULL, error, DW_DLE_ARANGES_NULL);
+        return DW_DLV_ERROR;
+    }
+    for (i = 0; i < arange_count; i++) {
+        curr_arange = *(aranges + i);
+        if (address >= curr_arange->ar_address &&
+            address <
+            curr_arange->ar_address + curr_arange->ar_length) {
+            *returned_arange = curr_arange;
+            return DW_DLV_OK;
+        }
+    }
+    return DW_DLV_NO_ENTRY;
+}
+
+/*  This function takes an Dwarf_Arange,
+    and returns the offset of the first
+    die in the compilation-unit that the
+    arange belongs to.  Returns DW_DLV_ERROR
+    on error.
+
+    For an arange, the cu_die can only be from debug_info. */
+int
+dwarf_get_cu_die_offset(Dwarf_Arange arange,
+    Dwarf_Off * returned_offset,
+    Dwarf_Error * error)
+{
+    Dwarf_Debug dbg = 0;
+    Dwarf_Off offset = 0;
+    Dwarf_Unsigned headerlen = 0;
+    int cres = 0;
+
+    if (arange == NULL) {
+        _dwarf_error(NULL, error, DW_DLE_ARANGE_NULL);
+        return DW_DLV_ERROR;
+    }
+    dbg = arange->ar_dbg;
+    offset = arange->ar_info_offset;
+    if (!dbg->de_debug_info.dss_data) {
+        int res = _dwarf_load_debug_info(dbg, error);
+
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+    }
+    cres = _dwarf_length_of_cu_header(dbg, offset,
+        true, &headerlen,error);
+    if (cres != DW_DLV_OK) {
+        return cres;
+    }
+    *returned_offset =  headerlen + offset;
+    return DW_DLV_OK;
+}
+
+/*  This function takes an Dwarf_Arange,
+    and returns the offset of the CU header
+    in the compilation-unit that the
+    arange belongs to.  Returns DW_DLV_ERROR
+    on error.
+    Ensures .debug_info loaded so
+    the cu_offset is meaningful.  */
+int
+dwarf_get_arange_cu_header_offset(Dwarf_Arange arange,
+    Dwarf_Off * cu_header_offset_returned,
+    Dwarf_Error * error)
+{
+    Dwarf_Debug dbg = 0;
+
+    if (arange == NULL) {
+        _dwarf_error(NULL, error, DW_DLE_ARANGE_NULL);
+        return DW_DLV_ERROR;
+    }
+    dbg = arange->ar_dbg;
+    /*  Like dwarf_get_arange_info_b() this ensures debug_info
+        loaded: the cu_header is in debug_info and will be used
+        by the caller. */
+    if (!dbg->de_debug_info.dss_data) {
+        int res = _dwarf_load_debug_info(dbg, error);
+
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+    }
+    *cu_header_offset_returned = arange->ar_info_offset;
+    return DW_DLV_OK;
+}
+
+/*  This function takes a Dwarf_Arange, and returns
+    true if it is not NULL.  It also stores the start
+    address of the range in *start, the length of the
+    range in *length, and the offset of the first die
+    in the compilation-unit in *cu_die_offset.  It
+    returns false on error.
+    If cu_die_offset returned ensures .debug_info loaded so
+    the cu_die_offset is meaningful.
+
+    New for DWARF4, entries may have segment information.
+    *segment is only meaningful
+    if *segment_entry_size is non-zero.  */
+int
+dwarf_get_arange_info_b(Dwarf_Arange arange,
+    Dwarf_Unsigned*  segment,
+    Dwarf_Unsigned*  segment_entry_size,
+    Dwarf_Addr    *  start,
+    Dwarf_Unsigned*  length,
+    Dwarf_Off     *  cu_die_offset,
+    Dwarf_Error   *  error )
+{
+    if (arange == NULL) {
+        _dwarf_error(NULL, error, DW_DLE_ARANGE_NULL);
+        return DW_DLV_ERROR;
+    }
+
+    if (segment != NULL) {
+        *segment = arange->ar_segment_selector;
+    }
+    if (segment_entry_size != NULL) {
+        *segment_entry_size = arange->ar_segment_selector_size;
+    }
+    if (start != NULL)
+        *start = arange->ar_address;
+    if (length != NULL)
+        *length = arange->ar_length;
+    if (cu_die_offset != NULL) {
+        return dwarf_get_cu_die_offset(arange,cu_die_offset,error);
+    }
+    return DW_DLV_OK;
+}
@@ -169,8 +169,8 @@ create_fullest_file_path(Dwarf_Debug dbg,
     char *file_name = 0;
     /*  Large enough that almost never will any malloc
         be needed by dwarfstring.  Arbitrary size. */
-    static char targbuf[300];
-    static char nbuf[300];
+    char targbuf[300];
+    char nbuf[300];
     dwarfstring targ;
     dwarfstring nxt;
     unsigned linetab_version = line_context->lc_version_number;
@@ -207,9 +207,9 @@ create_fullest_file_path(Dwarf_Debug dbg,
     {
         int need_dir = FALSE;
         unsigned include_dir_offset = 1;
-        static char compdirbuf[300];
-        static char incdirbuf[300];
-        static char filenamebuf[300];
+        char compdirbuf[300];
+        char incdirbuf[300];
+        char filenamebuf[300];
         dwarfstring compdir;
         dwarfstring incdir;
         dwarfstring filename;
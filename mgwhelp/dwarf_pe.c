@@ -18,9 +18,23 @@
  */
 
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 #include "config.h"
 #include "libdwarf_private.h"
@@ -28,7 +42,181 @@
 #include "libdwarf.h"
 #include "dwarf_base_types.h"
 #include "dwarf_opaque.h"
-
+#include "dwarf_pe.h"
+
+
+#ifndef _WIN32
+
+/* PE structures of winnt.h */
+
+typedef uint8_t BYTE, *PBYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint64_t ULONGLONG;
+typedef char *PSTR;
+
+#define MAX_PATH PATH_MAX
+
+#define IMAGE_DOS_SIGNATURE 0x5A4D
+#define IMAGE_NT_SIGNATURE 0x00004550
+#define IMAGE_FILE_MACHINE_I386 0x014c
+#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES 16
+
+typedef struct _IMAGE_DOS_HEADER {
+    WORD e_magic;
+    WORD e_cblp;
+    WORD e_cp;
+    WORD e_crlc;
+    WORD e_cparhdr;
+    WORD e_minalloc;
+    WORD e_maxalloc;
+    WORD e_ss;
+    WORD e_sp;
+    WORD e_csum;
+    WORD e_ip;
+    WORD e_cs;
+    WORD e_lfarlc;
+    WORD e_ovno;
+    WORD e_res[4];
+    WORD e_oemid;
+    WORD e_oeminfo;
+    WORD e_res2[10];
+    LONG e_lfanew;
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+
+typedef struct _IMAGE_FILE_HEADER {
+    WORD Machine;
+    WORD NumberOfSections;
+    DWORD TimeDateStamp;
+    DWORD PointerToSymbolTable;
+    DWORD NumberOfSymbols;
+    WORD SizeOfOptionalHeader;
+    WORD Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY {
+    DWORD VirtualAddress;
+    DWORD Size;
+} IMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER32 {
+    WORD Magic;
+    BYTE MajorLinkerVersion;
+    BYTE MinorLinkerVersion;
+    DWORD SizeOfCode;
+    DWORD SizeOfInitializedData;
+    DWORD SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint;
+    DWORD BaseOfCode;
+    DWORD BaseOfData;
+    DWORD ImageBase;
+    DWORD SectionAlignment;
+    DWORD FileAlignment;
+    WORD MajorOperatingSystemVersion;
+    WORD MinorOperatingSystemVersion;
+    WORD MajorImageVersion;
+    WORD MinorImageVersion;
+    WORD MajorSubsystemVersion;
+    WORD MinorSubsystemVersion;
+    DWORD Win32VersionValue;
+    DWORD SizeOfImage;
+    DWORD SizeOfHeaders;
+    DWORD CheckSum;
+    WORD Subsystem;
+    WORD DllCharacteristics;
+    DWORD SizeOfStackReserve;
+    DWORD SizeOfStackCommit;
+    DWORD SizeOfHeapReserve;
+    DWORD SizeOfHeapCommit;
+    DWORD LoaderFlags;
+    DWORD NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64 {
+    WORD Magic;
+    BYTE MajorLinkerVersion;
+    BYTE MinorLinkerVersion;
+    DWORD SizeOfCode;
+    DWORD SizeOfInitializedData;
+    DWORD SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint;
+    DWORD BaseOfCode;
+    ULONGLONG ImageBase;
+    DWORD SectionAlignment;
+    DWORD FileAlignment;
+    WORD MajorOperatingSystemVersion;
+    WORD MinorOperatingSystemVersion;
+    WORD MajorImageVersion;
+    WORD MinorImageVersion;
+    WORD MajorSubsystemVersion;
+    WORD MinorSubsystemVersion;
+    DWORD Win32VersionValue;
+    DWORD SizeOfImage;
+    DWORD SizeOfHeaders;
+    DWORD CheckSum;
+    WORD Subsystem;
+    WORD DllCharacteristics;
+    ULONGLONG SizeOfStackReserve;
+    ULONGLONG SizeOfStackCommit;
+    ULONGLONG SizeOfHeapReserve;
+    ULONGLONG SizeOfHeapCommit;
+    DWORD LoaderFlags;
+    DWORD NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS32 {
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+} IMAGE_NT_HEADERS32;
+
+typedef struct _IMAGE_NT_HEADERS64 {
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+} IMAGE_NT_HEADERS64, IMAGE_NT_HEADERS, *PIMAGE_NT_HEADERS;
+
+typedef struct _IMAGE_SECTION_HEADER {
+    BYTE Name[8];
+    union {
+        DWORD PhysicalAddress;
+        DWORD VirtualSize;
+    } Misc;
+    DWORD VirtualAddress;
+    DWORD SizeOfRawData;
+    DWORD PointerToRawData;
+    DWORD PointerToRelocations;
+    DWORD PointerToLinenumbers;
+    WORD NumberOfRelocations;
+    WORD NumberOfLinenumbers;
+    DWORD Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+#pragma pack(push, 2)
+typedef struct _IMAGE_SYMBOL {
+    union {
+        BYTE ShortName[8];
+        struct {
+            DWORD Short;
+            DWORD Long;
+        } Name;
+        DWORD LongName[2];
+    } N;
+    DWORD Value;
+    int16_t SectionNumber;
+    WORD Type;
+    BYTE StorageClass;
+    BYTE NumberOfAuxSymbols;
+} IMAGE_SYMBOL, *PIMAGE_SYMBOL;
+#pragma pack(pop)
+
+#endif
+
+
+#ifdef _WIN32
 
 wchar_t *
 dwst_ansi2wide(const char *str)
@@ -57,10 +245,344 @@ dwst_wide2ansi(const wchar_t *str)
 }
 
 
+struct dwst_lock {
+    CRITICAL_SECTION cs;
+};
+
+dwst_lock *
+dwst_lock_new(void)
+{
+    dwst_lock *lock = malloc(sizeof(dwst_lock));
+    if (!lock) return NULL;
+    InitializeCriticalSection(&lock->cs);
+    return lock;
+}
+
+void
+dwst_lock_free(dwst_lock *lock)
+{
+    if (!lock) return;
+    DeleteCriticalSection(&lock->cs);
+    free(lock);
+}
+
+void
+dwst_lock_enter(dwst_lock *lock)
+{
+    EnterCriticalSection(&lock->cs);
+}
+
+void
+dwst_lock_leave(dwst_lock *lock)
+{
+    LeaveCriticalSection(&lock->cs);
+}
+
+static dwst_lock *volatile global_lock;
+
+dwst_lock *
+dwst_global_lock(void)
+{
+    if (!global_lock) {
+        /* the loser of a race frees its own lock */
+        dwst_lock *lock = dwst_lock_new();
+        if (lock && InterlockedCompareExchangePointer(
+                (PVOID volatile *)&global_lock, lock, NULL))
+            dwst_lock_free(lock);
+    }
+    return global_lock;
+}
+
+
+const void *
+dwst_map_file(const wchar_t *name, size_t *size)
+{
+    HANDLE hFile = CreateFileW(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER li;
+    if (!GetFileSizeEx(hFile, &li) || !li.QuadPart ||
+        (ULONGLONG)li.QuadPart > (SIZE_T)-1) {
+        CloseHandle(hFile);
+        return NULL;
+    }
+
+    HANDLE hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY,
+                                            0, 0, NULL);
+    CloseHandle(hFile);
+    if (!hFileMapping) return NULL;
+
+    /* the view keeps the mapping alive */
+    const void *data = MapViewOfFile(hFileMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hFileMapping);
+    if (!data) return NULL;
+
+    *size = (size_t)li.QuadPart;
+    return data;
+}
+
+void
+dwst_unmap_file(const void *data, UNUSEDARG size_t size)
+{
+    if (data) UnmapViewOfFile(data);
+}
+
+FILE *
+dwst_wfopen(const wchar_t *name, const wchar_t *mode)
+{
+    return _wfopen(name, mode);
+}
+
+int
+dwst_wrename(const wchar_t *from, const wchar_t *to)
+{
+    return MoveFileExW(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+void
+dwst_wremove(const wchar_t *name)
+{
+    DeleteFileW(name);
+}
+
+static int
+file_exists(const wchar_t *name)
+{
+    return GetFileAttributesW(name) != INVALID_FILE_ATTRIBUTES;
+}
+
+uint64_t
+dwst_time_ns(void)
+{
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000 +
+        (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000 /
+        freq.QuadPart;
+}
+
+#else
+
+/* names which are invalid in the current locale keep their bytes */
+wchar_t *
+dwst_ansi2wide(const char *str)
+{
+    if (!str) return NULL;
+    size_t len = mbstowcs(NULL, str, 0);
+    int raw = len == (size_t)-1;
+    if (raw) len = strlen(str);
+    wchar_t *strW = malloc((len + 1) * sizeof(wchar_t));
+    if (!strW) return NULL;
+    if (raw) {
+        size_t i;
+        for (i = 0; i <= len; i++)
+            strW[i] = (unsigned char)str[i];
+    } else {
+        mbstowcs(strW, str, len + 1);
+    }
+    return strW;
+}
+
+char *
+dwst_wide2ansi(const wchar_t *str)
+{
+    if (!str) return NULL;
+    size_t len = wcstombs(NULL, str, 0);
+    int raw = len == (size_t)-1;
+    if (raw) len = wcslen(str);
+    char *strA = malloc(len + 1);
+    if (!strA) return NULL;
+    if (raw) {
+        size_t i;
+        for (i = 0; i <= len; i++)
+            strA[i] = (unsigned)str[i] < 256 ? (char)str[i] : '?';
+    } else {
+        wcstombs(strA, str, len + 1);
+    }
+    return strA;
+}
+
+
+struct dwst_lock {
+    pthread_mutex_t mutex;
+};
+
+dwst_lock *
+dwst_lock_new(void)
+{
+    dwst_lock *lock = malloc(sizeof(dwst_lock));
+    if (!lock) return NULL;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int res = pthread_mutex_init(&lock->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (res) {
+        free(lock);
+        return NULL;
+    }
+    return lock;
+}
+
+void
+dwst_lock_free(dwst_lock *lock)
+{
+    if (!lock) return;
+    pthread_mutex_destroy(&lock->mutex);
+    free(lock);
+}
+
+void
+dwst_lock_enter(dwst_lock *lock)
+{
+    pthread_mutex_lock(&lock->mutex);
+}
+
+void
+dwst_lock_leave(dwst_lock *lock)
+{
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+static pthread_once_t global_lock_once = PTHREAD_ONCE_INIT;
+static dwst_lock *global_lock;
+
+static void
+create_global_lock(void)
+{
+    global_lock = dwst_lock_new();
+}
+
+dwst_lock *
+dwst_global_lock(void)
+{
+    pthread_once(&global_lock_once, create_global_lock);
+    return global_lock;
+}
+
+
+const void *
+dwst_map_file(const wchar_t *name, size_t *size)
+{
+    char *nameA = dwst_wide2ansi(name);
+    if (!nameA) return NULL;
+    int fd = open(nameA, O_RDONLY);
+    free(nameA);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size ||
+        (uint64_t)st.st_size > (size_t)-1) {
+        close(fd);
+        return NULL;
+    }
+
+    /* the mapping stays valid after the file is closed */
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    *size = (size_t)st.st_size;
+    return data;
+}
+
+void
+dwst_unmap_file(const void *data, size_t size)
+{
+    if (data) munmap((void *)data, size);
+}
+
+FILE *
+dwst_wfopen(const wchar_t *name, const wchar_t *mode)
+{
+    char *nameA = dwst_wide2ansi(name);
+    char *modeA = dwst_wide2ansi(mode);
+    FILE *f = nameA && modeA ? fopen(nameA, modeA) : NULL;
+    free(nameA);
+    free(modeA);
+    return f;
+}
+
+int
+dwst_wrename(const wchar_t *from, const wchar_t *to)
+{
+    char *fromA = dwst_wide2ansi(from);
+    char *toA = dwst_wide2ansi(to);
+    int ok = fromA && toA && !rename(fromA, toA);
+    free(fromA);
+    free(toA);
+    return ok;
+}
+
+void
+dwst_wremove(const wchar_t *name)
+{
+    char *nameA = dwst_wide2ansi(name);
+    if (nameA) remove(nameA);
+    free(nameA);
+}
+
+static int
+file_exists(const wchar_t *name)
+{
+    char *nameA = dwst_wide2ansi(name);
+    int exists = nameA && !access(nameA, F_OK);
+    free(nameA);
+    return exists;
+}
+
+uint64_t
+dwst_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
+
+
+int
+dwst_pe_identity(const wchar_t *image,
+                 uint32_t *timestamp, uint32_t *size_of_image)
+{
+    size_t size;
+    const BYTE *data = dwst_map_file(image, &size);
+    if (!data) return 0;
+
+    int ok = 0;
+    const IMAGE_DOS_HEADER *pDosHeader = (const IMAGE_DOS_HEADER *)data;
+    if (size >= sizeof(IMAGE_DOS_HEADER) &&
+        pDosHeader->e_magic == IMAGE_DOS_SIGNATURE &&
+        pDosHeader->e_lfanew > 0 &&
+        (size_t)pDosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS32) <= size) {
+        const IMAGE_NT_HEADERS32 *pNtHeaders =
+            (const IMAGE_NT_HEADERS32 *)(data + pDosHeader->e_lfanew);
+        /* SizeOfImage has the same offset in PE32 and PE32+ headers */
+        if (pNtHeaders->Signature == IMAGE_NT_SIGNATURE) {
+            *timestamp = pNtHeaders->FileHeader.TimeDateStamp;
+            *size_of_image = pNtHeaders->OptionalHeader.SizeOfImage;
+            ok = 1;
+        }
+    }
+
+    dwst_unmap_file(data, size);
+    return ok;
+}
+
+
 typedef struct {
-    HANDLE hFile;
-    HANDLE hFileMapping;
+    size_t fileSize;
+    /* uncompressed size of the loaded .zdebug_ sections */
+    Dwarf_Unsigned inflated;
+    /* preferred image base, for the addresses of the sections */
+    Dwarf_Addr imageBase;
+    /* size of the headers in the loaded image */
+    Dwarf_Unsigned headerSize;
     union {
+        const void *lpMapping;
         PBYTE lpFileBase;
         PIMAGE_DOS_HEADER pDosHeader;
     };
@@ -92,6 +614,8 @@ pe_get_section_info(void *obj,
         } else {
             return_section->as_size = pSection->SizeOfRawData;
         }
+        /* pc-relative pointers of .eh_frame need the section address */
+        return_section->as_addr = pe_obj->imageBase + pSection->VirtualAddress;
         return_section->as_name = (const char *)pSection->Name;
         if (return_section->as_name[0] == '/') {
             return_section->as_name = &pe_obj->pStringTable[atoi(&return_section->as_name[1])];
@@ -129,10 +653,7 @@ static Dwarf_Unsigned
 pe_get_filesize(void *obj)
 {
     pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    LARGE_INTEGER li;
-    if (!GetFileSizeEx(pe_obj->hFile, &li))
-        return 0;
-    return li.QuadPart;
+    return pe_obj->fileSize;
 }
 
 
@@ -156,7 +677,22 @@ pe_load_section(void *obj,
         return DW_DLV_NO_ENTRY;
     } else {
         PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + section_index - 1;
+        if ((Dwarf_Unsigned)pSection->PointerToRawData +
+            pSection->SizeOfRawData > pe_obj->fileSize) {
+            return DW_DLV_ERROR;
+        }
         *return_data = pe_obj->lpFileBase + pSection->PointerToRawData;
+        /* libdwarf inflates these right after loading,
+         * the size follows "ZLIB" in big-endian */
+        if (pSection->SizeOfRawData >= 12 &&
+            !memcmp(*return_data, "ZLIB", 4)) {
+            Dwarf_Unsigned size = 0;
+            int i;
+            for (i = 4; i < 12; i++) {
+                size = size << 8 | (*return_data)[i];
+            }
+            pe_obj->inflated += size;
+        }
         return DW_DLV_OK;
     }
 }
@@ -194,23 +730,16 @@ dwarf_pe_init_link(const wchar_t *image,
         goto no_internals;
     }
 
-    pe_obj->hFile = CreateFileW(image, GENERIC_READ, FILE_SHARE_READ, NULL,
-                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-    if (pe_obj->hFile == INVALID_HANDLE_VALUE) {
+    pe_obj->lpMapping = dwst_map_file(image, &pe_obj->fileSize);
+    if (!pe_obj->lpMapping) {
         goto no_file;
     }
 
-    pe_obj->hFileMapping = CreateFileMapping(pe_obj->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!pe_obj->hFileMapping) {
-        goto no_file_mapping;
-    }
-
-    pe_obj->lpFileBase = (PBYTE)MapViewOfFile(pe_obj->hFileMapping, FILE_MAP_READ, 0, 0, 0);
-    if (!pe_obj->lpFileBase) {
-        goto no_view_of_file;
-    }
-
-    if (pe_obj->pDosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
+    if (pe_obj->fileSize < sizeof(IMAGE_DOS_HEADER) ||
+        pe_obj->pDosHeader->e_magic != IMAGE_DOS_SIGNATURE ||
+        pe_obj->pDosHeader->e_lfanew <= 0 ||
+        (size_t)pe_obj->pDosHeader->e_lfanew + sizeof(DWORD) +
+        sizeof(IMAGE_FILE_HEADER) > pe_obj->fileSize) {
         goto no_intfc;
     }
     pe_obj->pNtHeaders = (PIMAGE_NT_HEADERS) (
@@ -226,6 +755,11 @@ dwarf_pe_init_link(const wchar_t *image,
         sizeof(IMAGE_FILE_HEADER) +
         pe_obj->pNtHeaders->FileHeader.SizeOfOptionalHeader
     );
+    if ((PBYTE)(pe_obj->Sections +
+                pe_obj->pNtHeaders->FileHeader.NumberOfSections) >
+        pe_obj->lpFileBase + pe_obj->fileSize) {
+        goto no_intfc;
+    }
     pe_obj->pSymbolTable = (PIMAGE_SYMBOL) (
         pe_obj->lpFileBase +
         pe_obj->pNtHeaders->FileHeader.PointerToSymbolTable
@@ -233,26 +767,28 @@ dwarf_pe_init_link(const wchar_t *image,
     pe_obj->pStringTable = (PSTR)
         &pe_obj->pSymbolTable[pe_obj->pNtHeaders->FileHeader.NumberOfSymbols];
 
-    if (imagebase) {
+    {
         WORD sooh = pe_obj->pNtHeaders->FileHeader.SizeOfOptionalHeader;
         if (sooh==sizeof(IMAGE_OPTIONAL_HEADER32)) {
             PIMAGE_OPTIONAL_HEADER32 opt = (PIMAGE_OPTIONAL_HEADER32)(
                     (PBYTE)pe_obj->pNtHeaders +
                     sizeof(DWORD) +
                     sizeof(IMAGE_FILE_HEADER) );
-            *imagebase = opt->ImageBase;
+            pe_obj->imageBase = opt->ImageBase;
+            pe_obj->headerSize = opt->SizeOfHeaders;
         }
         else if (sooh==sizeof(IMAGE_OPTIONAL_HEADER64)) {
             PIMAGE_OPTIONAL_HEADER64 opt = (PIMAGE_OPTIONAL_HEADER64)(
                     (PBYTE)pe_obj->pNtHeaders +
                     sizeof(DWORD) +
                     sizeof(IMAGE_FILE_HEADER) );
-            *imagebase = opt->ImageBase;
-        }
-        else {
-            *imagebase = 0;
+            pe_obj->imageBase = opt->ImageBase;
+            pe_obj->headerSize = opt->SizeOfHeaders;
         }
     }
+    if (imagebase) {
+        *imagebase = pe_obj->imageBase;
+    }
 
     /* Initialize the interface struct */
     intfc = (Dwarf_Obj_Access_Interface_a *)calloc(1, sizeof *intfc);
@@ -282,10 +818,10 @@ dwarf_pe_init_link(const wchar_t *image,
             wchar_t *linkW = dwst_ansi2wide(link);
             if (linkW) {
                 wcscpy(delim1, linkW);
-                if (GetFileAttributesW(link_path) == INVALID_FILE_ATTRIBUTES) {
+                if (!file_exists(link_path)) {
                     wcscpy(delim1, L".debug/");
                     wcscat(delim1, linkW);
-                    if (GetFileAttributesW(link_path) == INVALID_FILE_ATTRIBUTES) {
+                    if (!file_exists(link_path)) {
                         link_path[0] = 0;
                     }
                 }
@@ -303,11 +839,7 @@ dwarf_pe_init_link(const wchar_t *image,
 no_dbg:
     free(intfc);
 no_intfc:
-    UnmapViewOfFile(pe_obj->lpFileBase);
-no_view_of_file:
-    CloseHandle(pe_obj->hFileMapping);
-no_file_mapping:
-    CloseHandle(pe_obj->hFile);
+    dwst_unmap_file(pe_obj->lpMapping, pe_obj->fileSize);
 no_file:
     free(pe_obj);
 no_internals:
@@ -333,14 +865,69 @@ dwarf_pe_init(const wchar_t *image,
 }
 
 
+Dwarf_Unsigned
+dwarf_pe_inflated(Dwarf_Debug dbg)
+{
+    pe_access_object_t *pe_obj = (pe_access_object_t *)dbg->de_obj_file->ai_object;
+    return pe_obj->inflated;
+}
+
+
+Dwarf_Half
+dwarf_pe_machine(Dwarf_Debug dbg)
+{
+    pe_access_object_t *pe_obj = (pe_access_object_t *)dbg->de_obj_file->ai_object;
+    return pe_obj->pNtHeaders->FileHeader.Machine;
+}
+
+
+int
+dwarf_pe_read_image(Dwarf_Debug dbg,
+                    Dwarf_Unsigned rva,
+                    void *buffer,
+                    Dwarf_Unsigned size)
+{
+    pe_access_object_t *pe_obj = (pe_access_object_t *)dbg->de_obj_file->ai_object;
+    /* the headers are at the start of the file */
+    Dwarf_Unsigned offset = rva;
+    Dwarf_Unsigned available = pe_obj->headerSize;
+    if (rva >= pe_obj->headerSize) {
+        /* find the section of the address in the loaded image */
+        WORD num_sections = pe_obj->pNtHeaders->FileHeader.NumberOfSections;
+        WORD i;
+        available = 0;
+        for (i = 0; i < num_sections; i++) {
+            PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + i;
+            DWORD section_size = pSection->SizeOfRawData;
+            if (pSection->Misc.VirtualSize < section_size) {
+                section_size = pSection->Misc.VirtualSize;
+            }
+            if (rva >= pSection->VirtualAddress &&
+                rva - pSection->VirtualAddress < section_size) {
+                offset = pSection->PointerToRawData +
+                    (rva - pSection->VirtualAddress);
+                available = (Dwarf_Unsigned)pSection->PointerToRawData +
+                    section_size;
+                break;
+            }
+        }
+    }
+    /* data beyond the raw size of the section (like .bss) isn't in the file */
+    if (offset + size < offset || offset + size > available ||
+        offset + size > pe_obj->fileSize) {
+        return 0;
+    }
+    memcpy(buffer, pe_obj->lpFileBase + offset, size);
+    return 1;
+}
+
+
 int
 dwarf_pe_finish(Dwarf_Debug dbg,
                 Dwarf_Error *error)
 {
     pe_access_object_t *pe_obj = (pe_access_object_t *)dbg->de_obj_file->ai_object;
-    UnmapViewOfFile(pe_obj->lpFileBase);
-    CloseHandle(pe_obj->hFileMapping);
-    CloseHandle(pe_obj->hFile);
+    dwst_unmap_file(pe_obj->lpMapping, pe_obj->fileSize);
     free(pe_obj);
     free(dbg->de_obj_file);
     return dwarf_object_finish(dbg);
@@ -22,6 +22,10 @@
 #define _DWARF_PE_H_
 
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 #include <dwarf.h>
 #include <libdwarf.h>
 
@@ -41,6 +45,22 @@ dwarf_pe_init(const wchar_t *image,
 int
 dwarf_pe_finish(Dwarf_Debug dbg, Dwarf_Error * error);
 
+/* decompressed bytes of the loaded sections */
+Dwarf_Unsigned
+dwarf_pe_inflated(Dwarf_Debug dbg);
+
+/* IMAGE_FILE_MACHINE_* of the executable */
+Dwarf_Half
+dwarf_pe_machine(Dwarf_Debug dbg);
+
+/* copy data of the loaded image (by its RVA) out of the file,
+ * returns 1 on success */
+int
+dwarf_pe_read_image(Dwarf_Debug dbg,
+                    Dwarf_Unsigned rva,
+                    void *buffer,
+                    Dwarf_Unsigned size);
+
 
 wchar_t *
 dwst_ansi2wide(const char *str);
@@ -49,6 +69,54 @@ char *
 dwst_wide2ansi(const wchar_t *str);
 
 
+/* recursive lock */
+typedef struct dwst_lock dwst_lock;
+
+dwst_lock *
+dwst_lock_new(void);
+
+void
+dwst_lock_free(dwst_lock *lock);
+
+void
+dwst_lock_enter(dwst_lock *lock);
+
+void
+dwst_lock_leave(dwst_lock *lock);
+
+/* process-wide lock, created on first use, never freed */
+dwst_lock *
+dwst_global_lock(void);
+
+
+/* read-only mapping of a whole file */
+const void *
+dwst_map_file(const wchar_t *name, size_t *size);
+
+void
+dwst_unmap_file(const void *data, size_t size);
+
+/* TimeDateStamp and SizeOfImage of a PE file */
+int
+dwst_pe_identity(const wchar_t *image,
+                 uint32_t *timestamp, uint32_t *size_of_image);
+
+FILE *
+dwst_wfopen(const wchar_t *name, const wchar_t *mode);
+
+/* rename a file, and replace the target if it exists,
+ * returns 1 on success */
+int
+dwst_wrename(const wchar_t *from, const wchar_t *to);
+
+void
+dwst_wremove(const wchar_t *name);
+
+/* monotonic clock in nanoseconds */
+uint64_t
+dwst_time_ns(void);
+
+
 #ifdef __cplusplus
 }
 #endif
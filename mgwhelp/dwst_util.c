@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwst_util.h"
+
+
+uint64_t
+dwst_hash_mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash * 0xff51afd7ed558ccdULL;
+}
+
+uint64_t
+dwst_hash_bytes(const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+int
+dwst_grow_array(void **arr, int *alloc, int needed, size_t elem_size)
+{
+    if (needed <= *alloc) return 1;
+
+    int new_alloc = *alloc ? *alloc : 64;
+    while (new_alloc < needed) new_alloc *= 2;
+    void *new_arr = realloc(*arr, new_alloc * elem_size);
+    if (!new_arr) return 0;
+    *arr = new_arr;
+    *alloc = new_alloc;
+    return 1;
+}
+
+int
+dwst_grow_hash(int **hash_arr, int *hash_size,
+               const void *entries, size_t entry_size, size_t hash_offset,
+               int qty)
+{
+    int new_size = *hash_size ? *hash_size * 2 : 256;
+    int *new_arr = malloc(new_size * sizeof(int));
+    if (!new_arr) return 0;
+
+    int i;
+    for (i = 0; i < new_size; i++) new_arr[i] = -1;
+    for (i = 0; i < qty; i++) {
+        uint64_t hash;
+        memcpy(&hash, (const char *)entries + i * entry_size + hash_offset,
+               sizeof(uint64_t));
+        int slot = (int)(hash & (new_size - 1));
+        while (new_arr[slot] >= 0) slot = (slot + 1) & (new_size - 1);
+        new_arr[slot] = i;
+    }
+
+    free(*hash_arr);
+    *hash_arr = new_arr;
+    *hash_size = new_size;
+    return 1;
+}
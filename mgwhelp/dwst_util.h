@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _DWST_UTIL_H_
+#define _DWST_UTIL_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* combine a value into a hash */
+uint64_t
+dwst_hash_mix(uint64_t hash, uint64_t value);
+
+/* FNV-1a hash of bytes */
+uint64_t
+dwst_hash_bytes(const void *data, size_t size);
+
+/* grow a malloc'd array to at least needed elements,
+ * returns 0 if it failed (the array is kept) */
+int
+dwst_grow_array(void **arr, int *alloc, int needed, size_t elem_size);
+
+/* rebuild an open addressing hash table of entry indexes
+ * (-1 for empty slots) with twice the size,
+ * the uint64_t hash of each entry is at hash_offset,
+ * returns 0 if it failed (the table is kept) */
+int
+dwst_grow_hash(int **hash_arr, int *hash_size,
+               const void *entries, size_t entry_size, size_t hash_offset,
+               int qty);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _DWST_UTIL_H_ */
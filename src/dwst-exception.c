@@ -61,12 +61,16 @@ int captureStackTrace( ULONG_PTR *frameAddr,uintptr_t *frames,int size )
 #define cip Pc
 #define cfp Fp
 #define MACH_TYPE IMAGE_FILE_MACHINE_ARM64
+#define FP_REG 29
 #else
 // Defaults to AMD64
 #define csp Rsp
 #define cip Rip
 #define cfp Rbp
 #define MACH_TYPE IMAGE_FILE_MACHINE_AMD64
+#define FP_REG 6
+// all functions which aren't leafs have unwind codes
+#define UNWIND_CODES
 #endif
 #else
 // Defaults to i386
@@ -74,6 +78,7 @@ int captureStackTrace( ULONG_PTR *frameAddr,uintptr_t *frames,int size )
 #define cip Eip
 #define cfp Ebp
 #define MACH_TYPE IMAGE_FILE_MACHINE_I386
+#define FP_REG 5
 #endif
 
 #ifndef NO_DBGHELP
@@ -115,43 +120,117 @@ int dwstOfProcessExt(
     dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
     void *callbackContext );
 
-int dwstOfExceptionExt(
-    void *context,
-    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
-    void *callbackContext )
+void captureModules( dwstRawStack *stack );
+
+#if defined(NO_DBGHELP) || defined(UNWIND_CODES)
+int unwindModule( dwstUnwindRegs *regs,int caller );
+
+// the registers of the context by DWARF register number
+static void contextRegs( const CONTEXT *context,dwstUnwindRegs *regs )
+{
+  memset( regs,0,sizeof(dwstUnwindRegs) );
+  regs->pc = context->cip;
+
+  int r;
+#ifdef _WIN64
+#if defined(__aarch64__) || defined(_M_ARM64)
+  for( r=0; r<31; r++ )
+    regs->reg[r] = context->X[r];
+  regs->reg[31] = context->Sp;
+  regs->valid = 0xffffffff;
+#else
+  const DWORD64 values[16] = {
+    context->Rax,context->Rdx,context->Rcx,context->Rbx,
+    context->Rsi,context->Rdi,context->Rbp,context->Rsp,
+    context->R8,context->R9,context->R10,context->R11,
+    context->R12,context->R13,context->R14,context->R15 };
+  for( r=0; r<16; r++ )
+    regs->reg[r] = values[r];
+  regs->valid = 0xffff;
+#endif
+#else
+  const DWORD values[8] = {
+    context->Eax,context->Ecx,context->Edx,context->Ebx,
+    context->Esp,context->Ebp,context->Esi,context->Edi };
+  for( r=0; r<8; r++ )
+    regs->reg[r] = values[r];
+  regs->valid = 0xff;
+#endif
+}
+
+static int unwindContext( CONTEXT *contextP,dwstUnwindRegs *regs,
+    uintptr_t *frames,int size )
+{
+  int count = 0;
+  frames[count++] = contextP->cip;
+
+  contextRegs( contextP,regs );
+  while( count<size && unwindModule(regs,count>1) )
+    frames[count++] = regs->pc - 1;
+
+  return( count );
+}
+#endif
+
+static int captureException( CONTEXT *contextP,uintptr_t *frames,int size )
 {
-  uintptr_t frames[MAX_FRAMES];
   int count = 0;
-  CONTEXT *contextP = (CONTEXT*)context;
 
 #ifdef NO_DBGHELP
-  frames[count++] = contextP->cip;
+  // the call frame information doesn't need frame pointers,
+  // and the frame pointer chain continues where it's missing
+  dwstUnwindRegs regs;
+  count = unwindContext( contextP,&regs,frames,size );
 
-  ULONG_PTR csp = *(ULONG_PTR*)contextP->csp;
-  if( csp )
-    frames[count++] = csp - 1;
+  if( count==1 )
+  {
+    ULONG_PTR csp = *(ULONG_PTR*)contextP->csp;
+    if( csp )
+      frames[count++] = csp - 1;
 
-  ULONG_PTR *sp = (ULONG_PTR*)contextP->cfp;
-  count += captureStackTrace( sp,frames+count,MAX_FRAMES-count );
+    ULONG_PTR *sp = (ULONG_PTR*)contextP->cfp;
+    count += captureStackTrace( sp,frames+count,size-count );
+  }
+  else if( regs.valid&(1U<<FP_REG) )
+  {
+    ULONG_PTR *sp = (ULONG_PTR*)(uintptr_t)regs.reg[FP_REG];
+    count += captureStackTrace( sp,frames+count,size-count );
+  }
 #else
+#ifdef UNWIND_CODES
+  // the symbols of all modules are only loaded by dbghelp
+  // if the unwind codes couldn't be used
+  dwstUnwindRegs regs;
+  count = unwindContext( contextP,&regs,frames,size );
+  if( count>1 ) return( count );
+  count = 0;
+#endif
+
   HANDLE process = GetCurrentProcess();
 
   SymSetOptions( SYMOPT_LOAD_LINES );
   SymInitialize( process,NULL,TRUE );
 
-  count += captureStackWalk( process,contextP,frames+count,MAX_FRAMES-count );
-#endif
-
-  count = dwstOfProcessExt( frames,count,
-      callbackFunc,callbackFuncW,callbackContext );
+  count += captureStackWalk( process,contextP,frames+count,size-count );
 
-#ifndef NO_DBGHELP
   SymCleanup( process );
 #endif
 
   return( count );
 }
 
+int dwstOfExceptionExt(
+    void *context,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  uintptr_t frames[MAX_FRAMES];
+  int count = captureException( (CONTEXT*)context,frames,MAX_FRAMES );
+
+  return( dwstOfProcessExt(frames,count,
+        callbackFunc,callbackFuncW,callbackContext) );
+}
+
 int dwstOfException(
     void *context,
     dwstCallback *callbackFunc,void *callbackContext )
@@ -165,3 +244,14 @@ int dwstOfExceptionW(
 {
   return( dwstOfExceptionExt(context,NULL,callbackFunc,callbackContext) );
 }
+
+int dwstCaptureException( void *context,dwstRawStack *stack )
+{
+  if( !context || !stack ) return( 0 );
+
+  stack->count = captureException(
+      (CONTEXT*)context,stack->addr,DWST_MAX_FRAMES );
+  captureModules( stack );
+
+  return( stack->count );
+}
@@ -21,42 +21,15 @@
 
 #include "dwarf_pe.h"
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
 
 
-typedef int ChildWalker( Dwarf_Debug dbg,Dwarf_Die die,void *context );
+typedef struct image_frames image_frames;
 
-// call walkFunc() recursively for every child DIE
-static int walkChildren( Dwarf_Debug dbg,Dwarf_Die die,
-    ChildWalker *walkFunc,void *context )
-{
-  Dwarf_Die child;
-  if( dwarf_child(die,&child,NULL)!=DW_DLV_OK )
-    return( 0 );
-
-  while( 1 )
-  {
-    int stopChildren = walkChildren( dbg,child,walkFunc,context );
-    int stopCur = walkFunc( dbg,child,context );
-
-    if( stopChildren || stopCur )
-    {
-      dwarf_dealloc( dbg,child,DW_DLA_DIE );
-      return( 1 );
-    }
-
-    Dwarf_Die next_child;
-    int res = dwarf_siblingof_b( dbg,child,1,&next_child,NULL );
-
-    dwarf_dealloc( dbg,child,DW_DLA_DIE );
-
-    if( res!=DW_DLV_OK ) break;
-    child = next_child;
-  }
-
-  return( 0 );
-}
+void freeImageFrames( Dwarf_Debug dbg,image_frames *frames );
 
 
 // get Dwarf_Ranges of specified DIE
@@ -123,21 +96,30 @@ static int dwarf_lowhighpc( Dwarf_Die die,
   return( res );
 }
 
-// get DIE by reference attribute
-static int dwarf_die_by_ref( Dwarf_Debug dbg,Dwarf_Die die,
-    Dwarf_Half attr,Dwarf_Die *return_die )
+// get DIE offset of reference attribute
+static int dwarf_ref_offset( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Half attr,Dwarf_Off *ref_off )
 {
   Dwarf_Attribute ref_attr;
   int res = dwarf_attr( die,attr,&ref_attr,NULL );
   if( res!=DW_DLV_OK ) return( res );
 
+  res = dwarf_global_formref( ref_attr,ref_off,NULL );
+
+  dwarf_dealloc( dbg,ref_attr,DW_DLA_ATTR );
+
+  return( res );
+}
+
+// get DIE by reference attribute
+static int dwarf_die_by_ref( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Half attr,Dwarf_Die *return_die )
+{
   Dwarf_Off ref_off;
-  res = dwarf_global_formref( ref_attr,&ref_off,NULL );
+  int res = dwarf_ref_offset( dbg,die,attr,&ref_off );
   if( res==DW_DLV_OK )
     res = dwarf_offdie_b( dbg,ref_off,1,return_die,NULL );
 
-  dwarf_dealloc( dbg,ref_attr,DW_DLA_ATTR );
-
   return( res );
 }
 
@@ -167,7 +149,7 @@ size_t dwstDemangle(
 
 // get function name of specified DIE
 static int dwarf_name_of_func( Dwarf_Debug dbg,Dwarf_Die die,
-    char **funcname )
+    char **funcname,dwstStats *stats )
 {
   *funcname = NULL;
   char *local_funcname;
@@ -185,6 +167,7 @@ static int dwarf_name_of_func( Dwarf_Debug dbg,Dwarf_Die die,
     if( res==DW_DLV_OK )
     {
       char *demangled = __cxa_demangle( local_funcname,NULL,NULL,NULL );
+      stats->demangleCalls++;
 
       dwarf_dealloc( dbg,local_funcname,DW_DLA_STRING );
 
@@ -203,6 +186,7 @@ static int dwarf_name_of_func( Dwarf_Debug dbg,Dwarf_Die die,
   }
 #else
   (void)dbg;
+  (void)stats;
 #endif
 
   res = dwarf_diename( die,&local_funcname,NULL );
@@ -213,22 +197,180 @@ static int dwarf_name_of_func( Dwarf_Debug dbg,Dwarf_Die die,
   return( DW_DLV_OK );
 }
 
-static char *dwarf_name_of_func_linked( Dwarf_Debug dbg,Dwarf_Die die )
+
+// function name of DIE offset
+typedef struct func_name
 {
-  char *funcname = NULL;
-  if( dwarf_name_of_func(dbg,die,&funcname)==DW_DLV_OK )
-    return( funcname );
+  Dwarf_Off offs;
+  const char *name;
+} func_name;
 
-  Dwarf_Die link;
-  if( dwarf_die_by_ref(dbg,die,DW_AT_abstract_origin,&link)==DW_DLV_OK ||
-      dwarf_die_by_ref(dbg,die,DW_AT_specification,&link)==DW_DLV_OK )
+// function names by DIE offset, and the interned name strings
+typedef struct func_name_cache
+{
+  func_name *names;
+  uint32_t nameMask;
+  int nameCount;
+  char **strings;
+  uint32_t stringMask;
+  int stringCount;
+} func_name_cache;
+
+static uint32_t hashString( const char *str,size_t len )
+{
+  uint32_t hash = 2166136261u;
+  size_t i;
+  for( i=0; i<len; i++ )
   {
-    funcname = dwarf_name_of_func_linked( dbg,link );
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return( hash );
+}
 
-    dwarf_dealloc( dbg,link,DW_DLA_DIE );
+static uint32_t hashOffset( Dwarf_Off offs )
+{
+  uint64_t hash = (uint64_t)offs*0x9e3779b97f4a7c15ull;
+  return( (uint32_t)(hash>>32) );
+}
+
+// get the interned copy of str
+static const char *internString( func_name_cache *cache,const char *str )
+{
+  // keep the load factor below 1/2
+  if( (uint32_t)(cache->stringCount+1)*2>cache->stringMask )
+  {
+    uint32_t newMask = cache->stringMask ? cache->stringMask*2+1 : 255;
+    char **newArr = calloc( newMask+1,sizeof(char*) );
+    if( !newArr ) return( NULL );
+
+    uint32_t i;
+    for( i=0; cache->strings && i<=cache->stringMask; i++ )
+    {
+      char *old = cache->strings[i];
+      if( !old ) continue;
+      uint32_t h = hashString( old,strlen(old) ) & newMask;
+      while( newArr[h] ) h = (h+1) & newMask;
+      newArr[h] = old;
+    }
+    free( cache->strings );
+    cache->strings = newArr;
+    cache->stringMask = newMask;
+  }
+
+  uint32_t h = hashString( str,strlen(str) ) & cache->stringMask;
+  while( cache->strings[h] )
+  {
+    if( !strcmp(cache->strings[h],str) )
+      return( cache->strings[h] );
+    h = (h+1) & cache->stringMask;
+  }
+
+  char *copy = strdup( str );
+  if( !copy ) return( NULL );
+  cache->strings[h] = copy;
+  cache->stringCount++;
+
+  return( copy );
+}
+
+static const func_name *findFuncName( const func_name_cache *cache,
+    Dwarf_Off offs )
+{
+  if( !cache->names ) return( NULL );
+
+  uint32_t h = hashOffset( offs ) & cache->nameMask;
+  while( cache->names[h].offs )
+  {
+    if( cache->names[h].offs==offs )
+      return( &cache->names[h] );
+    h = (h+1) & cache->nameMask;
+  }
+
+  return( NULL );
+}
+
+static void addFuncName( func_name_cache *cache,
+    Dwarf_Off offs,const char *name )
+{
+  if( !offs ) return;
+
+  // keep the load factor below 1/2
+  if( (uint32_t)(cache->nameCount+1)*2>cache->nameMask )
+  {
+    uint32_t newMask = cache->nameMask ? cache->nameMask*2+1 : 255;
+    func_name *newArr = calloc( newMask+1,sizeof(func_name) );
+    if( !newArr ) return;
+
+    uint32_t i;
+    for( i=0; cache->names && i<=cache->nameMask; i++ )
+    {
+      if( !cache->names[i].offs ) continue;
+      uint32_t h = hashOffset( cache->names[i].offs ) & newMask;
+      while( newArr[h].offs ) h = (h+1) & newMask;
+      newArr[h] = cache->names[i];
+    }
+    free( cache->names );
+    cache->names = newArr;
+    cache->nameMask = newMask;
+  }
+
+  uint32_t h = hashOffset( offs ) & cache->nameMask;
+  while( cache->names[h].offs ) h = (h+1) & cache->nameMask;
+  cache->names[h].offs = offs;
+  cache->names[h].name = name;
+  cache->nameCount++;
+}
+
+static void freeFuncNameCache( func_name_cache *cache )
+{
+  uint32_t i;
+  for( i=0; cache->strings && i<=cache->stringMask; i++ )
+    free( cache->strings[i] );
+  free( cache->strings );
+  free( cache->names );
+}
+
+// maximum chain length of abstract origins and specifications
+#define MAX_NAME_LINKS 16
+
+// get function name of the DIE at offs, or of the DIE it is linked to,
+// each DIE is read (and its name demangled) only once
+static const char *funcNameOfDie( Dwarf_Debug dbg,func_name_cache *cache,
+    Dwarf_Off offs,int links,dwstStats *stats )
+{
+  const func_name *cached = findFuncName( cache,offs );
+  if( cached )
+  {
+    stats->nameHits++;
+    return( cached->name );
+  }
+  stats->nameMisses++;
+
+  const char *name = NULL;
+  Dwarf_Die die;
+  if( dwarf_offdie_b(dbg,offs,1,&die,NULL)==DW_DLV_OK )
+  {
+    stats->offdieCalls++;
+
+    char *funcname;
+    Dwarf_Off link;
+    if( dwarf_name_of_func(dbg,die,&funcname,stats)==DW_DLV_OK )
+    {
+      name = internString( cache,funcname );
+      dwarf_dealloc( dbg,funcname,DW_DLA_STRING );
+    }
+    else if( links<MAX_NAME_LINKS &&
+        (dwarf_ref_offset(dbg,die,DW_AT_abstract_origin,&link)==DW_DLV_OK ||
+         dwarf_ref_offset(dbg,die,DW_AT_specification,&link)==DW_DLV_OK) )
+      name = funcNameOfDie( dbg,cache,link,links+1,stats );
+
+    dwarf_dealloc( dbg,die,DW_DLA_DIE );
   }
 
-  return( funcname );
+  addFuncName( cache,offs,name );
+
+  return( name );
 }
 
 
@@ -256,512 +398,3265 @@ static void dwarf_callback(
 }
 
 
-typedef struct inline_info
+// source location of a line table row
+typedef struct line_row
 {
-  Dwarf_Addr ptr,low;
-  char **files;
-  int fileCount;
-  dwstCallback *callbackFunc;
-  dwstCallbackW *callbackFuncW;
-  void *callbackContext;
-  uint64_t ptrOrig;
-  int fileno,lineno,columnno;
-  int fileno_offs;
-} inline_info;
+  uint32_t lineno;
+  uint16_t fileno;
+  uint16_t columnno;
+} line_row;
 
-// find the calling-location of inlined functions
-static int findInlined( Dwarf_Debug dbg,Dwarf_Die die,inline_info *cuInfo )
+// fileno of rows which end a sequence
+#define LINE_END_SEQUENCE 0xffff
+
+// flattened line table, sorted by address
+typedef struct line_table
 {
-  Dwarf_Half tag;
-  if( dwarf_tag(die,&tag,NULL)!=DW_DLV_OK ||
-      (tag!=DW_TAG_inlined_subroutine &&
-       tag!=DW_TAG_subprogram) )
-    return( 0 );
+  Dwarf_Addr base;
+  uint32_t *offs;
+  line_row *rows;
+  int count;
+} line_table;
 
+typedef struct line_sequence
+{
   Dwarf_Addr low,high;
-  if( dwarf_lowhighpc(die,&low,&high)==DW_DLV_OK && high )
+  int first,count;
+} line_sequence;
+
+static int cmpLineSequence( const void *a,const void *b )
+{
+  const line_sequence *sa = a;
+  const line_sequence *sb = b;
+  if( sa->low!=sb->low ) return( sa->low<sb->low ? -1 : 1 );
+  return( sa->first - sb->first );
+}
+
+// convert the line table of the CU into a line_table
+static int readLineTable( Dwarf_Die die,line_table *table,int *fileno_offs,
+    dwstStats *stats )
+{
+  table->base = 0;
+  table->offs = NULL;
+  table->rows = NULL;
+  table->count = 0;
+
+  Dwarf_Unsigned lineVersion = 0;
+  Dwarf_Small tableCount = 0;
+  Dwarf_Line_Context lineContext = NULL;
+  Dwarf_Line *lines;
+  Dwarf_Signed lineCount;
+  if( dwarf_srclines_b(die,&lineVersion,
+        &tableCount,&lineContext,NULL)!=DW_DLV_OK ||
+      tableCount!=1 ||
+      dwarf_srclines_from_linecontext(lineContext,
+        &lines,&lineCount,NULL)!=DW_DLV_OK )
   {
-    if( cuInfo->ptr<low || cuInfo->ptr>=high )
-      return( 0 );
+    dwarf_srclines_dealloc_b( lineContext );
+    return( 0 );
   }
-  else
+  *fileno_offs = lineVersion>=5 ? 0 : -1;
+  stats->lineRows += lineCount;
+
+  Dwarf_Addr *addrs = malloc( lineCount*sizeof(Dwarf_Addr) );
+  line_row *rows = malloc( lineCount*sizeof(line_row) );
+  line_sequence *seqs = malloc( lineCount*sizeof(line_sequence) );
+  if( !addrs || !rows || !seqs ) lineCount = 0;
+
+  // collect the sequences, duplicate addresses only keep the last row
+  int c;
+  int rowCount = 0;
+  int seqCount = 0;
+  int onEnd = 1;
+  for( c=0; c<lineCount; c++ )
   {
-    Dwarf_Half version;
-    Dwarf_Signed rangeCount;
-    Dwarf_Ranges *ranges;
-    Dwarf_Rnglists_Head rnghlhead;
-    Dwarf_Unsigned rngEntriesCount;
-    if( dwarf_ranges(dbg,die,&version,&ranges,&rangeCount,
-          &rnghlhead,&rngEntriesCount)!=DW_DLV_OK )
-      return( 0 );
+    Dwarf_Addr add;
+    Dwarf_Bool endsequ;
+    if( dwarf_lineaddr(lines[c],&add,NULL)!=DW_DLV_OK ||
+        dwarf_lineendsequence(lines[c],&endsequ,NULL)!=DW_DLV_OK )
+      break;
 
-    if( version<=4 )
+    if( onEnd )
     {
-      int i;
-      Dwarf_Addr base = cuInfo->low;
-      for( i=0; i<rangeCount; i++ )
-      {
-        Dwarf_Ranges *range = ranges + i;
-        if( range->dwr_type==DW_RANGES_END ) continue;
+      seqs[seqCount].low = add;
+      seqs[seqCount].first = rowCount;
+      seqCount++;
+    }
+    else if( add==addrs[rowCount-1] )
+      rowCount--;
 
-        low = range->dwr_addr1;
-        high = range->dwr_addr2;
+    line_row *row = &rows[rowCount];
+    addrs[rowCount++] = add;
+    onEnd = endsequ;
 
-        if( range->dwr_type==DW_RANGES_ENTRY )
-        {
-          low += base;
-          high += base;
-        }
-        else
-        {
-          base = high;
-          continue;
-        }
+    if( endsequ )
+    {
+      line_sequence *seq = &seqs[seqCount-1];
+      seq->high = add;
+      seq->count = rowCount - seq->first;
+      row->lineno = 0;
+      row->fileno = LINE_END_SEQUENCE;
+      row->columnno = 0;
+      continue;
+    }
 
-        if( cuInfo->ptr<low || cuInfo->ptr>=high )
-          continue;
+    Dwarf_Unsigned srcfileno = 0;
+    Dwarf_Unsigned lineno = 0;
+    Dwarf_Unsigned columnno = 0;
+    dwarf_line_srcfileno( lines[c],&srcfileno,NULL );
+    dwarf_lineno( lines[c],&lineno,NULL );
+    dwarf_lineoff_b( lines[c],&columnno,NULL );
+    if( srcfileno>=LINE_END_SEQUENCE || lineno>UINT32_MAX )
+      srcfileno = lineno = 0;
+    if( columnno>UINT16_MAX ) columnno = 0;
+    row->lineno = lineno;
+    row->fileno = srcfileno;
+    row->columnno = columnno;
+  }
+  // an unterminated sequence at the end is dropped
+  if( !onEnd ) seqCount--;
 
-        break;
-      }
+  dwarf_srclines_dealloc_b( lineContext );
+
+  // sequences at address 0 belong to discarded code
+  int s;
+  Dwarf_Addr base = 0;
+  for( s=0; s<seqCount; s++ )
+  {
+    if( seqs[s].low && (!base || seqs[s].low<base) )
+      base = seqs[s].low;
+  }
+
+  qsort( seqs,seqCount,sizeof(line_sequence),cmpLineSequence );
+
+  uint32_t *offs = NULL;
+  line_row *tableRows = NULL;
+  if( seqCount )
+  {
+    offs = malloc( rowCount*sizeof(uint32_t) );
+    tableRows = malloc( rowCount*sizeof(line_row) );
+    if( !offs || !tableRows ) seqCount = 0;
+  }
+
+  // concatenate the sorted sequences, overlapping ones are skipped
+  int count = 0;
+  Dwarf_Addr end = 0;
+  for( s=0; s<seqCount; s++ )
+  {
+    line_sequence *seq = &seqs[s];
+    if( !seq->low || seq->low<end || seq->low>=seq->high ||
+        seq->high-base>UINT32_MAX )
+      continue;
+
+    // the end of the previous sequence is replaced by this start
+    if( count && seq->low==end ) count--;
+
+    int r;
+    for( r=0; r<seq->count; r++ )
+      offs[count+r] = addrs[seq->first+r] - base;
+    memcpy( tableRows+count,rows+seq->first,seq->count*sizeof(line_row) );
+    count += seq->count;
+    end = seq->high;
+  }
+
+  free( addrs );
+  free( rows );
+  free( seqs );
 
-      dwarf_dealloc_ranges( dbg,ranges,rangeCount );
+  if( !count )
+  {
+    free( offs );
+    free( tableRows );
+    return( 1 );
+  }
+
+  table->base = base;
+  uint32_t *newOffs = realloc( offs,count*sizeof(uint32_t) );
+  table->offs = newOffs ? newOffs : offs;
+  line_row *newRows = realloc( tableRows,count*sizeof(line_row) );
+  table->rows = newRows ? newRows : tableRows;
+  table->count = count;
 
-      if( i>=rangeCount ) return( 0 );
+  return( 1 );
+}
+
+// binary search the row containing ptr,
+// starting at the row of the previous lookup (hint)
+static const line_row *findLine( const line_table *table,Dwarf_Addr ptr,
+    int *hint )
+{
+  if( !table->count || ptr<table->base ||
+      ptr-table->base>UINT32_MAX )
+    return( NULL );
+
+  uint32_t off = ptr - table->base;
+  const uint32_t *offs = table->offs;
+  int low = 0;
+  int high = table->count;
+  if( *hint<high && offs[*hint]<=off )
+  {
+    // addresses are often increasing, so gallop forward first
+    int step = 1;
+    low = *hint + 1;
+    while( low+step<=high && offs[low+step-1]<=off )
+    {
+      low += step;
+      step *= 2;
     }
+    if( low+step<=high ) high = low + step - 1;
+  }
+  while( low<high )
+  {
+    int mid = low + (high-low)/2;
+    if( offs[mid]<=off )
+      low = mid + 1;
     else
+      high = mid;
+  }
+
+  if( !low ) return( NULL );
+  *hint = low - 1;
+
+  if( table->rows[low-1].fileno==LINE_END_SEQUENCE )
+    return( NULL );
+
+  return( &table->rows[low-1] );
+}
+
+// subprogram or inlined subroutine
+typedef struct inline_node
+{
+  Dwarf_Off offs;
+  const char *funcname;
+  atomic_int nameRead;
+  int parent;
+  int depth;
+  int isInlined;
+  // call location of inlined subroutines, callfile is -1 if unknown
+  int callfile,callline,callcolumn;
+} inline_node;
+
+// address range of an inline_node, up is the next enclosing range
+typedef struct inline_range
+{
+  Dwarf_Addr low,high;
+  int node;
+  int depth;
+  int up;
+} inline_range;
+
+// all subprograms and inlined subroutines of a CU
+typedef struct inline_tree
+{
+  inline_node *nodes;
+  int nodeCount,nodeAlloc;
+  inline_range *ranges;
+  int rangeCount,rangeAlloc;
+} inline_tree;
+
+static int addInlineRange( inline_tree *tree,
+    Dwarf_Addr low,Dwarf_Addr high,int node )
+{
+  if( low>=high ) return( 1 );
+
+  if( tree->rangeCount>=tree->rangeAlloc )
+  {
+    int newAlloc = tree->rangeAlloc ? tree->rangeAlloc*2 : 64;
+    inline_range *newArr = realloc( tree->ranges,
+        newAlloc*sizeof(inline_range) );
+    if( !newArr ) return( 0 );
+    tree->ranges = newArr;
+    tree->rangeAlloc = newAlloc;
+  }
+
+  inline_range *range = &tree->ranges[tree->rangeCount++];
+  range->low = low;
+  range->high = high;
+  range->node = node;
+  range->depth = tree->nodes[node].depth;
+  range->up = -1;
+
+  return( 1 );
+}
+
+// add the address ranges of the DIE to the node
+static int readInlineRanges( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Addr cuBase,inline_tree *tree,int node )
+{
+  int rangeCount = tree->rangeCount;
+
+  Dwarf_Addr low,high;
+  if( dwarf_lowhighpc(die,&low,&high)==DW_DLV_OK && high )
+  {
+    addInlineRange( tree,low,high,node );
+    return( tree->rangeCount>rangeCount );
+  }
+
+  Dwarf_Half version;
+  Dwarf_Signed rangesCount;
+  Dwarf_Ranges *ranges;
+  Dwarf_Rnglists_Head rnghlhead;
+  Dwarf_Unsigned rngEntriesCount;
+  if( dwarf_ranges(dbg,die,&version,&ranges,&rangesCount,
+        &rnghlhead,&rngEntriesCount)!=DW_DLV_OK )
+    return( 0 );
+
+  if( version<=4 )
+  {
+    int i;
+    Dwarf_Addr base = cuBase;
+    for( i=0; i<rangesCount; i++ )
     {
-      unsigned i;
-      for( i=0; i<rngEntriesCount; i++ )
-      {
-        unsigned entrylen = 0;
-        unsigned code = 0;
-        Dwarf_Unsigned lowpc = 0;
-        Dwarf_Unsigned highpc = 0;
-        Dwarf_Bool debug_addr_unavailable = 0;
-        int res = dwarf_get_rnglists_entry_fields_a( rnghlhead,i,
-            &entrylen,&code,NULL,NULL,
-            &debug_addr_unavailable,&lowpc,&highpc,NULL );
-        if( res!=DW_DLV_OK || code==DW_RLE_end_of_list )
-        {
-          i = rngEntriesCount;
-          break;
-        }
-        if( code==DW_RLE_base_addressx || code==DW_RLE_base_address ||
-            debug_addr_unavailable )
-          continue;
+      Dwarf_Ranges *range = ranges + i;
+      if( range->dwr_type==DW_RANGES_END ) continue;
 
-        if( cuInfo->ptr<lowpc || cuInfo->ptr>=highpc )
-          continue;
+      low = range->dwr_addr1;
+      high = range->dwr_addr2;
 
-        break;
+      if( range->dwr_type==DW_RANGES_ENTRY )
+      {
+        low += base;
+        high += base;
+      }
+      else
+      {
+        base = high;
+        continue;
       }
 
-      dwarf_dealloc_rnglists_head( rnghlhead );
-
-      if( i>=rngEntriesCount ) return( 0 );
+      addInlineRange( tree,low,high,node );
     }
-  }
 
-  if( tag==DW_TAG_subprogram )
+    dwarf_dealloc_ranges( dbg,ranges,rangesCount );
+  }
+  else
   {
-    char *funcname = dwarf_name_of_func_linked( dbg,die );
+    unsigned i;
+    for( i=0; i<rngEntriesCount; i++ )
+    {
+      unsigned entrylen = 0;
+      unsigned code = 0;
+      Dwarf_Unsigned lowpc = 0;
+      Dwarf_Unsigned highpc = 0;
+      Dwarf_Bool debug_addr_unavailable = 0;
+      int res = dwarf_get_rnglists_entry_fields_a( rnghlhead,i,
+          &entrylen,&code,NULL,NULL,
+          &debug_addr_unavailable,&lowpc,&highpc,NULL );
+      if( res!=DW_DLV_OK || code==DW_RLE_end_of_list )
+        break;
+      if( code==DW_RLE_base_addressx || code==DW_RLE_base_address ||
+          debug_addr_unavailable )
+        continue;
 
-    dwarf_callback( cuInfo->callbackFunc,cuInfo->callbackFuncW,
-        cuInfo->ptrOrig,cuInfo->files[cuInfo->fileno],NULL,
-        cuInfo->lineno,funcname,cuInfo->callbackContext,cuInfo->columnno );
+      addInlineRange( tree,lowpc,highpc,node );
+    }
 
-    if( funcname )
-      dwarf_dealloc( dbg,funcname,DW_DLA_STRING );
-    return( 1 );
+    dwarf_dealloc_rnglists_head( rnghlhead );
   }
 
+  return( tree->rangeCount>rangeCount );
+}
+
+// read the call location of an inlined subroutine
+static void readCallLocation( Dwarf_Debug dbg,Dwarf_Die die,
+    inline_node *node )
+{
+  node->callfile = -1;
+  node->callline = 0;
+  node->callcolumn = 0;
+
   Dwarf_Attribute callfile;
   if( dwarf_attr(die,DW_AT_call_file,&callfile,NULL)!=DW_DLV_OK )
-    return( 1 );
+    return;
 
   Dwarf_Attribute callline;
   if( dwarf_attr(die,DW_AT_call_line,&callline,NULL)!=DW_DLV_OK )
   {
     dwarf_dealloc( dbg,callfile,DW_DLA_ATTR );
-    return( 1 );
+    return;
   }
 
   Dwarf_Unsigned fileno,lineno;
   if( dwarf_formudata(callfile,&fileno,NULL)==DW_DLV_OK &&
       dwarf_formudata(callline,&lineno,NULL)==DW_DLV_OK &&
-      (int)fileno+cuInfo->fileno_offs>=0 &&
-      (int)fileno+cuInfo->fileno_offs<cuInfo->fileCount )
+      fileno<INT32_MAX && lineno<INT32_MAX )
   {
-    char *funcname = dwarf_name_of_func_linked( dbg,die );
-
-    dwarf_callback( cuInfo->callbackFunc,cuInfo->callbackFuncW,
-        cuInfo->ptrOrig,cuInfo->files[cuInfo->fileno],NULL,
-        cuInfo->lineno,funcname,cuInfo->callbackContext,cuInfo->columnno );
-
-    cuInfo->fileno = fileno + cuInfo->fileno_offs;
-    cuInfo->lineno = lineno;
-    cuInfo->columnno = 0;
-    cuInfo->ptrOrig = 0;
+    node->callfile = fileno;
+    node->callline = lineno;
 
     Dwarf_Attribute callcolumn;
     if( dwarf_attr(die,DW_AT_call_column,&callcolumn,NULL)==DW_DLV_OK )
     {
       Dwarf_Unsigned columnno;
-      if( dwarf_formudata(callcolumn,&columnno,NULL)==DW_DLV_OK )
-        cuInfo->columnno = columnno;
+      if( dwarf_formudata(callcolumn,&columnno,NULL)==DW_DLV_OK &&
+          columnno<INT32_MAX )
+        node->callcolumn = columnno;
 
       dwarf_dealloc( dbg,callcolumn,DW_DLA_ATTR );
     }
-
-    if( funcname )
-      dwarf_dealloc( dbg,funcname,DW_DLA_STRING );
   }
 
   dwarf_dealloc( dbg,callfile,DW_DLA_ATTR );
   dwarf_dealloc( dbg,callline,DW_DLA_ATTR );
-
-  return( 1 );
 }
 
-typedef struct range_t
-{
-  Dwarf_Addr low;
-  Dwarf_Addr high;
-} range_t;
-
-typedef struct cu_info
-{
-  Dwarf_Off offs;
-  Dwarf_Addr low,high;
-  Dwarf_Line *lines;
-  Dwarf_Signed lineCount;
-  Dwarf_Line_Context lineContext;
-  int fileno_offs;
-  char **files;
-  Dwarf_Signed fileCount;
-  range_t *ranges;
-  int rangeCount;
-} cu_info;
-
-int dwstOfFileExt(
-    const char *name,const wchar_t *nameW,uint64_t imageBase,
-    uint64_t *addr,int count,
-    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
-    void *callbackContext )
+// collect subprograms and inlined subroutines of all child DIEs
+static void readInlineChildren( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Addr cuBase,inline_tree *tree,int parent,int depth,
+    dwstStats *stats )
 {
-  if( !nameW || !addr || !count || (!callbackFunc && !callbackFuncW) )
-    return( 0 );
-
-  if( imageBase )
-    dwarf_callback( callbackFunc,callbackFuncW,imageBase,name,nameW,
-        DWST_BASE_ADDR,NULL,callbackContext,0 );
+  Dwarf_Die child;
+  if( dwarf_child(die,&child,NULL)!=DW_DLV_OK )
+    return;
 
-  Dwarf_Addr imageBase_dbg;
-  Dwarf_Debug dbg;
-  if( dwarf_pe_init(nameW,&imageBase_dbg,0,0,&dbg,NULL)!=DW_DLV_OK )
+  while( 1 )
   {
-    int i;
-    for( i=0; i<count; i++ )
-      dwarf_callback( callbackFunc,callbackFuncW,addr[i],name,nameW,
-          DWST_NO_DBG_SYM,NULL,callbackContext,0 );
+    stats->diesVisited++;
 
-    return( count );
+    int node = parent;
+    Dwarf_Half tag;
+    if( dwarf_tag(child,&tag,NULL)==DW_DLV_OK &&
+        (tag==DW_TAG_inlined_subroutine || tag==DW_TAG_subprogram) )
+    {
+      if( tree->nodeCount>=tree->nodeAlloc )
+      {
+        int newAlloc = tree->nodeAlloc ? tree->nodeAlloc*2 : 64;
+        inline_node *newArr = realloc( tree->nodes,
+            newAlloc*sizeof(inline_node) );
+        if( newArr )
+        {
+          tree->nodes = newArr;
+          tree->nodeAlloc = newAlloc;
+        }
+      }
+
+      if( tree->nodeCount<tree->nodeAlloc )
+      {
+        inline_node *n = &tree->nodes[tree->nodeCount];
+        n->parent = parent;
+        n->depth = depth;
+        n->isInlined = tag==DW_TAG_inlined_subroutine;
+        n->funcname = NULL;
+        n->nameRead = 0;
+        n->callfile = -1;
+        n->callline = 0;
+        n->callcolumn = 0;
+        if( dwarf_dieoffset(child,&n->offs,NULL)!=DW_DLV_OK )
+          n->offs = 0;
+
+        // nodes without code (declarations, abstract instances)
+        // are not needed
+        if( readInlineRanges(dbg,child,cuBase,tree,tree->nodeCount) )
+        {
+          node = tree->nodeCount++;
+          if( n->isInlined )
+            readCallLocation( dbg,child,n );
+        }
+      }
+    }
+
+    readInlineChildren( dbg,child,cuBase,tree,node,
+        node!=parent ? depth+1 : depth,stats );
+
+    Dwarf_Die next_child;
+    int res = dwarf_siblingof_b( dbg,child,1,&next_child,NULL );
+
+    dwarf_dealloc( dbg,child,DW_DLA_DIE );
+
+    if( res!=DW_DLV_OK ) break;
+    child = next_child;
+  }
+}
+
+static int cmpInlineRange( const void *a,const void *b )
+{
+  const inline_range *ra = a;
+  const inline_range *rb = b;
+  if( ra->low!=rb->low ) return( ra->low<rb->low ? -1 : 1 );
+  if( ra->high!=rb->high ) return( ra->high>rb->high ? -1 : 1 );
+  if( ra->depth!=rb->depth ) return( ra->depth - rb->depth );
+  return( ra->node - rb->node );
+}
+
+// build the inline tree of the CU
+static void readInlineTree( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Addr cuBase,inline_tree *tree,dwstStats *stats )
+{
+  memset( tree,0,sizeof(inline_tree) );
+
+  readInlineChildren( dbg,die,cuBase,tree,-1,0,stats );
+
+  if( !tree->rangeCount ) return;
+
+  // the ranges are nested, so sorted by start address the
+  // enclosing range of each is the last one not yet ended
+  inline_range *ranges = tree->ranges;
+  qsort( ranges,tree->rangeCount,sizeof(inline_range),cmpInlineRange );
+
+  int *stack = malloc( tree->rangeCount*sizeof(int) );
+  if( !stack )
+  {
+    tree->rangeCount = 0;
+    return;
+  }
+
+  int i;
+  int stackCount = 0;
+  for( i=0; i<tree->rangeCount; i++ )
+  {
+    while( stackCount && ranges[stack[stackCount-1]].high<=ranges[i].low )
+      stackCount--;
+    ranges[i].up = stackCount ? stack[stackCount-1] : -1;
+    stack[stackCount++] = i;
+  }
+
+  free( stack );
+}
+
+static void freeInlineTree( inline_tree *tree )
+{
+  free( tree->nodes );
+  free( tree->ranges );
+}
+
+// maximum nesting depth of inlined subroutines
+#define MAX_INLINE_DEPTH 64
+
+// find the nodes containing ptr, returns the innermost one
+static int findInlined( const inline_tree *tree,Dwarf_Addr ptr,
+    int *found,int *foundCount )
+{
+  const inline_range *ranges = tree->ranges;
+  int low = 0;
+  int high = tree->rangeCount;
+  while( low<high )
+  {
+    int mid = low + (high-low)/2;
+    if( ranges[mid].low<=ptr )
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  int inner = -1;
+  int r;
+  *foundCount = 0;
+  for( r=low-1; r>=0 && *foundCount<MAX_INLINE_DEPTH; r=ranges[r].up )
+  {
+    if( ptr>=ranges[r].high ) continue;
+
+    int node = ranges[r].node;
+    found[(*foundCount)++] = node;
+
+    const inline_node *n = &tree->nodes[node];
+    if( inner<0 || n->depth>tree->nodes[inner].depth ||
+        (n->depth==tree->nodes[inner].depth && node<inner) )
+      inner = node;
+  }
+
+  return( inner );
+}
+
+
+typedef struct cu_info
+{
+  Dwarf_Off offs;
+  Dwarf_Addr base;
+  Dwarf_Addr low,high;
+  line_table lines;
+  int linesRead;
+  inline_tree inlines;
+  int inlinesRead;
+  int fileno_offs;
+  char **files;
+  Dwarf_Signed fileCount;
+  // set once the tables above are complete, they are never changed after,
+  // until the CU is evicted
+  atomic_int ready;
+  // running lookups using the tables, which keeps them from eviction
+  atomic_int users;
+  // tick of the last use, for evicting the least recently used tables
+  atomic_ullong lastUse;
+  // memory of the decoded tables
+  size_t memSize;
+} cu_info;
+
+// lazily read the line table of the CU
+static void readCuLines( Dwarf_Die die,cu_info *cuInfo,dwstStats *stats )
+{
+  if( cuInfo->linesRead ) return;
+
+  uint64_t start = dwst_time_ns();
+  readLineTable( die,&cuInfo->lines,&cuInfo->fileno_offs,stats );
+  cuInfo->linesRead = 1;
+  stats->lineTime += dwst_time_ns() - start;
+}
+
+// lazily read the source files of the CU,
+// their numbering depends on the line table version
+static void readCuFiles( Dwarf_Die die,cu_info *cuInfo,dwstStats *stats )
+{
+  if( cuInfo->fileCount>=0 ) return;
+
+  readCuLines( die,cuInfo,stats );
+
+  uint64_t start = dwst_time_ns();
+  if( dwarf_srcfiles(die,&cuInfo->files,&cuInfo->fileCount,NULL)!=DW_DLV_OK )
+  {
+    cuInfo->files = NULL;
+    cuInfo->fileCount = 0;
+  }
+  stats->fileTime += dwst_time_ns() - start;
+}
+
+// address range of a CU
+typedef struct cu_range
+{
+  Dwarf_Addr low,high;
+  int cu;
+} cu_range;
+
+// function name with DIE offset
+typedef struct name_entry
+{
+  char *name;
+  Dwarf_Off offs;
+  uint32_t hash;
+  int next;
+} name_entry;
+
+// function names, hashed by their plain name
+typedef struct name_index
+{
+  name_entry *entries;
+  int count,alloc;
+  int *buckets;
+  uint32_t bucketMask;
+} name_index;
+
+// symbol index file, a prebuilt copy of the lookup tables of all CUs:
+// the sections are 8-byte aligned arrays in native little-endian layout,
+// and refer to each other only by index, so they are used directly mapped
+#define INDEX_MAGIC "DWSTIDX"
+#define INDEX_VERSION 1
+
+enum
+{
+  INDEX_RANGES,    // index_range, sorted by address
+  INDEX_UNBOUND,   // uint32_t, CUs without address ranges
+  INDEX_CUS,       // index_cu
+  INDEX_LINE_OFFS, // uint32_t, the offs of all line tables
+  INDEX_LINE_ROWS, // line_row, the rows of all line tables
+  INDEX_FILES,     // uint32_t, string offsets of the source files
+  INDEX_NODES,     // index_node
+  INDEX_INLINES,   // index_inline
+  INDEX_STRINGS,   // NUL-terminated strings
+  INDEX_SECTIONS
+};
+
+typedef struct index_section
+{
+  uint64_t offs;
+  uint64_t count;
+} index_section;
+
+typedef struct index_header
+{
+  char magic[8];
+  uint32_t version;
+  // identity of the executable
+  uint32_t timestamp;
+  uint32_t sizeOfImage;
+  uint32_t pad;
+  uint64_t imageBase;
+  index_section sections[INDEX_SECTIONS];
+} index_header;
+
+typedef struct index_range
+{
+  uint64_t low,high;
+  uint32_t cu;
+  uint32_t pad;
+} index_range;
+
+// the *First members are relative to the start of their section,
+// node and range numbers of the inline tree are relative to the CU
+typedef struct index_cu
+{
+  uint64_t offs;
+  uint64_t base;
+  uint64_t low,high;
+  uint64_t lineBase;
+  uint32_t lineFirst,lineCount;
+  uint32_t fileFirst,fileCount;
+  uint32_t nodeFirst,nodeCount;
+  uint32_t inlineFirst,inlineCount;
+  int32_t filenoOffs;
+  uint32_t pad;
+} index_cu;
+
+// string offset of nodes without name
+#define INDEX_NO_STRING 0xffffffff
+
+typedef struct index_node
+{
+  uint32_t name;
+  int32_t parent;
+  int32_t depth;
+  int32_t isInlined;
+  int32_t callfile,callline,callcolumn;
+  uint32_t pad;
+} index_node;
+
+typedef struct index_inline
+{
+  uint64_t low,high;
+  int32_t node;
+  int32_t depth;
+  int32_t up;
+  uint32_t pad;
+} index_inline;
+
+static const size_t indexEntrySize[INDEX_SECTIONS] = {
+  sizeof(index_range),sizeof(uint32_t),sizeof(index_cu),
+  sizeof(uint32_t),sizeof(line_row),sizeof(uint32_t),
+  sizeof(index_node),sizeof(index_inline),1,
+};
+
+// location of the symbol index, next to the executable
+static wchar_t *indexName( const wchar_t *nameW )
+{
+  static const wchar_t ext[] = L".dwsti";
+  size_t len = wcslen( nameW );
+  wchar_t *indexW = malloc( len*sizeof(wchar_t)+sizeof(ext) );
+  if( !indexW ) return( NULL );
+
+  memcpy( indexW,nameW,len*sizeof(wchar_t) );
+  memcpy( indexW+len,ext,sizeof(ext) );
+  return( indexW );
+}
+
+// check the sections of the symbol index, and everything which is used
+// before a CU is prepared; the inline trees are checked per CU
+static int checkIndex( const unsigned char *data,size_t size,
+    uint32_t timestamp,uint32_t sizeOfImage )
+{
+  if( size<sizeof(index_header) ) return( 0 );
+
+  const index_header *header = (const index_header*)data;
+  if( memcmp(header->magic,INDEX_MAGIC,sizeof(header->magic)) ||
+      header->version!=INDEX_VERSION ||
+      header->timestamp!=timestamp ||
+      header->sizeOfImage!=sizeOfImage )
+    return( 0 );
+
+  const index_section *sections = header->sections;
+  int s;
+  for( s=0; s<INDEX_SECTIONS; s++ )
+  {
+    uint64_t offs = sections[s].offs;
+    uint64_t count = sections[s].count;
+    if( offs%8 || offs<sizeof(index_header) || offs>size ||
+        count>(size-offs)/indexEntrySize[s] ||
+        (s!=INDEX_STRINGS && count>INT32_MAX) )
+      return( 0 );
+  }
+
+  const index_section *strings = &sections[INDEX_STRINGS];
+  if( strings->count && data[strings->offs+strings->count-1] )
+    return( 0 );
+  if( sections[INDEX_LINE_OFFS].count!=sections[INDEX_LINE_ROWS].count )
+    return( 0 );
+
+  uint64_t cuCount = sections[INDEX_CUS].count;
+  const index_cu *cus = (const index_cu*)( data+sections[INDEX_CUS].offs );
+  uint64_t i;
+  for( i=0; i<cuCount; i++ )
+  {
+    const index_cu *cu = &cus[i];
+    if( (uint64_t)cu->lineFirst+cu->lineCount>
+        sections[INDEX_LINE_OFFS].count ||
+        (uint64_t)cu->fileFirst+cu->fileCount>sections[INDEX_FILES].count ||
+        (uint64_t)cu->nodeFirst+cu->nodeCount>sections[INDEX_NODES].count ||
+        (uint64_t)cu->inlineFirst+cu->inlineCount>
+        sections[INDEX_INLINES].count )
+      return( 0 );
+  }
+
+  const index_range *ranges =
+    (const index_range*)( data+sections[INDEX_RANGES].offs );
+  for( i=0; i<sections[INDEX_RANGES].count; i++ )
+    if( ranges[i].cu>=cuCount ) return( 0 );
+
+  const uint32_t *unbound =
+    (const uint32_t*)( data+sections[INDEX_UNBOUND].offs );
+  for( i=0; i<sections[INDEX_UNBOUND].count; i++ )
+    if( unbound[i]>=cuCount ) return( 0 );
+
+  return( 1 );
+}
+
+// dwstStats only has uint64_t fields
+#define STATS_COUNT ( sizeof(dwstStats)/sizeof(uint64_t) )
+
+struct dwstImage
+{
+  char *name;
+  wchar_t *nameW;
+  Dwarf_Debug dbg;
+  Dwarf_Addr imageBase_dbg;
+  cu_info *cuArr;
+  int cuQty;
+  // sorted non-overlapping address ranges of all CUs
+  cu_range *rangeArr;
+  int rangeQty;
+  // CUs without any address range information
+  int *unboundArr;
+  int unboundQty;
+  // function names, valid until the image is closed
+  func_name_cache funcNameCache;
+  // serializes all libdwarf access, and building of the lazy tables
+  dwst_lock *lock;
+  // functions of .debug_gnu_pubnames or .debug_pubnames
+  name_index pubnames;
+  int pubnamesRead;
+  // all functions with code, if not found in pubnames
+  name_index funcnames;
+  int funcnamesRead;
+  // mapped symbol index, used instead of the debug information
+  const unsigned char *index;
+  size_t indexSize;
+  // the debug information of a symbol index is only read on demand
+  int dbgRead;
+  // dwstStats of all lookups, added up after each call
+  atomic_ullong stats[STATS_COUNT];
+  // CUs with decoded tables, changed with the image lock
+  int *decodedArr;
+  int decodedQty,decodedAlloc;
+  // memory of the decoded tables, and its limit (0 means no limit)
+  atomic_size_t footprint;
+  atomic_size_t budget;
+  // all open images, for the budget of all handles together,
+  // changed with the global lock
+  dwstImage *prevImage,*nextImage;
+  int registered;
+  // call frame information of dwstUnwindImage(), read on first use
+  image_frames *frames;
+};
+
+// budget of all handles together, changed with the global lock
+static dwstImage *imageList;
+static atomic_size_t globalFootprint;
+static atomic_size_t globalBudget;
+// incremented on every use of a CU, for the least recently used order
+static atomic_ullong cuUseTick;
+
+// add the statistics of one call to the totals of the image,
+// concurrent lookups only share the fields they changed
+static void addStats( dwstImage *image,const dwstStats *stats )
+{
+  uint64_t values[STATS_COUNT];
+  memcpy( values,stats,sizeof(values) );
+
+  size_t i;
+  for( i=0; i<STATS_COUNT; i++ )
+  {
+    if( values[i] )
+      atomic_fetch_add_explicit( &image->stats[i],values[i],
+          memory_order_relaxed );
+  }
+}
+
+static int addCuRange( dwstImage *image,int *rangeAlloc,
+    Dwarf_Addr low,Dwarf_Addr high,int cu )
+{
+  if( low>=high ) return( 0 );
+
+  if( image->rangeQty>=*rangeAlloc )
+  {
+    int newAlloc = *rangeAlloc ? *rangeAlloc*2 : 256;
+    cu_range *newArr = realloc( image->rangeArr,newAlloc*sizeof(cu_range) );
+    if( !newArr ) return( 0 );
+    image->rangeArr = newArr;
+    *rangeAlloc = newAlloc;
+  }
+
+  cu_range *range = &image->rangeArr[image->rangeQty++];
+  range->low = low;
+  range->high = high;
+  range->cu = cu;
+
+  return( 1 );
+}
+
+static int cmpCuRange( const void *a,const void *b )
+{
+  const cu_range *ra = a;
+  const cu_range *rb = b;
+  if( ra->low!=rb->low ) return( ra->low<rb->low ? -1 : 1 );
+  return( ra->cu - rb->cu );
+}
+
+// sort CU ranges and make them non-overlapping,
+// in overlapping parts the earlier starting range wins
+static void sortCuRanges( dwstImage *image )
+{
+  cu_range *rangeArr = image->rangeArr;
+  int rangeQty = image->rangeQty;
+  if( !rangeQty ) return;
+
+  qsort( rangeArr,rangeQty,sizeof(cu_range),cmpCuRange );
+
+  int i;
+  int qty = 0;
+  Dwarf_Addr end = 0;
+  for( i=0; i<rangeQty; i++ )
+  {
+    cu_range range = rangeArr[i];
+    if( range.low<end ) range.low = end;
+    if( range.low>=range.high ) continue;
+
+    if( qty && rangeArr[qty-1].cu==range.cu &&
+        rangeArr[qty-1].high==range.low )
+      rangeArr[qty-1].high = range.high;
+    else
+      rangeArr[qty++] = range;
+    end = range.high;
+  }
+
+  cu_range *newArr = realloc( rangeArr,qty*sizeof(cu_range) );
+  if( newArr ) image->rangeArr = newArr;
+  image->rangeQty = qty;
+}
+
+// binary search the CU containing ptr,
+// starting at the range of the previous lookup (hint)
+static int findCu( dwstImage *image,Dwarf_Addr ptr,int *hint )
+{
+  cu_range *rangeArr = image->rangeArr;
+  int low = 0;
+  int high = image->rangeQty;
+  if( *hint<high && rangeArr[*hint].low<=ptr )
+  {
+    int step = 1;
+    low = *hint + 1;
+    while( low+step<=high && rangeArr[low+step-1].low<=ptr )
+    {
+      low += step;
+      step *= 2;
+    }
+    if( low+step<=high ) high = low + step - 1;
+  }
+  while( low<high )
+  {
+    int mid = low + (high-low)/2;
+    if( rangeArr[mid].low<=ptr )
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if( !low ) return( -1 );
+  *hint = low - 1;
+
+  if( ptr>=rangeArr[low-1].high ) return( -1 );
+
+  return( rangeArr[low-1].cu );
+}
+
+// address range of a CU listed in .debug_aranges
+typedef struct cu_arange
+{
+  Dwarf_Off cuHeader;
+  Dwarf_Addr low,high;
+} cu_arange;
+
+static int cmpCuArange( const void *a,const void *b )
+{
+  const cu_arange *ra = a;
+  const cu_arange *rb = b;
+  if( ra->cuHeader!=rb->cuHeader )
+    return( ra->cuHeader<rb->cuHeader ? -1 : 1 );
+  if( ra->low!=rb->low ) return( ra->low<rb->low ? -1 : 1 );
+  return( 0 );
+}
+
+// read .debug_aranges, sorted by the CU header offset
+static int readAranges( Dwarf_Debug dbg,cu_arange **arangeArr )
+{
+  *arangeArr = NULL;
+
+  Dwarf_Arange *aranges;
+  Dwarf_Signed arangeCount;
+  if( dwarf_get_aranges(dbg,&aranges,&arangeCount,NULL)!=DW_DLV_OK )
+    return( 0 );
+
+  cu_arange *arr = malloc( arangeCount*sizeof(cu_arange) );
+  int qty = 0;
+  Dwarf_Signed i;
+  for( i=0; i<arangeCount; i++ )
+  {
+    Dwarf_Addr start;
+    Dwarf_Unsigned length;
+    Dwarf_Off cuHeader;
+    if( arr &&
+        dwarf_get_arange_info_b(aranges[i],NULL,NULL,
+          &start,&length,NULL,NULL)==DW_DLV_OK &&
+        dwarf_get_arange_cu_header_offset(aranges[i],
+          &cuHeader,NULL)==DW_DLV_OK &&
+        length && start+length>start )
+    {
+      arr[qty].cuHeader = cuHeader;
+      arr[qty].low = start;
+      arr[qty].high = start + length;
+      qty++;
+    }
+
+    dwarf_dealloc( dbg,aranges[i],DW_DLA_ARANGE );
+  }
+  dwarf_dealloc( dbg,aranges,DW_DLA_LIST );
+
+  if( !qty )
+  {
+    free( arr );
+    return( 0 );
+  }
+
+  qsort( arr,qty,sizeof(cu_arange),cmpCuArange );
+
+  *arangeArr = arr;
+  return( qty );
+}
+
+// collect address ranges of the CU DIE
+static int readCuDieRanges( dwstImage *image,int *rangeAlloc,
+    Dwarf_Die die,int cu )
+{
+  Dwarf_Debug dbg = image->dbg;
+  cu_info *cuInfo = &image->cuArr[cu];
+  int rangeCountCu = 0;
+
+  cuInfo->low = 0;
+  cuInfo->high = 0;
+  int res = dwarf_lowhighpc( die,&cuInfo->low,&cuInfo->high );
+  cuInfo->base = cuInfo->low;
+  if( res==DW_DLV_OK && cuInfo->high )
+    return( addCuRange(image,rangeAlloc,cuInfo->low,cuInfo->high,cu) );
+
+  int hasLow = res==DW_DLV_OK && cuInfo->low;
+  if( !hasLow ) cuInfo->low = 0;
+  cuInfo->high = 0;
+  cuInfo->base = cuInfo->low;
+
+  Dwarf_Half version;
+  Dwarf_Signed rangeCount;
+  Dwarf_Ranges *ranges;
+  Dwarf_Rnglists_Head rnghlhead;
+  Dwarf_Unsigned rngEntriesCount;
+  if( dwarf_ranges(dbg,die,&version,&ranges,&rangeCount,
+        &rnghlhead,&rngEntriesCount)!=DW_DLV_OK )
+    return( 0 );
+
+  if( version<=4 )
+  {
+    int i;
+    Dwarf_Addr base = cuInfo->low;
+    for( i=0; i<rangeCount; i++ )
+    {
+      Dwarf_Ranges *range = ranges + i;
+      if( range->dwr_type==DW_RANGES_END ) continue;
+
+      Dwarf_Addr low = range->dwr_addr1;
+      Dwarf_Addr high = range->dwr_addr2;
+
+      if( range->dwr_type==DW_RANGES_ENTRY )
+      {
+        low += base;
+        high += base;
+      }
+      else
+      {
+        base = high;
+        continue;
+      }
+
+      if( !low ) continue;
+
+      if( !hasLow || low<cuInfo->low )
+      {
+        cuInfo->low = low;
+        hasLow = 1;
+      }
+      if( high>cuInfo->high )
+        cuInfo->high = high;
+
+      rangeCountCu += addCuRange( image,rangeAlloc,low,high,cu );
+    }
+
+    dwarf_dealloc_ranges( dbg,ranges,rangeCount );
+  }
+  else
+  {
+    unsigned i;
+    for( i=0; i<rngEntriesCount; i++ )
+    {
+      unsigned entrylen = 0;
+      unsigned code = 0;
+      Dwarf_Unsigned rawlowpc = 0;
+      Dwarf_Unsigned rawhighpc = 0;
+      Dwarf_Unsigned lowpc = 0;
+      Dwarf_Unsigned highpc = 0;
+      Dwarf_Bool debug_addr_unavailable = 0;
+      res = dwarf_get_rnglists_entry_fields_a( rnghlhead,i,
+          &entrylen,&code,&rawlowpc,&rawhighpc,
+          &debug_addr_unavailable,&lowpc,&highpc,NULL );
+      if( res!=DW_DLV_OK || code==DW_RLE_end_of_list )
+        break;
+      if( code==DW_RLE_base_addressx || code==DW_RLE_base_address ||
+          debug_addr_unavailable || !lowpc )
+        continue;
+
+      if( !hasLow || lowpc<cuInfo->low )
+      {
+        cuInfo->low = lowpc;
+        hasLow = 1;
+      }
+      if( highpc>cuInfo->high )
+        cuInfo->high = highpc;
+
+      rangeCountCu += addCuRange( image,rangeAlloc,lowpc,highpc,cu );
+    }
+
+    dwarf_dealloc_rnglists_head( rnghlhead );
+  }
+
+  return( rangeCountCu );
+}
+
+// collect address ranges of the CU listed in .debug_aranges
+static int readCuAranges( dwstImage *image,int *rangeAlloc,
+    Dwarf_Die die,int cu,const cu_arange *arangeArr,int arangeQty )
+{
+  cu_info *cuInfo = &image->cuArr[cu];
+  int rangeCountCu = 0;
+
+  // range lists of inlined subroutines still need the CU base address
+  if( dwarf_lowpc(die,&cuInfo->base,NULL)!=DW_DLV_OK )
+    cuInfo->base = 0;
+  cuInfo->low = 0;
+  cuInfo->high = 0;
+
+  int i;
+  for( i=0; i<arangeQty; i++ )
+  {
+    Dwarf_Addr low = arangeArr[i].low;
+    Dwarf_Addr high = arangeArr[i].high;
+
+    // ranges at address 0 belong to discarded code
+    if( !low ) continue;
+
+    if( !rangeCountCu || low<cuInfo->low )
+      cuInfo->low = low;
+    if( high>cuInfo->high )
+      cuInfo->high = high;
+
+    rangeCountCu += addCuRange( image,rangeAlloc,low,high,cu );
+  }
+
+  return( rangeCountCu );
+}
+
+// collect address ranges of all CUs,
+// from .debug_aranges if possible, and from the CU DIEs otherwise
+static void readCuInfo( dwstImage *image )
+{
+  Dwarf_Debug dbg = image->dbg;
+  int rangeAlloc = 0;
+
+  cu_arange *arangeArr;
+  int arangeQty = readAranges( dbg,&arangeArr );
+  int a = 0;
+
+  Dwarf_Unsigned cuHeader = 0;
+  while( 1 )
+  {
+    Dwarf_Unsigned next_cu_header;
+    if( dwarf_next_cu_header_d(dbg,1,NULL,NULL,NULL,NULL,NULL,
+          NULL,NULL,NULL,&next_cu_header,NULL,NULL)!=DW_DLV_OK )
+      break;
+
+    Dwarf_Unsigned thisCuHeader = cuHeader;
+    cuHeader = next_cu_header;
+
+    Dwarf_Die die;
+    if( dwarf_siblingof_b(dbg,0,1,&die,NULL)!=DW_DLV_OK )
+      continue;
+
+    {
+      cu_info *newArr = realloc( image->cuArr,
+          (image->cuQty+1)*sizeof(cu_info) );
+      if( !newArr )
+      {
+        dwarf_dealloc( dbg,die,DW_DLA_DIE );
+        break;
+      }
+      image->cuQty++;
+      image->cuArr = newArr;
+    }
+
+    int cu = image->cuQty - 1;
+    cu_info *cuInfo = &image->cuArr[cu];
+
+    if( dwarf_dieoffset(die,&cuInfo->offs,NULL)!=DW_DLV_OK )
+      cuInfo->offs = 0;
+
+    // the aranges are sorted by CU, same as the CUs are read
+    while( a<arangeQty && arangeArr[a].cuHeader<thisCuHeader )
+      a++;
+    int arangeFirst = a;
+    while( a<arangeQty && arangeArr[a].cuHeader==thisCuHeader )
+      a++;
+
+    int rangeCountCu = 0;
+    if( a>arangeFirst )
+      rangeCountCu = readCuAranges( image,&rangeAlloc,die,cu,
+          arangeArr+arangeFirst,a-arangeFirst );
+    if( !rangeCountCu )
+      rangeCountCu = readCuDieRanges( image,&rangeAlloc,die,cu );
+
+    // without ranges the CU is checked for every address
+    if( !rangeCountCu && !cuInfo->high && cuInfo->offs )
+    {
+      int *newArr = realloc( image->unboundArr,
+          (image->unboundQty+1)*sizeof(int) );
+      if( newArr )
+      {
+        image->unboundArr = newArr;
+        image->unboundArr[image->unboundQty++] = cu;
+      }
+    }
+
+    cuInfo->lines.count = 0;
+    cuInfo->lines.offs = NULL;
+    cuInfo->lines.rows = NULL;
+    cuInfo->linesRead = 0;
+    cuInfo->inlinesRead = 0;
+    cuInfo->fileno_offs = -1;
+    cuInfo->files = NULL;
+    cuInfo->fileCount = -1;
+    cuInfo->memSize = 0;
+    atomic_init( &cuInfo->ready,0 );
+    atomic_init( &cuInfo->users,0 );
+    atomic_init( &cuInfo->lastUse,0 );
+
+    dwarf_dealloc( dbg,die,DW_DLA_DIE );
+  }
+
+  free( arangeArr );
+
+  sortCuRanges( image );
+}
+
+// plain name of a function, without return type, scope and parameters
+static const char *funcBaseName( const char *name,size_t *len )
+{
+  const char *start = name;
+  const char *p = name;
+  int depth = 0;
+  while( *p )
+  {
+    if( !depth && p==start && !strncmp(p,"operator",8) &&
+        !((p[8]>='a' && p[8]<='z') || (p[8]>='A' && p[8]<='Z') ||
+          (p[8]>='0' && p[8]<='9') || p[8]=='_') )
+    {
+      // the symbols of operators are part of the name
+      p += 8;
+      if( p[0]=='(' && p[1]==')' )
+        p += 2;
+      else
+        while( *p && strchr("<>=!+-*/%^&|~[],",*p) ) p++;
+      continue;
+    }
+
+    if( *p=='<' )
+      depth++;
+    else if( *p=='>' )
+    {
+      if( depth ) depth--;
+    }
+    else if( depth )
+      ;
+    else if( !strncmp(p,"(anonymous namespace)",21) )
+      p += 20;
+    else if( *p=='(' )
+      break;
+    else if( *p==' ' )
+      start = p + 1;
+    else if( p[0]==':' && p[1]==':' )
+    {
+      p++;
+      start = p + 1;
+    }
+    p++;
+  }
+
+  *len = p - start;
+  return( start );
+}
+
+static int addName( name_index *index,const char *name,Dwarf_Off offs )
+{
+  if( !name || !name[0] ) return( 0 );
+
+  if( index->count>=index->alloc )
+  {
+    int newAlloc = index->alloc ? index->alloc*2 : 256;
+    name_entry *newArr = realloc( index->entries,
+        newAlloc*sizeof(name_entry) );
+    if( !newArr ) return( 0 );
+    index->entries = newArr;
+    index->alloc = newAlloc;
+  }
+
+  name_entry *entry = &index->entries[index->count];
+  entry->name = strdup( name );
+  if( !entry->name ) return( 0 );
+  entry->offs = offs;
+  index->count++;
+
+  return( 1 );
+}
+
+// hash the collected names by their plain name
+static void hashNames( name_index *index )
+{
+  if( !index->count ) return;
+
+  uint32_t bucketCount = 64;
+  while( bucketCount<(uint32_t)index->count ) bucketCount *= 2;
+  index->buckets = malloc( bucketCount*sizeof(int) );
+  if( !index->buckets ) return;
+  index->bucketMask = bucketCount - 1;
+
+  uint32_t b;
+  for( b=0; b<bucketCount; b++ )
+    index->buckets[b] = -1;
+
+  int i;
+  for( i=0; i<index->count; i++ )
+  {
+    name_entry *entry = &index->entries[i];
+    size_t len;
+    const char *base = funcBaseName( entry->name,&len );
+    entry->hash = hashString( base,len );
+    b = entry->hash & index->bucketMask;
+    entry->next = index->buckets[b];
+    index->buckets[b] = i;
+  }
+}
+
+static void freeNames( name_index *index )
+{
+  int i;
+  for( i=0; i<index->count; i++ )
+    free( index->entries[i].name );
+  free( index->entries );
+  free( index->buckets );
+}
+
+static const void *indexSection( const dwstImage *image,int section )
+{
+  const index_header *header = (const index_header*)image->index;
+  return( image->index + header->sections[section].offs );
+}
+
+// map the symbol index of the executable, if it matches it
+static int readIndex( dwstImage *image )
+{
+  uint32_t timestamp,sizeOfImage;
+  if( !dwst_pe_identity(image->nameW,&timestamp,&sizeOfImage) )
+    return( 0 );
+
+  wchar_t *indexW = indexName( image->nameW );
+  if( !indexW ) return( 0 );
+  size_t size = 0;
+  const unsigned char *data = dwst_map_file( indexW,&size );
+  free( indexW );
+  if( !data ) return( 0 );
+
+  if( !checkIndex(data,size,timestamp,sizeOfImage) )
+  {
+    dwst_unmap_file( data,size );
+    return( 0 );
+  }
+
+  image->index = data;
+  image->indexSize = size;
+
+  const index_header *header = (const index_header*)data;
+  const index_section *sections = header->sections;
+  int cuQty = (int)sections[INDEX_CUS].count;
+  int rangeQty = (int)sections[INDEX_RANGES].count;
+  int unboundQty = (int)sections[INDEX_UNBOUND].count;
+
+  image->cuArr = calloc( cuQty?cuQty:1,sizeof(cu_info) );
+  image->rangeArr = malloc( (rangeQty?rangeQty:1)*sizeof(cu_range) );
+  image->unboundArr = malloc( (unboundQty?unboundQty:1)*sizeof(int) );
+  if( !image->cuArr || !image->rangeArr || !image->unboundArr )
+  {
+    free( image->cuArr );
+    free( image->rangeArr );
+    free( image->unboundArr );
+    image->cuArr = NULL;
+    image->rangeArr = NULL;
+    image->unboundArr = NULL;
+    image->index = NULL;
+    dwst_unmap_file( data,size );
+    return( 0 );
+  }
+
+  image->imageBase_dbg = header->imageBase;
+
+  // the line tables are used in place, and never changed
+  const index_cu *cus = indexSection( image,INDEX_CUS );
+  uint32_t *lineOffs = (uint32_t*)indexSection( image,INDEX_LINE_OFFS );
+  line_row *lineRows = (line_row*)indexSection( image,INDEX_LINE_ROWS );
+  int cu;
+  for( cu=0; cu<cuQty; cu++ )
+  {
+    cu_info *cuInfo = &image->cuArr[cu];
+    cuInfo->offs = cus[cu].offs;
+    cuInfo->base = cus[cu].base;
+    cuInfo->low = cus[cu].low;
+    cuInfo->high = cus[cu].high;
+    cuInfo->lines.base = cus[cu].lineBase;
+    cuInfo->lines.offs = lineOffs + cus[cu].lineFirst;
+    cuInfo->lines.rows = lineRows + cus[cu].lineFirst;
+    cuInfo->lines.count = cus[cu].lineCount;
+    cuInfo->linesRead = 1;
+    cuInfo->fileno_offs = cus[cu].filenoOffs;
+    cuInfo->files = NULL;
+    cuInfo->fileCount = 0;
+    atomic_init( &cuInfo->ready,0 );
+    atomic_init( &cuInfo->users,0 );
+    atomic_init( &cuInfo->lastUse,0 );
+  }
+  image->cuQty = cuQty;
+
+  const index_range *ranges = indexSection( image,INDEX_RANGES );
+  int r;
+  for( r=0; r<rangeQty; r++ )
+  {
+    image->rangeArr[r].low = ranges[r].low;
+    image->rangeArr[r].high = ranges[r].high;
+    image->rangeArr[r].cu = ranges[r].cu;
+  }
+  image->rangeQty = rangeQty;
+
+  const uint32_t *unbound = indexSection( image,INDEX_UNBOUND );
+  for( r=0; r<unboundQty; r++ )
+    image->unboundArr[r] = unbound[r];
+  image->unboundQty = unboundQty;
+
+  return( 1 );
+}
+
+// source files and inline tree of a CU of the symbol index,
+// they refer to the strings of the mapping
+static void readIndexCu( dwstImage *image,int cu )
+{
+  const index_header *header = (const index_header*)image->index;
+  const index_cu *icu = (const index_cu*)indexSection( image,INDEX_CUS ) + cu;
+  const char *strings = indexSection( image,INDEX_STRINGS );
+  uint64_t stringSize = header->sections[INDEX_STRINGS].count;
+  cu_info *cuInfo = &image->cuArr[cu];
+
+  const uint32_t *fileOffs =
+    (const uint32_t*)indexSection( image,INDEX_FILES ) + icu->fileFirst;
+  char **files = icu->fileCount ?
+    malloc( icu->fileCount*sizeof(char*) ) : NULL;
+  uint32_t i;
+  for( i=0; files && i<icu->fileCount; i++ )
+  {
+    if( fileOffs[i]>=stringSize )
+    {
+      free( files );
+      files = NULL;
+      break;
+    }
+    files[i] = (char*)strings + fileOffs[i];
+  }
+  cuInfo->files = files;
+  cuInfo->fileCount = files ? icu->fileCount : 0;
+
+  const index_node *nodes =
+    (const index_node*)indexSection( image,INDEX_NODES ) + icu->nodeFirst;
+  const index_inline *ranges = (const index_inline*)indexSection(
+      image,INDEX_INLINES ) + icu->inlineFirst;
+  inline_tree *tree = &cuInfo->inlines;
+  memset( tree,0,sizeof(inline_tree) );
+  if( icu->nodeCount )
+    tree->nodes = malloc( icu->nodeCount*sizeof(inline_node) );
+  if( icu->inlineCount )
+    tree->ranges = malloc( icu->inlineCount*sizeof(inline_range) );
+  int ok = (tree->nodes || !icu->nodeCount) &&
+    (tree->ranges || !icu->inlineCount);
+
+  // parents and enclosing ranges always come first,
+  // which keeps the walks of dwstOfCu() and findInlined() finite
+  for( i=0; ok && i<icu->nodeCount; i++ )
+  {
+    const index_node *in = &nodes[i];
+    if( in->parent<-1 || in->parent>=(int32_t)i ||
+        (in->name!=INDEX_NO_STRING && in->name>=stringSize) )
+    {
+      ok = 0;
+      break;
+    }
+
+    inline_node *n = &tree->nodes[i];
+    n->offs = 0;
+    n->funcname = in->name!=INDEX_NO_STRING ? strings+in->name : NULL;
+    atomic_init( &n->nameRead,1 );
+    n->parent = in->parent;
+    n->depth = in->depth;
+    n->isInlined = in->isInlined;
+    n->callfile = in->callfile;
+    n->callline = in->callline;
+    n->callcolumn = in->callcolumn;
+  }
+  for( i=0; ok && i<icu->inlineCount; i++ )
+  {
+    const index_inline *ir = &ranges[i];
+    if( ir->node<0 || (uint32_t)ir->node>=icu->nodeCount ||
+        ir->up<-1 || ir->up>=(int32_t)i )
+    {
+      ok = 0;
+      break;
+    }
+
+    inline_range *range = &tree->ranges[i];
+    range->low = ir->low;
+    range->high = ir->high;
+    range->node = ir->node;
+    range->depth = ir->depth;
+    range->up = ir->up;
+  }
+
+  if( ok )
+  {
+    tree->nodeCount = tree->nodeAlloc = icu->nodeCount;
+    tree->rangeCount = tree->rangeAlloc = icu->inlineCount;
+  }
+  else
+  {
+    freeInlineTree( tree );
+    memset( tree,0,sizeof(inline_tree) );
+  }
+  cuInfo->inlinesRead = 1;
+}
+
+// memory of the decoded tables of the CU
+static size_t cuMemSize( const dwstImage *image,const cu_info *cuInfo )
+{
+  size_t size = 0;
+  if( cuInfo->inlinesRead )
+    size += cuInfo->inlines.nodeAlloc*sizeof(inline_node) +
+      cuInfo->inlines.rangeAlloc*sizeof(inline_range);
+  if( cuInfo->files )
+    size += cuInfo->fileCount*sizeof(char*);
+
+  // the line tables and file names of the symbol index are mapped
+  if( image->index ) return( size );
+
+  if( cuInfo->linesRead )
+    size += cuInfo->lines.count*(sizeof(uint32_t)+sizeof(line_row));
+  int i;
+  for( i=0; cuInfo->files && i<cuInfo->fileCount; i++ )
+    size += strlen( cuInfo->files[i] ) + 1;
+
+  return( size );
+}
+
+// free the decoded tables of the CU, they are read again on next use
+static void freeCuTables( dwstImage *image,cu_info *cuInfo )
+{
+  // the line tables of the symbol index are part of the mapping
+  if( !image->index && cuInfo->linesRead )
+  {
+    free( cuInfo->lines.offs );
+    free( cuInfo->lines.rows );
+    cuInfo->linesRead = 0;
+    cuInfo->fileno_offs = -1;
+  }
+
+  if( cuInfo->inlinesRead )
+  {
+    freeInlineTree( &cuInfo->inlines );
+    cuInfo->inlinesRead = 0;
+  }
+
+  // and so are its source files, only the array is allocated
+  if( cuInfo->files && image->index )
+    free( cuInfo->files );
+  else if( cuInfo->files )
+  {
+    char **files = cuInfo->files;
+    int fileCount = cuInfo->fileCount;
+    int fc;
+    for( fc=0; fc<fileCount; fc++ )
+      dwarf_dealloc( image->dbg,files[fc],DW_DLA_STRING );
+
+    dwarf_dealloc( image->dbg,files,DW_DLA_LIST );
+  }
+  cuInfo->files = NULL;
+  cuInfo->fileCount = image->index ? 0 : -1;
+}
+
+// account the tables of a newly decoded CU, needs the image lock
+static void addDecoded( dwstImage *image,int cu )
+{
+  cu_info *cuInfo = &image->cuArr[cu];
+  cuInfo->memSize = cuMemSize( image,cuInfo );
+
+  // without the entry the tables are just never evicted
+  if( image->decodedQty>=image->decodedAlloc )
+  {
+    int newAlloc = image->decodedAlloc ? image->decodedAlloc*2 : 64;
+    int *newArr = realloc( image->decodedArr,newAlloc*sizeof(int) );
+    if( !newArr ) return;
+    image->decodedArr = newArr;
+    image->decodedAlloc = newAlloc;
+  }
+  image->decodedArr[image->decodedQty++] = cu;
+
+  atomic_fetch_add( &image->footprint,cuInfo->memSize );
+  atomic_fetch_add( &globalFootprint,cuInfo->memSize );
+}
+
+// least recently used CU without running lookups, needs the image lock,
+// returns its position in decodedArr, or -1
+static int oldestDecoded( dwstImage *image,uint64_t *lastUse )
+{
+  int oldest = -1;
+  int d;
+  for( d=0; d<image->decodedQty; d++ )
+  {
+    cu_info *cuInfo = &image->cuArr[image->decodedArr[d]];
+    if( atomic_load_explicit(&cuInfo->users,memory_order_relaxed) )
+      continue;
+
+    uint64_t use = atomic_load_explicit( &cuInfo->lastUse,
+        memory_order_relaxed );
+    if( oldest<0 || use<*lastUse )
+    {
+      oldest = d;
+      *lastUse = use;
+    }
+  }
+
+  return( oldest );
+}
+
+// free the tables of the CU at position d of decodedArr,
+// unless a lookup started using them, needs the image lock
+static int evictCu( dwstImage *image,int d )
+{
+  int cu = image->decodedArr[d];
+  cu_info *cuInfo = &image->cuArr[cu];
+
+  // a lookup first increments users, and then checks ready,
+  // so either it sees ready cleared and waits for the lock,
+  // or its increment is seen here
+  atomic_store( &cuInfo->ready,0 );
+  if( atomic_load(&cuInfo->users) )
+  {
+    atomic_store( &cuInfo->ready,1 );
+    return( 0 );
+  }
+
+  freeCuTables( image,cuInfo );
+  image->decodedArr[d] = image->decodedArr[--image->decodedQty];
+
+  atomic_fetch_sub( &image->footprint,cuInfo->memSize );
+  atomic_fetch_sub( &globalFootprint,cuInfo->memSize );
+  cuInfo->memSize = 0;
+
+  return( 1 );
+}
+
+// evict tables until the image is within its budget, needs the image lock
+static void trimImage( dwstImage *image,dwstStats *stats )
+{
+  size_t budget = atomic_load( &image->budget );
+  while( budget && atomic_load(&image->footprint)>budget )
+  {
+    uint64_t lastUse;
+    int d = oldestDecoded( image,&lastUse );
+    if( d<0 || !evictCu(image,d) ) break;
+    stats->cuEvictions++;
+  }
+}
+
+// evict the least recently used tables of all images,
+// until they are together within the global budget,
+// must not be called with any image lock, they are taken after this one
+static void trimGlobal( dwstStats *stats )
+{
+  size_t budget = atomic_load( &globalBudget );
+  if( !budget || atomic_load(&globalFootprint)<=budget ) return;
+
+  dwst_lock *globalLock = dwst_global_lock();
+  if( !globalLock ) return;
+  dwst_lock_enter( globalLock );
+
+  while( atomic_load(&globalFootprint)>budget )
+  {
+    dwstImage *oldestImage = NULL;
+    uint64_t oldestUse = 0;
+    dwstImage *image;
+    for( image=imageList; image; image=image->nextImage )
+    {
+      dwst_lock_enter( image->lock );
+      uint64_t lastUse;
+      if( oldestDecoded(image,&lastUse)>=0 &&
+          (!oldestImage || lastUse<oldestUse) )
+      {
+        oldestImage = image;
+        oldestUse = lastUse;
+      }
+      dwst_lock_leave( image->lock );
+    }
+    if( !oldestImage ) break;
+
+    // the CU may have been used in between, then it's searched again
+    dwst_lock_enter( oldestImage->lock );
+    uint64_t lastUse;
+    int d = oldestDecoded( oldestImage,&lastUse );
+    int evicted = d>=0 && evictCu( oldestImage,d );
+    dwst_lock_leave( oldestImage->lock );
+    if( !evicted ) break;
+    stats->cuEvictions++;
+  }
+
+  dwst_lock_leave( globalLock );
+}
+
+// apply both budgets after a call released its CUs,
+// which were kept while they were pinned
+static void trimAfterCall( dwstImage *image,dwstStats *stats )
+{
+  size_t budget = atomic_load( &image->budget );
+  if( budget && atomic_load(&image->footprint)>budget )
+  {
+    dwst_lock_enter( image->lock );
+    trimImage( image,stats );
+    dwst_lock_leave( image->lock );
+  }
+
+  trimGlobal( stats );
+}
+
+static dwstImage *dwstOpenFileExt( const char *name,const wchar_t *nameW,
+    int useIndex )
+{
+  if( !nameW ) return( NULL );
+
+  dwstImage *image = calloc( 1,sizeof(dwstImage) );
+  if( !image ) return( NULL );
+
+  size_t lenW = wcslen( nameW ) + 1;
+  image->nameW = malloc( lenW*sizeof(wchar_t) );
+  if( name ) image->name = strdup( name );
+  if( !image->nameW || (name && !image->name) )
+  {
+    free( image->nameW );
+    free( image->name );
+    free( image );
+    return( NULL );
+  }
+  memcpy( image->nameW,nameW,lenW*sizeof(wchar_t) );
+
+  image->lock = dwst_lock_new();
+  if( !image->lock )
+  {
+    free( image->nameW );
+    free( image->name );
+    free( image );
+    return( NULL );
+  }
+
+  size_t i;
+  for( i=0; i<STATS_COUNT; i++ )
+    atomic_init( &image->stats[i],0 );
+  atomic_init( &image->footprint,0 );
+  atomic_init( &image->budget,0 );
+
+  dwstStats stats;
+  memset( &stats,0,sizeof(dwstStats) );
+  uint64_t start = dwst_time_ns();
+
+  // a matching symbol index avoids parsing the debug information,
+  // and without either the handle stays valid,
+  // and every lookup reports DWST_NO_DBG_SYM
+  if( !useIndex || !readIndex(image) )
+  {
+    if( dwarf_pe_init(nameW,&image->imageBase_dbg,0,0,
+          &image->dbg,NULL)!=DW_DLV_OK )
+      image->dbg = NULL;
+    else
+    {
+      readCuInfo( image );
+      stats.bytesInflated = dwarf_pe_inflated( image->dbg );
+    }
+  }
+
+  stats.openTime = dwst_time_ns() - start;
+  addStats( image,&stats );
+
+  // the global budget may evict tables of any open image
+  dwst_lock *globalLock = dwst_global_lock();
+  if( globalLock )
+  {
+    dwst_lock_enter( globalLock );
+    image->nextImage = imageList;
+    if( imageList ) imageList->prevImage = image;
+    imageList = image;
+    image->registered = 1;
+    dwst_lock_leave( globalLock );
+  }
+
+  return( image );
+}
+
+dwstImage *dwstOpenFile( const char *name )
+{
+  wchar_t *nameW = dwst_ansi2wide( name );
+  dwstImage *image = dwstOpenFileExt( name,nameW,1 );
+  free( nameW );
+  return( image );
+}
+
+dwstImage *dwstOpenFileW( const wchar_t *name )
+{
+  return( dwstOpenFileExt(NULL,name,1) );
+}
+
+dwstImage *dwstOpenFileNoIndex( const char *name )
+{
+  wchar_t *nameW = dwst_ansi2wide( name );
+  dwstImage *image = dwstOpenFileExt( name,nameW,0 );
+  free( nameW );
+  return( image );
+}
+
+dwstImage *dwstOpenFileNoIndexW( const wchar_t *name )
+{
+  return( dwstOpenFileExt(NULL,name,0) );
+}
+
+void dwstCloseImage( dwstImage *image )
+{
+  if( !image ) return;
+
+  if( image->registered )
+  {
+    dwst_lock *globalLock = dwst_global_lock();
+    dwst_lock_enter( globalLock );
+    if( image->prevImage )
+      image->prevImage->nextImage = image->nextImage;
+    else
+      imageList = image->nextImage;
+    if( image->nextImage )
+      image->nextImage->prevImage = image->prevImage;
+    dwst_lock_leave( globalLock );
+  }
+  atomic_fetch_sub( &globalFootprint,atomic_load(&image->footprint) );
+
+  Dwarf_Debug dbg = image->dbg;
+  int j;
+  for( j=0; j<image->cuQty; j++ )
+    freeCuTables( image,&image->cuArr[j] );
+  free( image->cuArr );
+  free( image->decodedArr );
+  free( image->rangeArr );
+  free( image->unboundArr );
+  freeNames( &image->pubnames );
+  freeNames( &image->funcnames );
+  freeFuncNameCache( &image->funcNameCache );
+
+  if( dbg )
+  {
+    freeImageFrames( dbg,image->frames );
+    dwarf_pe_finish( dbg,NULL );
+  }
+  if( image->index )
+    dwst_unmap_file( image->index,image->indexSize );
+
+  dwst_lock_free( image->lock );
+
+  free( image->name );
+  free( image->nameW );
+  free( image );
+}
+
+// pin the CU, and read its line, file and inline tables if needed,
+// until releaseCu() they are only read, so lookups don't need the lock
+static void prepareCu( dwstImage *image,int cu,dwstStats *stats )
+{
+  cu_info *cuInfo = &image->cuArr[cu];
+
+  // the pin has to be visible before ready is checked, see evictCu()
+  atomic_fetch_add( &cuInfo->users,1 );
+  atomic_store_explicit( &cuInfo->lastUse,
+      atomic_fetch_add_explicit(&cuUseTick,1,memory_order_relaxed),
+      memory_order_relaxed );
+  if( atomic_load(&cuInfo->ready) )
+  {
+    stats->cuHits++;
+    return;
+  }
+
+  dwst_lock_enter( image->lock );
+
+  if( !atomic_load_explicit(&cuInfo->ready,memory_order_relaxed) )
+  {
+    stats->cuMisses++;
+
+    Dwarf_Debug dbg = image->dbg;
+    Dwarf_Die die;
+    if( image->index )
+      readIndexCu( image,cu );
+    else if( cuInfo->offs &&
+        dwarf_offdie_b(dbg,cuInfo->offs,1,&die,NULL)==DW_DLV_OK )
+    {
+      stats->offdieCalls++;
+      Dwarf_Unsigned inflated = dwarf_pe_inflated( dbg );
+
+      readCuFiles( die,cuInfo,stats );
+      if( !cuInfo->inlinesRead )
+      {
+        uint64_t start = dwst_time_ns();
+        readInlineTree( dbg,die,cuInfo->base,&cuInfo->inlines,stats );
+        cuInfo->inlinesRead = 1;
+        stats->inlineTime += dwst_time_ns() - start;
+      }
+
+      dwarf_dealloc( dbg,die,DW_DLA_DIE );
+
+      stats->bytesInflated += dwarf_pe_inflated( dbg ) - inflated;
+    }
+
+    addDecoded( image,cu );
+    atomic_store( &cuInfo->ready,1 );
+
+    trimImage( image,stats );
+  }
+  else
+    stats->cuHits++;
+
+  dwst_lock_leave( image->lock );
+}
+
+// unpin the CU, its tables may be evicted afterwards
+static void releaseCu( dwstImage *image,int cu )
+{
+  atomic_fetch_sub_explicit( &image->cuArr[cu].users,1,
+      memory_order_release );
+}
+
+// lazily read the function name of a node
+static const char *inlineName( dwstImage *image,inline_node *node,
+    dwstStats *stats )
+{
+  if( atomic_load_explicit(&node->nameRead,memory_order_acquire) )
+    return( node->funcname );
+
+  dwst_lock_enter( image->lock );
+
+  if( !atomic_load_explicit(&node->nameRead,memory_order_relaxed) )
+  {
+    if( node->offs )
+    {
+      uint64_t start = dwst_time_ns();
+      Dwarf_Unsigned inflated = dwarf_pe_inflated( image->dbg );
+      node->funcname = funcNameOfDie( image->dbg,&image->funcNameCache,
+          node->offs,0,stats );
+      stats->bytesInflated += dwarf_pe_inflated( image->dbg ) - inflated;
+      stats->nameTime += dwst_time_ns() - start;
+    }
+
+    atomic_store_explicit( &node->nameRead,1,memory_order_release );
+  }
+
+  dwst_lock_leave( image->lock );
+
+  return( node->funcname );
+}
+
+// CUs pinned by a batch lookup, its recorded source files are part
+// of their tables, so they are released after the replay
+typedef struct cu_pins
+{
+  int *arr;
+  int count,alloc;
+  int failed;
+} cu_pins;
+
+static int addPin( cu_pins *pins,int cu )
+{
+  if( pins->count>=pins->alloc )
+  {
+    int newAlloc = pins->alloc ? pins->alloc*2 : 64;
+    int *newArr = realloc( pins->arr,newAlloc*sizeof(int) );
+    if( !newArr )
+    {
+      pins->failed = 1;
+      return( 0 );
+    }
+    pins->arr = newArr;
+    pins->alloc = newAlloc;
+  }
+
+  pins->arr[pins->count++] = cu;
+  return( 1 );
+}
+
+// search hints of consecutive lookups, each lookup has its own,
+// the CU of the cursor stays pinned until it moves to another one
+typedef struct cu_cursor
+{
+  int cu;
+  int range;
+  int line;
+  cu_pins *pins;
+} cu_cursor;
+
+// unpin the CU of the cursor, unless the batch keeps it
+static void releaseCursor( dwstImage *image,cu_cursor *cursor )
+{
+  if( cursor->cu>=0 && !cursor->pins )
+    releaseCu( image,cursor->cu );
+  cursor->cu = -1;
+}
+
+// find source location of ptr in the specified CU
+static int dwstOfCu( dwstImage *image,cu_cursor *cursor,int cu,
+    uint64_t ptr,uint64_t ptrOrig,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  cu_info *cuInfo = &image->cuArr[cu];
+  int found_ptr = 0;
+
+  stats->cusExamined++;
+  if( cursor->cu!=cu )
+  {
+    // a failed batch is repeated without it
+    if( cursor->pins && !addPin(cursor->pins,cu) )
+      return( 0 );
+
+    releaseCursor( image,cursor );
+    prepareCu( image,cu,stats );
+    cursor->cu = cu;
+    cursor->line = 0;
+  }
+
+  Dwarf_Unsigned srcfileno = 0;
+  Dwarf_Unsigned lineno = 0;
+  Dwarf_Unsigned columnno = 0;
+  const line_row *row = findLine( &cuInfo->lines,ptr,&cursor->line );
+  if( row )
+  {
+    srcfileno = row->fileno;
+    lineno = row->lineno;
+    columnno = row->columnno;
+  }
+
+  char **files = cuInfo->files;
+  Dwarf_Signed fileCount = cuInfo->fileCount;
+
+  if( (int)srcfileno+cuInfo->fileno_offs>=0 && lineno && files )
+  {
+    found_ptr = 1;
+
+    if( (int)srcfileno+cuInfo->fileno_offs<fileCount )
+    {
+      inline_tree *tree = &cuInfo->inlines;
+      int found[MAX_INLINE_DEPTH];
+      int foundCount;
+      int node = findInlined( tree,ptr,found,&foundCount );
+
+      // report the innermost inlined subroutine first,
+      // and continue with the location it was called from
+      int fileno = (int)srcfileno + cuInfo->fileno_offs;
+      for( ; node>=0; node=tree->nodes[node].parent )
+      {
+        int f;
+        for( f=0; f<foundCount && found[f]!=node; f++ );
+        if( f>=foundCount ) continue;
+
+        inline_node *n = &tree->nodes[node];
+        if( !n->isInlined )
+        {
+          dwarf_callback( callbackFunc,callbackFuncW,
+              ptrOrig,files[fileno],NULL,
+              lineno,inlineName(image,n,stats),
+              callbackContext,columnno );
+          continue;
+        }
+
+        if( n->callfile<0 ||
+            n->callfile+cuInfo->fileno_offs<0 ||
+            n->callfile+cuInfo->fileno_offs>=fileCount )
+          continue;
+
+        dwarf_callback( callbackFunc,callbackFuncW,
+            ptrOrig,files[fileno],NULL,
+            lineno,inlineName(image,n,stats),
+            callbackContext,columnno );
+
+        fileno = n->callfile + cuInfo->fileno_offs;
+        lineno = n->callline;
+        columnno = n->callcolumn;
+        ptrOrig = 0;
+      }
+    }
+    else
+      dwarf_callback( callbackFunc,callbackFuncW,ptrOrig,
+          image->name,image->nameW,
+          DWST_NO_SRC_FILE,NULL,callbackContext,0 );
+  }
+
+  return( found_ptr );
+}
+
+// resolve ptr in its CU, or else in the CUs without ranges
+static void dwstOfAddr( dwstImage *image,
+    cu_cursor *cursor,cu_cursor *unboundCursor,
+    uint64_t ptr,uint64_t ptrOrig,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  int found_ptr = 0;
+  int cu = findCu( image,ptr,&cursor->range );
+  if( cu>=0 )
+    found_ptr = dwstOfCu( image,cursor,cu,ptr,ptrOrig,
+        callbackFunc,callbackFuncW,callbackContext,stats );
+
+  int j;
+  for( j=0; j<image->unboundQty && !found_ptr; j++ )
+    found_ptr = dwstOfCu( image,unboundCursor,image->unboundArr[j],
+        ptr,ptrOrig,callbackFunc,callbackFuncW,callbackContext,stats );
+
+  if( !found_ptr )
+    dwarf_callback( callbackFunc,callbackFuncW,ptrOrig,
+        image->name,image->nameW,
+        DWST_NOT_FOUND,NULL,callbackContext,0 );
+}
+
+
+// recorded callback of a batch lookup
+typedef struct frame_record
+{
+  uint64_t addr;
+  const char *filename;
+  const char *funcname;
+  int lineno;
+  int columnno;
+} frame_record;
+
+typedef struct frame_recorder
+{
+  frame_record *records;
+  int count,alloc;
+  int failed;
+} frame_recorder;
+
+static void recordFrame(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  frame_recorder *recorder = context;
+  if( recorder->failed ) return;
+
+  if( recorder->count>=recorder->alloc )
+  {
+    int newAlloc = recorder->alloc ? recorder->alloc*2 : 256;
+    frame_record *newArr = realloc( recorder->records,
+        newAlloc*sizeof(frame_record) );
+    if( !newArr )
+    {
+      recorder->failed = 1;
+      return;
+    }
+    recorder->records = newArr;
+    recorder->alloc = newAlloc;
+  }
+
+  frame_record *record = &recorder->records[recorder->count++];
+
+  // source file and function names stay valid as long as the image,
+  // the image name is given again on replay
+  record->addr = addr;
+  record->funcname = funcname;
+  record->filename = lineno>0 ? filename : NULL;
+  record->lineno = lineno;
+  record->columnno = columnno;
+}
+
+typedef struct batch_entry
+{
+  uint64_t ptr;
+  int idx;
+  int first,count;
+} batch_entry;
+
+static int cmpBatchEntry( const void *a,const void *b )
+{
+  const batch_entry *ea = a;
+  const batch_entry *eb = b;
+  if( ea->ptr!=eb->ptr ) return( ea->ptr<eb->ptr ? -1 : 1 );
+  return( ea->idx - eb->idx );
+}
+
+// minimum count of addresses for sorted batch lookups
+#define BATCH_MIN_COUNT 16
+
+// resolve the addresses in sorted order, so every CU and line table
+// is walked only once, and replay the results in the original order
+static int dwstOfBatch( dwstImage *image,uint64_t baseOffs,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  batch_entry *entries = malloc( count*sizeof(batch_entry) );
+  int *order = malloc( count*sizeof(int) );
+  if( !entries || !order )
+  {
+    free( entries );
+    free( order );
+    return( 0 );
+  }
+
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    entries[i].ptr = addr[i] + baseOffs;
+    entries[i].idx = i;
+  }
+  qsort( entries,count,sizeof(batch_entry),cmpBatchEntry );
+
+  frame_recorder recorder = { NULL,0,0,0 };
+  cu_pins pins = { NULL,0,0,0 };
+  cu_cursor cursor = { -1,0,0,&pins };
+  cu_cursor unboundCursor = { -1,0,0,&pins };
+  for( i=0; i<count && !recorder.failed && !pins.failed; i++ )
+  {
+    batch_entry *entry = &entries[i];
+    order[entry->idx] = i;
+
+    // repeated addresses share the result of the first one
+    if( i && entry->ptr==entries[i-1].ptr &&
+        addr[entry->idx]==addr[entries[i-1].idx] )
+    {
+      entry->first = entries[i-1].first;
+      entry->count = entries[i-1].count;
+      continue;
+    }
+
+    entry->first = recorder.count;
+    dwstOfAddr( image,&cursor,&unboundCursor,
+        entry->ptr,addr[entry->idx],recordFrame,NULL,&recorder,stats );
+    entry->count = recorder.count - entry->first;
+  }
+
+  int ret = 0;
+  if( !recorder.failed && !pins.failed )
+  {
+    for( i=0; i<count; i++ )
+    {
+      batch_entry *entry = &entries[order[i]];
+      int r;
+      for( r=0; r<entry->count; r++ )
+      {
+        frame_record *record = &recorder.records[entry->first+r];
+        if( record->filename )
+          dwarf_callback( callbackFunc,callbackFuncW,record->addr,
+              record->filename,NULL,record->lineno,record->funcname,
+              callbackContext,record->columnno );
+        else
+          dwarf_callback( callbackFunc,callbackFuncW,record->addr,
+              image->name,image->nameW,record->lineno,record->funcname,
+              callbackContext,record->columnno );
+      }
+    }
+    ret = count;
+  }
+
+  for( i=0; i<pins.count; i++ )
+    releaseCu( image,pins.arr[i] );
+
+  free( recorder.records );
+  free( entries );
+  free( order );
+  free( pins.arr );
+
+  return( ret );
+}
+
+static int dwstOfImageStats(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  const char *name = image->name;
+  const wchar_t *nameW = image->nameW;
+
+  if( imageBase )
+    dwarf_callback( callbackFunc,callbackFuncW,imageBase,name,nameW,
+        DWST_BASE_ADDR,NULL,callbackContext,0 );
+
+  if( !image->index && !image->dbg )
+  {
+    int i;
+    for( i=0; i<count; i++ )
+      dwarf_callback( callbackFunc,callbackFuncW,addr[i],name,nameW,
+          DWST_NO_DBG_SYM,NULL,callbackContext,0 );
+
+    return( count );
+  }
+
+  uint64_t baseOffs = 0;
+  if( imageBase )
+  {
+    if( image->imageBase_dbg )
+      baseOffs = image->imageBase_dbg - imageBase;
+  }
+
+  if( count>=BATCH_MIN_COUNT &&
+      dwstOfBatch(image,baseOffs,addr,count,
+        callbackFunc,callbackFuncW,callbackContext,stats) )
+    return( count );
+
+  int i;
+  cu_cursor cursor = { -1,0,0,NULL };
+  cu_cursor unboundCursor = { -1,0,0,NULL };
+  for( i=0; i<count; i++ )
+    dwstOfAddr( image,&cursor,&unboundCursor,addr[i]+baseOffs,addr[i],
+        callbackFunc,callbackFuncW,callbackContext,stats );
+
+  releaseCursor( image,&cursor );
+  releaseCursor( image,&unboundCursor );
+
+  return( i );
+}
+
+// statistics of the last lookup of each thread
+static _Thread_local dwstStats lastStats;
+
+int dwstOfImageExt(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !image || !addr || !count || (!callbackFunc && !callbackFuncW) )
+    return( 0 );
+
+  // only the decoding of tables is timed, it's slow anyway
+  dwstStats stats;
+  memset( &stats,0,sizeof(dwstStats) );
+
+  int ret = dwstOfImageStats( image,imageBase,addr,count,
+      callbackFunc,callbackFuncW,callbackContext,&stats );
+
+  // the evicted tables of other images count for this call
+  trimAfterCall( image,&stats );
+
+  stats.calls = 1;
+  stats.addresses = count;
+  lastStats = stats;
+  addStats( image,&stats );
+
+  return( ret );
+}
+
+int dwstOfImage(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext )
+{
+  return( dwstOfImageExt(image,imageBase,addr,count,
+        callbackFunc,NULL,callbackContext) );
+}
+
+int dwstOfImageW(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallbackW *callbackFunc,void *callbackContext )
+{
+  return( dwstOfImageExt(image,imageBase,addr,count,
+        NULL,callbackFunc,callbackContext) );
+}
+
+void dwstLastStats( dwstStats *stats )
+{
+  if( stats ) *stats = lastStats;
+}
+
+int dwstImageStats( dwstImage *image,dwstStats *stats )
+{
+  if( !image || !stats ) return( 0 );
+
+  uint64_t values[STATS_COUNT];
+  size_t i;
+  for( i=0; i<STATS_COUNT; i++ )
+    values[i] = atomic_load_explicit( &image->stats[i],memory_order_relaxed );
+  memcpy( stats,values,sizeof(values) );
+
+  return( 1 );
+}
+
+void dwstSetCacheBudget( dwstImage *image,size_t budget )
+{
+  dwstStats stats;
+  memset( &stats,0,sizeof(dwstStats) );
+
+  if( image )
+  {
+    dwst_lock_enter( image->lock );
+    atomic_store( &image->budget,budget );
+    trimImage( image,&stats );
+    dwst_lock_leave( image->lock );
+
+    addStats( image,&stats );
+    return;
+  }
+
+  atomic_store( &globalBudget,budget );
+  trimGlobal( &stats );
+}
+
+size_t dwstCacheSize( dwstImage *image )
+{
+  if( image ) return( atomic_load(&image->footprint) );
+  return( atomic_load(&globalFootprint) );
+}
+
+// get plain name of specified DIE, or of the DIE it is linked to
+static char *dwarf_diename_linked( Dwarf_Debug dbg,Dwarf_Die die )
+{
+  char *name = NULL;
+  if( dwarf_diename(die,&name,NULL)==DW_DLV_OK )
+    return( name );
+
+  Dwarf_Die link;
+  if( dwarf_die_by_ref(dbg,die,DW_AT_abstract_origin,&link)==DW_DLV_OK ||
+      dwarf_die_by_ref(dbg,die,DW_AT_specification,&link)==DW_DLV_OK )
+  {
+    name = dwarf_diename_linked( dbg,link );
+
+    dwarf_dealloc( dbg,link,DW_DLA_DIE );
+  }
+
+  return( name );
+}
+
+// get unsigned value of specified attribute
+static int dwarf_attr_udata( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Half attr,Dwarf_Unsigned *value )
+{
+  Dwarf_Attribute udata_attr;
+  int res = dwarf_attr( die,attr,&udata_attr,NULL );
+  if( res!=DW_DLV_OK ) return( res );
+
+  res = dwarf_formudata( udata_attr,value,NULL );
+
+  dwarf_dealloc( dbg,udata_attr,DW_DLA_ATTR );
+
+  return( res );
+}
+
+// get declaration location of specified DIE, or of the DIE it is linked to
+static void dwarf_decl_linked( Dwarf_Debug dbg,Dwarf_Die die,
+    Dwarf_Unsigned *fileno,Dwarf_Unsigned *lineno )
+{
+  if( dwarf_attr_udata(dbg,die,DW_AT_decl_file,fileno)==DW_DLV_OK &&
+      dwarf_attr_udata(dbg,die,DW_AT_decl_line,lineno)==DW_DLV_OK )
+    return;
+
+  *fileno = 0;
+  *lineno = 0;
+
+  Dwarf_Die link;
+  if( dwarf_die_by_ref(dbg,die,DW_AT_abstract_origin,&link)==DW_DLV_OK ||
+      dwarf_die_by_ref(dbg,die,DW_AT_specification,&link)==DW_DLV_OK )
+  {
+    dwarf_decl_linked( dbg,link,fileno,lineno );
+
+    dwarf_dealloc( dbg,link,DW_DLA_DIE );
+  }
+}
+
+// read the functions of .debug_gnu_pubnames, or else of .debug_pubnames
+static void readPubnames( dwstImage *image )
+{
+  Dwarf_Debug dbg = image->dbg;
+  name_index *index = &image->pubnames;
+
+  Dwarf_Gnu_Index_Head head;
+  Dwarf_Unsigned blockCount;
+  if( dwarf_get_gnu_index_head(dbg,1,&head,&blockCount,NULL)==DW_DLV_OK )
+  {
+    Dwarf_Unsigned b;
+    for( b=0; b<blockCount; b++ )
+    {
+      Dwarf_Unsigned cuHeader;
+      Dwarf_Unsigned entryCount;
+      if( dwarf_get_gnu_index_block(head,b,NULL,NULL,
+            &cuHeader,NULL,&entryCount,NULL)!=DW_DLV_OK )
+        continue;
+
+      Dwarf_Unsigned e;
+      for( e=0; e<entryCount; e++ )
+      {
+        Dwarf_Unsigned offs;
+        const char *name;
+        unsigned char kind;
+        if( dwarf_get_gnu_index_block_entry(head,b,e,
+              &offs,&name,NULL,NULL,&kind,NULL)==DW_DLV_OK &&
+            kind==DW_GNUIKIND_function )
+          addName( index,name,cuHeader+offs );
+      }
+    }
+
+    dwarf_gnu_index_dealloc( head );
+  }
+
+  Dwarf_Global *globals;
+  Dwarf_Signed globalCount;
+  if( !index->count &&
+      dwarf_get_globals(dbg,&globals,&globalCount,NULL)==DW_DLV_OK )
+  {
+    // .debug_pubnames also lists variables,
+    // they are skipped on lookup since they are no subprograms
+    Dwarf_Signed g;
+    for( g=0; g<globalCount; g++ )
+    {
+      char *name;
+      Dwarf_Off offs;
+      if( dwarf_globname(globals[g],&name,NULL)==DW_DLV_OK &&
+          dwarf_global_die_offset(globals[g],&offs,NULL)==DW_DLV_OK )
+        addName( index,name,offs );
+    }
+
+    dwarf_globals_dealloc( dbg,globals,globalCount );
   }
 
-  cu_info *cuArr = NULL;
-  int cuQty = 0;
+  hashNames( index );
+}
+
+// collect all subprograms with code of the child DIEs
+static void readFuncChildren( Dwarf_Debug dbg,Dwarf_Die die,
+    name_index *index )
+{
+  Dwarf_Die child;
+  if( dwarf_child(die,&child,NULL)!=DW_DLV_OK )
+    return;
+
   while( 1 )
   {
-    Dwarf_Unsigned next_cu_header;
-    if( dwarf_next_cu_header_d(dbg,1,NULL,NULL,NULL,NULL,NULL,
-          NULL,NULL,NULL,&next_cu_header,NULL,NULL)!=DW_DLV_OK )
-      break;
+    Dwarf_Half tag;
+    if( dwarf_tag(child,&tag,NULL)!=DW_DLV_OK )
+      tag = 0;
+
+    if( tag==DW_TAG_subprogram )
+    {
+      // functions at address 0 belong to discarded code,
+      // nested functions are not collected
+      Dwarf_Addr low;
+      Dwarf_Bool hasRanges = 0;
+      Dwarf_Off offs;
+      if( (dwarf_lowpc(child,&low,NULL)==DW_DLV_OK ? low!=0 :
+            dwarf_hasattr(child,DW_AT_ranges,&hasRanges,NULL)==DW_DLV_OK &&
+            hasRanges) &&
+          dwarf_dieoffset(child,&offs,NULL)==DW_DLV_OK )
+        addName( index,dwarf_diename_linked(dbg,child),offs );
+    }
+    else if( tag!=DW_TAG_inlined_subroutine )
+      readFuncChildren( dbg,child,index );
+
+    Dwarf_Die next_child;
+    int res = dwarf_siblingof_b( dbg,child,1,&next_child,NULL );
+
+    dwarf_dealloc( dbg,child,DW_DLA_DIE );
+
+    if( res!=DW_DLV_OK ) break;
+    child = next_child;
+  }
+}
 
+// collect the functions of all CUs
+static void readFuncNames( dwstImage *image )
+{
+  Dwarf_Debug dbg = image->dbg;
+  int cu;
+  for( cu=0; cu<image->cuQty; cu++ )
+  {
     Dwarf_Die die;
-    if( dwarf_siblingof_b(dbg,0,1,&die,NULL)!=DW_DLV_OK )
+    if( !image->cuArr[cu].offs ||
+        dwarf_offdie_b(dbg,image->cuArr[cu].offs,1,&die,NULL)!=DW_DLV_OK )
       continue;
 
-    {
-      cu_info *newArr = realloc( cuArr,(cuQty+1)*sizeof(cu_info) );
-      if( !newArr )
-      {
-        dwarf_dealloc( dbg,die,DW_DLA_DIE );
-        break;
-      }
-      cuQty++;
-      cuArr = newArr;
-    }
+    readFuncChildren( dbg,die,&image->funcnames );
 
-    cu_info *cuInfo = &cuArr[cuQty-1];
+    dwarf_dealloc( dbg,die,DW_DLA_DIE );
+  }
 
-    if( dwarf_dieoffset(die,&cuInfo->offs,NULL)!=DW_DLV_OK )
-      cuInfo->offs = 0;
+  hashNames( &image->funcnames );
+}
 
-    cuInfo->ranges = NULL;
-    cuInfo->rangeCount = 0;
-
-    cuInfo->low = 0;
-    cuInfo->high = 0;
-    int res = dwarf_lowhighpc( die,&cuInfo->low,&cuInfo->high );
-    if( res!=DW_DLV_OK || !cuInfo->high )
-    {
-      int hasLow = res==DW_DLV_OK && cuInfo->low;
-      if( !hasLow ) cuInfo->low = 0;
-      cuInfo->high = 0;
-
-      Dwarf_Half version;
-      Dwarf_Signed rangeCount;
-      Dwarf_Ranges *ranges;
-      Dwarf_Rnglists_Head rnghlhead;
-      Dwarf_Unsigned rngEntriesCount;
-      if( dwarf_ranges(dbg,die,&version,&ranges,&rangeCount,
-            &rnghlhead,&rngEntriesCount)==DW_DLV_OK )
-      {
-        if( version<=4 )
-        {
-          int i;
-          Dwarf_Addr base = cuInfo->low;
-          cuInfo->ranges = malloc( rangeCount*sizeof(range_t) );
-          if( !cuInfo->ranges ) rangeCount = 0;
-          for( i=0; i<rangeCount; i++ )
-          {
-            Dwarf_Ranges *range = ranges + i;
-            if( range->dwr_type==DW_RANGES_END ) continue;
-
-            Dwarf_Addr low = range->dwr_addr1;
-            Dwarf_Addr high = range->dwr_addr2;
-
-            if( range->dwr_type==DW_RANGES_ENTRY )
-            {
-              low += base;
-              high += base;
-            }
-            else
-            {
-              base = high;
-              continue;
-            }
-
-            if( !low ) continue;
-
-            if( !hasLow || low<cuInfo->low )
-            {
-              cuInfo->low = low;
-              hasLow = 1;
-            }
-            if( high>cuInfo->high )
-              cuInfo->high = high;
-
-            cuInfo->ranges[cuInfo->rangeCount].low = low;
-            cuInfo->ranges[cuInfo->rangeCount].high = high;
-            cuInfo->rangeCount++;
-          }
-
-          dwarf_dealloc_ranges( dbg,ranges,rangeCount );
-        }
-        else
-        {
-          unsigned i;
-          cuInfo->ranges = malloc( rngEntriesCount*sizeof(range_t) );
-          if( !cuInfo->ranges ) rngEntriesCount = 0;
-          for( i=0; i<rngEntriesCount; i++ )
-          {
-            unsigned entrylen = 0;
-            unsigned code = 0;
-            Dwarf_Unsigned rawlowpc = 0;
-            Dwarf_Unsigned rawhighpc = 0;
-            Dwarf_Unsigned lowpc = 0;
-            Dwarf_Unsigned highpc = 0;
-            Dwarf_Bool debug_addr_unavailable = 0;
-            int res = dwarf_get_rnglists_entry_fields_a( rnghlhead,i,
-                &entrylen,&code,&rawlowpc,&rawhighpc,
-                &debug_addr_unavailable,&lowpc,&highpc,NULL );
-            if( res!=DW_DLV_OK || code==DW_RLE_end_of_list )
-            {
-              i = rngEntriesCount;
-              break;
-            }
-            if( code==DW_RLE_base_addressx || code==DW_RLE_base_address ||
-                debug_addr_unavailable || !lowpc )
-              continue;
-
-            if( !hasLow || lowpc<cuInfo->low )
-            {
-              cuInfo->low = lowpc;
-              hasLow = 1;
-            }
-            if( highpc>cuInfo->high )
-              cuInfo->high = highpc;
-
-            cuInfo->ranges[cuInfo->rangeCount].low = lowpc;
-            cuInfo->ranges[cuInfo->rangeCount].high = highpc;
-            cuInfo->rangeCount++;
-          }
-
-          dwarf_dealloc_rnglists_head( rnghlhead );
-        }
-      }
-    }
+// binary search the CU containing the DIE offset
+static int findCuOfDie( dwstImage *image,Dwarf_Off offs )
+{
+  int low = 0;
+  int high = image->cuQty;
+  while( low<high )
+  {
+    int mid = low + (high-low)/2;
+    if( image->cuArr[mid].offs<=offs )
+      low = mid + 1;
+    else
+      high = mid;
+  }
 
-    cuInfo->lines = NULL;
-    cuInfo->lineCount = -1;
-    cuInfo->lineContext = NULL;
-    cuInfo->fileno_offs = -1;
-    cuInfo->files = NULL;
-    cuInfo->fileCount = -1;
+  return( low - 1 );
+}
 
+static void func_callback(
+    dwstFuncCallback *callbackFunc,dwstFuncCallbackW *callbackFuncW,
+    uint64_t low,uint64_t high,const char *filename,int lineno,
+    const char *funcname,void *context )
+{
+  if( callbackFunc )
+    callbackFunc( low,high,filename,lineno,funcname,context );
+  else
+  {
+    wchar_t *wide = dwst_ansi2wide( filename );
+    callbackFuncW( low,high,wide,lineno,funcname,context );
+    free( wide );
+  }
+}
+
+// report the address ranges of the subprogram at offs,
+// if either its name in the index or its reported name match funcname
+static int dwstAddrOfDie( dwstImage *image,uint64_t baseOffs,
+    const name_entry *entry,const char *funcname,
+    dwstFuncCallback *callbackFunc,dwstFuncCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  Dwarf_Debug dbg = image->dbg;
+  int cu = findCuOfDie( image,entry->offs );
+  if( cu<0 ) return( 0 );
+  cu_info *cuInfo = &image->cuArr[cu];
+
+  Dwarf_Die die;
+  Dwarf_Half tag;
+  if( dwarf_offdie_b(dbg,entry->offs,1,&die,NULL)!=DW_DLV_OK )
+    return( 0 );
+  if( dwarf_tag(die,&tag,NULL)!=DW_DLV_OK || tag!=DW_TAG_subprogram )
+  {
+    dwarf_dealloc( dbg,die,DW_DLA_DIE );
+    return( 0 );
+  }
+
+  const char *name = funcNameOfDie( dbg,&image->funcNameCache,
+      entry->offs,0,stats );
+  if( strcmp(funcname,entry->name) && (!name || strcmp(funcname,name)) )
+  {
     dwarf_dealloc( dbg,die,DW_DLA_DIE );
+    return( 0 );
+  }
+
+  inline_node node;
+  memset( &node,0,sizeof(inline_node) );
+  inline_tree tree = { &node,1,1,NULL,0,0 };
+  readInlineRanges( dbg,die,cuInfo->base,&tree,0 );
+
+  Dwarf_Unsigned fileno,lineno;
+  dwarf_decl_linked( dbg,die,&fileno,&lineno );
+
+  const char *filename = NULL;
+  int pinned = tree.rangeCount && lineno;
+  if( pinned )
+    prepareCu( image,cu,stats );
+  if( cuInfo->files &&
+      (int)fileno+cuInfo->fileno_offs>=0 &&
+      (int)fileno+cuInfo->fileno_offs<cuInfo->fileCount )
+    filename = cuInfo->files[(int)fileno+cuInfo->fileno_offs];
+  if( !filename || lineno>INT32_MAX ) lineno = 0;
+
+  int r;
+  for( r=0; r<tree.rangeCount; r++ )
+    func_callback( callbackFunc,callbackFuncW,
+        tree.ranges[r].low-baseOffs,tree.ranges[r].high-baseOffs,
+        filename,lineno,name?name:entry->name,callbackContext );
+
+  if( pinned )
+    releaseCu( image,cu );
+
+  free( tree.ranges );
+  dwarf_dealloc( dbg,die,DW_DLA_DIE );
+
+  return( tree.rangeCount );
+}
+
+static int dwstAddrOfIndex( dwstImage *image,uint64_t baseOffs,
+    const name_index *index,const char *funcname,
+    dwstFuncCallback *callbackFunc,dwstFuncCallbackW *callbackFuncW,
+    void *callbackContext,dwstStats *stats )
+{
+  if( !index->buckets ) return( 0 );
+
+  size_t len;
+  const char *base = funcBaseName( funcname,&len );
+  uint32_t hash = hashString( base,len );
+
+  int found = 0;
+  int i;
+  for( i=index->buckets[hash&index->bucketMask]; i>=0;
+      i=index->entries[i].next )
+  {
+    const name_entry *entry = &index->entries[i];
+    if( entry->hash!=hash ) continue;
+
+    size_t entryLen;
+    const char *entryBase = funcBaseName( entry->name,&entryLen );
+    if( entryLen!=len || memcmp(entryBase,base,len) ) continue;
+
+    found += dwstAddrOfDie( image,baseOffs,entry,funcname,
+        callbackFunc,callbackFuncW,callbackContext,stats );
+  }
+
+  return( found );
+}
+
+// open the debug information of a symbol index handle,
+// needs the image lock
+static void openIndexDbg( dwstImage *image )
+{
+  if( !image->index || image->dbgRead ) return;
+
+  Dwarf_Addr imageBase_dbg;
+  if( dwarf_pe_init(image->nameW,&imageBase_dbg,0,0,
+        &image->dbg,NULL)!=DW_DLV_OK )
+    image->dbg = NULL;
+  image->dbgRead = 1;
+}
+
+// enter the image lock for other uses of the debug information,
+// returns NULL (and leaves the lock) if there is none
+Dwarf_Debug enterImageDbg( dwstImage *image,
+    Dwarf_Addr *imageBase_dbg,image_frames ***frames )
+{
+  dwst_lock_enter( image->lock );
+
+  openIndexDbg( image );
+  if( !image->dbg )
+  {
+    dwst_lock_leave( image->lock );
+    return( NULL );
   }
 
+  *imageBase_dbg = image->imageBase_dbg;
+  *frames = &image->frames;
+  return( image->dbg );
+}
+
+void leaveImageDbg( dwstImage *image )
+{
+  dwst_lock_leave( image->lock );
+}
+
+int dwstAddrOfFuncExt(
+    dwstImage *image,uint64_t imageBase,const char *funcname,
+    dwstFuncCallback *callbackFunc,dwstFuncCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !image || (!image->index && !image->dbg) || !funcname ||
+      (!callbackFunc && !callbackFuncW) )
+    return( 0 );
+
   uint64_t baseOffs = 0;
   if( imageBase )
   {
-    if( imageBase_dbg )
-      baseOffs = imageBase_dbg - imageBase;
+    if( image->imageBase_dbg )
+      baseOffs = image->imageBase_dbg - imageBase;
   }
 
-  int i,j,k;
-  for( i=0; i<count; i++ )
+  dwst_lock_enter( image->lock );
+
+  // the functions are not part of the symbol index
+  openIndexDbg( image );
+  if( !image->dbg )
   {
-    uint64_t ptrOrig = addr[i];
-    uint64_t ptr = ptrOrig + baseOffs;
+    dwst_lock_leave( image->lock );
+    return( 0 );
+  }
 
-    int found_ptr = 0;
-    for( j=0; j<cuQty; j++ )
-    {
-      cu_info *cuInfo = &cuArr[j];
-      if( cuInfo->high && (ptr<cuInfo->low || ptr>=cuInfo->high) )
-        continue;
-      for( k=0; k<cuInfo->rangeCount; ++k )
-        if( ptr>=cuInfo->ranges[k].low && ptr<cuInfo->ranges[k].high )
-          break;
-      if( k && k>=cuInfo->rangeCount )
-        continue;
+  if( !image->pubnamesRead )
+  {
+    readPubnames( image );
+    image->pubnamesRead = 1;
+  }
 
-      Dwarf_Die die;
-      if( cuInfo->offs &&
-          dwarf_offdie_b(dbg,cuArr[j].offs,1,&die,NULL)==DW_DLV_OK )
-      {
-        Dwarf_Line *lines = cuInfo->lines;
-        Dwarf_Signed lineCount = cuInfo->lineCount;
-        if( lineCount<0 )
-        {
-          Dwarf_Unsigned lineVersion = 0;
-          Dwarf_Small tableCount = 0;
-          Dwarf_Line_Context lineContext = NULL;
-          if( dwarf_srclines_b(die,&lineVersion,
-                &tableCount,&lineContext,NULL)!=DW_DLV_OK ||
-              tableCount!=1 ||
-              dwarf_srclines_from_linecontext(lineContext,
-                &lines,&lineCount,NULL)!=DW_DLV_OK )
-          {
-            dwarf_srclines_dealloc_b( lineContext );
-            lines = NULL;
-            lineCount = 0;
-            lineContext = NULL;
-          }
-          cuInfo->lines = lines;
-          cuInfo->lineCount = lineCount;
-          cuInfo->lineContext = lineContext;
-          cuInfo->fileno_offs = lineVersion>=5 ? 0 : -1;
-        }
+  dwstStats stats;
+  memset( &stats,0,sizeof(dwstStats) );
+  int found = dwstAddrOfIndex( image,baseOffs,&image->pubnames,funcname,
+      callbackFunc,callbackFuncW,callbackContext,&stats );
 
-        Dwarf_Unsigned srcfileno = 0;
-        Dwarf_Unsigned lineno = 0;
-        Dwarf_Unsigned columnno = 0;
-        if( lines )
-        {
-          int c;
-          int onEnd = 1;
-          Dwarf_Addr prevAdd = 0;
-          for( c=0; c<lineCount; c++ )
-          {
-            Dwarf_Addr add;
-            if( dwarf_lineaddr(lines[c],&add,NULL)!=DW_DLV_OK )
-              break;
-
-            if( onEnd || add<=ptr || prevAdd>ptr )
-            {
-              Dwarf_Bool endsequ;
-              if( dwarf_lineendsequence(lines[c],&endsequ,NULL)!=DW_DLV_OK )
-                break;
-
-              onEnd = endsequ;
-              prevAdd = add;
-              continue;
-            }
-
-            dwarf_line_srcfileno( lines[c-1],&srcfileno,NULL );
-            dwarf_lineno( lines[c-1],&lineno,NULL );
-            dwarf_lineoff_b( lines[c-1],&columnno,NULL );
-            break;
-          }
-        }
+  // the accelerator tables may be missing, or lack static functions,
+  // so all functions are indexed once on the first miss
+  if( !found && !image->funcnamesRead )
+  {
+    readFuncNames( image );
+    image->funcnamesRead = 1;
+  }
 
-        char **files = cuInfo->files;
-        Dwarf_Signed fileCount = cuInfo->fileCount;
-        if( (int)srcfileno+cuInfo->fileno_offs>=0 && lineno && fileCount<0 )
-        {
-          if( dwarf_srcfiles(die,&files,&fileCount,NULL)!=DW_DLV_OK )
-          {
-            files = NULL;
-            fileCount = 0;
-          }
-          cuInfo->files = files;
-          cuInfo->fileCount = fileCount;
-        }
+  if( !found )
+    found = dwstAddrOfIndex( image,baseOffs,&image->funcnames,funcname,
+        callbackFunc,callbackFuncW,callbackContext,&stats );
 
-        if( (int)srcfileno+cuInfo->fileno_offs>=0 && lineno && files )
-        {
-          found_ptr = 1;
-
-          if( (int)srcfileno+cuInfo->fileno_offs<=fileCount )
-          {
-            inline_info ii = { ptr,cuInfo->low,
-              files,fileCount,callbackFunc,callbackFuncW,callbackContext,
-              ptrOrig,(int)srcfileno+cuInfo->fileno_offs,lineno,columnno,
-              cuInfo->fileno_offs };
-            walkChildren( dbg,die,(ChildWalker*)findInlined,&ii );
-          }
-          else
-            dwarf_callback( callbackFunc,callbackFuncW,ptrOrig,name,nameW,
-                DWST_NO_SRC_FILE,NULL,callbackContext,0 );
-        }
+  dwst_lock_leave( image->lock );
 
-        dwarf_dealloc( dbg,die,DW_DLA_DIE );
-      }
+  trimAfterCall( image,&stats );
+  addStats( image,&stats );
+
+  return( found );
+}
+
+int dwstAddrOfFunc(
+    dwstImage *image,uint64_t imageBase,const char *funcname,
+    dwstFuncCallback *callbackFunc,void *callbackContext )
+{
+  return( dwstAddrOfFuncExt(image,imageBase,funcname,
+        callbackFunc,NULL,callbackContext) );
+}
+
+int dwstAddrOfFuncW(
+    dwstImage *image,uint64_t imageBase,const char *funcname,
+    dwstFuncCallbackW *callbackFunc,void *callbackContext )
+{
+  return( dwstAddrOfFuncExt(image,imageBase,funcname,
+        NULL,callbackFunc,callbackContext) );
+}
+
+
+// strings of the symbol index, each one is stored once
+typedef struct index_strings
+{
+  char *data;
+  size_t size,alloc;
+  // string offset + 1, or 0 if empty
+  uint32_t *slots;
+  uint32_t mask;
+  uint32_t count;
+  int failed;
+} index_strings;
+
+static uint32_t indexString( index_strings *strs,const char *str )
+{
+  if( !str || strs->failed ) return( INDEX_NO_STRING );
+
+  // keep the load factor below 1/2
+  if( (strs->count+1)*2>strs->mask )
+  {
+    uint32_t newMask = strs->mask ? strs->mask*2+1 : 1023;
+    uint32_t *newArr = calloc( newMask+1,sizeof(uint32_t) );
+    if( !newArr )
+    {
+      strs->failed = 1;
+      return( INDEX_NO_STRING );
+    }
+
+    uint32_t i;
+    for( i=0; strs->slots && i<=strs->mask; i++ )
+    {
+      if( !strs->slots[i] ) continue;
+      const char *old = strs->data + strs->slots[i] - 1;
+      uint32_t h = hashString( old,strlen(old) ) & newMask;
+      while( newArr[h] ) h = (h+1) & newMask;
+      newArr[h] = strs->slots[i];
+    }
+    free( strs->slots );
+    strs->slots = newArr;
+    strs->mask = newMask;
+  }
+
+  size_t len = strlen( str );
+  uint32_t h = hashString( str,len ) & strs->mask;
+  while( strs->slots[h] )
+  {
+    if( !strcmp(strs->data+strs->slots[h]-1,str) )
+      return( strs->slots[h] - 1 );
+    h = (h+1) & strs->mask;
+  }
 
-      if( found_ptr ) break;
+  if( strs->size+len+1>=INDEX_NO_STRING )
+  {
+    strs->failed = 1;
+    return( INDEX_NO_STRING );
+  }
+  if( strs->size+len+1>strs->alloc )
+  {
+    size_t newAlloc = strs->alloc ? strs->alloc*2 : 65536;
+    while( newAlloc<strs->size+len+1 ) newAlloc *= 2;
+    char *newData = realloc( strs->data,newAlloc );
+    if( !newData )
+    {
+      strs->failed = 1;
+      return( INDEX_NO_STRING );
     }
+    strs->data = newData;
+    strs->alloc = newAlloc;
+  }
+
+  uint32_t offs = (uint32_t)strs->size;
+  memcpy( strs->data+offs,str,len+1 );
+  strs->size += len + 1;
+  strs->slots[h] = offs + 1;
+  strs->count++;
+
+  return( offs );
+}
+
+// write data at offs, the file is currently at *pos
+static int writeIndexAt( FILE *f,uint64_t *pos,uint64_t offs,
+    const void *data,size_t size )
+{
+  static const char zeros[8];
+  while( *pos<offs )
+  {
+    size_t pad = offs-*pos<8 ? (size_t)(offs-*pos) : 8;
+    if( fwrite(zeros,1,pad,f)!=pad ) return( 0 );
+    *pos += pad;
+  }
+
+  if( size && fwrite(data,1,size,f)!=size ) return( 0 );
+  *pos += size;
+
+  return( 1 );
+}
+
+// size of the debug information sections
+static uint64_t debugSize( dwstImage *image )
+{
+  dwst_lock_enter( image->lock );
+
+  openIndexDbg( image );
+
+  uint64_t size = 0;
+  int count = image->dbg ? dwarf_get_section_count( image->dbg ) : 0;
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    const char *name;
+    Dwarf_Addr addr;
+    Dwarf_Unsigned secSize;
+    if( dwarf_get_section_info_by_index(image->dbg,i,&name,&addr,
+          &secSize,NULL)!=DW_DLV_OK || !name )
+      continue;
 
-    if( !found_ptr )
-      dwarf_callback( callbackFunc,callbackFuncW,ptrOrig,name,nameW,
-          DWST_NOT_FOUND,NULL,callbackContext,0 );
+    if( !strncmp(name,".debug_",7) || !strncmp(name,".zdebug_",8) )
+      size += secSize;
   }
 
-  for( j=0; j<cuQty; j++ )
+  dwst_lock_leave( image->lock );
+
+  return( size );
+}
+
+// unpin all CUs pinned for writing the index
+static void releaseAllCus( dwstImage *image,dwstStats *stats )
+{
+  int cu;
+  for( cu=0; cu<image->cuQty; cu++ )
+    releaseCu( image,cu );
+
+  trimAfterCall( image,stats );
+  addStats( image,stats );
+}
+
+static int dwstWriteIndexExt( dwstImage *image,const wchar_t *nameW,
+    dwstIndexStats *stats )
+{
+  if( !image || (!image->index && !image->dbg) ) return( 0 );
+
+  // the tables of a mapped index may be in the file which is replaced,
+  // so the index is written from the debug information instead
+  if( image->index )
+  {
+    dwstImage *dbgImage = dwstOpenFileExt( NULL,image->nameW,0 );
+    int ok = dbgImage && dwstWriteIndexExt( dbgImage,nameW,stats );
+    dwstCloseImage( dbgImage );
+    return( ok );
+  }
+
+  index_header header;
+  memset( &header,0,sizeof(index_header) );
+  if( !dwst_pe_identity(image->nameW,&header.timestamp,&header.sizeOfImage) )
+    return( 0 );
+  memcpy( header.magic,INDEX_MAGIC,sizeof(header.magic) );
+  header.version = INDEX_VERSION;
+  header.imageBase = image->imageBase_dbg;
+
+  // read everything which is otherwise read on demand,
+  // all CUs stay pinned until the index is written
+  dwstStats readStats;
+  memset( &readStats,0,sizeof(dwstStats) );
+  uint64_t lineCount = 0;
+  uint64_t fileCount = 0;
+  uint64_t nodeCount = 0;
+  uint64_t inlineCount = 0;
+  int cu;
+  for( cu=0; cu<image->cuQty; cu++ )
+  {
+    cu_info *cuInfo = &image->cuArr[cu];
+    prepareCu( image,cu,&readStats );
+
+    int n;
+    for( n=0; n<cuInfo->inlines.nodeCount; n++ )
+      inlineName( image,&cuInfo->inlines.nodes[n],&readStats );
+
+    lineCount += cuInfo->lines.count;
+    if( cuInfo->fileCount>0 ) fileCount += cuInfo->fileCount;
+    nodeCount += cuInfo->inlines.nodeCount;
+    inlineCount += cuInfo->inlines.rangeCount;
+  }
+  if( lineCount>INT32_MAX || fileCount>INT32_MAX ||
+      nodeCount>INT32_MAX || inlineCount>INT32_MAX )
   {
-    if( cuArr[j].lines )
-      dwarf_srclines_dealloc_b( cuArr[j].lineContext );
+    releaseAllCus( image,&readStats );
+    return( 0 );
+  }
 
-    if( cuArr[j].files )
+  index_section *sections = header.sections;
+  sections[INDEX_RANGES].count = image->rangeQty;
+  sections[INDEX_UNBOUND].count = image->unboundQty;
+  sections[INDEX_CUS].count = image->cuQty;
+  sections[INDEX_LINE_OFFS].count = lineCount;
+  sections[INDEX_LINE_ROWS].count = lineCount;
+  sections[INDEX_FILES].count = fileCount;
+  sections[INDEX_NODES].count = nodeCount;
+  sections[INDEX_INLINES].count = inlineCount;
+
+  index_range *ranges = calloc( image->rangeQty+1,sizeof(index_range) );
+  uint32_t *unbound = calloc( image->unboundQty+1,sizeof(uint32_t) );
+  index_cu *cus = calloc( image->cuQty+1,sizeof(index_cu) );
+  uint32_t *files = calloc( fileCount+1,sizeof(uint32_t) );
+  index_node *nodes = calloc( nodeCount+1,sizeof(index_node) );
+  index_inline *inlines = calloc( inlineCount+1,sizeof(index_inline) );
+  index_strings strs;
+  memset( &strs,0,sizeof(index_strings) );
+  strs.failed = !ranges || !unbound || !cus || !files || !nodes || !inlines;
+
+  int i;
+  for( i=0; !strs.failed && i<image->rangeQty; i++ )
+  {
+    ranges[i].low = image->rangeArr[i].low;
+    ranges[i].high = image->rangeArr[i].high;
+    ranges[i].cu = image->rangeArr[i].cu;
+  }
+  for( i=0; !strs.failed && i<image->unboundQty; i++ )
+    unbound[i] = image->unboundArr[i];
+
+  uint32_t lineFirst = 0;
+  uint32_t fileFirst = 0;
+  uint32_t nodeFirst = 0;
+  uint32_t inlineFirst = 0;
+  for( cu=0; !strs.failed && cu<image->cuQty; cu++ )
+  {
+    cu_info *cuInfo = &image->cuArr[cu];
+    const inline_tree *tree = &cuInfo->inlines;
+    index_cu *icu = &cus[cu];
+    icu->offs = cuInfo->offs;
+    icu->base = cuInfo->base;
+    icu->low = cuInfo->low;
+    icu->high = cuInfo->high;
+    icu->lineBase = cuInfo->lines.base;
+    icu->lineFirst = lineFirst;
+    icu->lineCount = cuInfo->lines.count;
+    icu->fileFirst = fileFirst;
+    icu->fileCount = cuInfo->fileCount>0 ? (uint32_t)cuInfo->fileCount : 0;
+    icu->nodeFirst = nodeFirst;
+    icu->nodeCount = tree->nodeCount;
+    icu->inlineFirst = inlineFirst;
+    icu->inlineCount = tree->rangeCount;
+    icu->filenoOffs = cuInfo->fileno_offs;
+
+    for( i=0; i<(int)icu->fileCount; i++ )
+      files[fileFirst+i] = indexString( &strs,cuInfo->files[i] );
+
+    for( i=0; i<tree->nodeCount; i++ )
     {
-      char **files = cuArr[j].files;
-      int fileCount = cuArr[j].fileCount;
-      int fc;
-      for( fc=0; fc<fileCount; fc++ )
-        dwarf_dealloc( dbg,files[fc],DW_DLA_STRING );
+      const inline_node *n = &tree->nodes[i];
+      index_node *in = &nodes[nodeFirst+i];
+      in->name = indexString( &strs,n->funcname );
+      in->parent = n->parent;
+      in->depth = n->depth;
+      in->isInlined = n->isInlined;
+      in->callfile = n->callfile;
+      in->callline = n->callline;
+      in->callcolumn = n->callcolumn;
+    }
 
-      dwarf_dealloc( dbg,files,DW_DLA_LIST );
+    for( i=0; i<tree->rangeCount; i++ )
+    {
+      const inline_range *r = &tree->ranges[i];
+      index_inline *ir = &inlines[inlineFirst+i];
+      ir->low = r->low;
+      ir->high = r->high;
+      ir->node = r->node;
+      ir->depth = r->depth;
+      ir->up = r->up;
     }
 
-    free( cuArr[j].ranges );
+    lineFirst += icu->lineCount;
+    fileFirst += icu->fileCount;
+    nodeFirst += icu->nodeCount;
+    inlineFirst += icu->inlineCount;
   }
-  free( cuArr );
+  sections[INDEX_STRINGS].count = strs.size;
 
-  dwarf_pe_finish( dbg,NULL );
+  uint64_t offs = sizeof(index_header);
+  int s;
+  for( s=0; s<INDEX_SECTIONS; s++ )
+  {
+    offs = (offs+7) & ~(uint64_t)7;
+    sections[s].offs = offs;
+    offs += sections[s].count*indexEntrySize[s];
+  }
 
-  return( i );
+  // written to a temporary file first, which then replaces the old one,
+  // so readers of the old index never see a partial file
+  wchar_t *indexW = nameW ? NULL : indexName( image->nameW );
+  const wchar_t *targetW = nameW ? nameW : indexW;
+  wchar_t *tempW = targetW ?
+    malloc( (wcslen(targetW)+5)*sizeof(wchar_t) ) : NULL;
+  FILE *f = NULL;
+  if( tempW )
+  {
+    wcscpy( tempW,targetW );
+    wcscat( tempW,L".tmp" );
+    if( !strs.failed ) f = dwst_wfopen( tempW,L"wb" );
+  }
+
+  // the header is written last, so incomplete files are never valid
+  index_header empty;
+  memset( &empty,0,sizeof(index_header) );
+  uint64_t pos = 0;
+  int ok = f && writeIndexAt( f,&pos,0,&empty,sizeof(index_header) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_RANGES].offs,
+      ranges,image->rangeQty*sizeof(index_range) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_UNBOUND].offs,
+      unbound,image->unboundQty*sizeof(uint32_t) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_CUS].offs,
+      cus,image->cuQty*sizeof(index_cu) );
+  for( cu=0; ok && cu<image->cuQty; cu++ )
+    ok = writeIndexAt( f,&pos,cu?pos:sections[INDEX_LINE_OFFS].offs,
+        image->cuArr[cu].lines.offs,
+        image->cuArr[cu].lines.count*sizeof(uint32_t) );
+  for( cu=0; ok && cu<image->cuQty; cu++ )
+    ok = writeIndexAt( f,&pos,cu?pos:sections[INDEX_LINE_ROWS].offs,
+        image->cuArr[cu].lines.rows,
+        image->cuArr[cu].lines.count*sizeof(line_row) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_FILES].offs,
+      files,fileCount*sizeof(uint32_t) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_NODES].offs,
+      nodes,nodeCount*sizeof(index_node) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_INLINES].offs,
+      inlines,inlineCount*sizeof(index_inline) );
+  ok = ok && writeIndexAt( f,&pos,sections[INDEX_STRINGS].offs,
+      strs.data,strs.size );
+  ok = ok && !fseek( f,0,SEEK_SET ) &&
+    fwrite( &header,sizeof(index_header),1,f )==1;
+  if( f && fclose(f) ) ok = 0;
+  if( f && !(ok && dwst_wrename(tempW,targetW)) )
+  {
+    ok = 0;
+    dwst_wremove( tempW );
+  }
+  free( tempW );
+  free( indexW );
+
+  releaseAllCus( image,&readStats );
+
+  if( ok && stats )
+  {
+    stats->debugSize = debugSize( image );
+    stats->indexSize = offs;
+    stats->cuCount = image->cuQty;
+    stats->rangeCount = image->rangeQty;
+    stats->lineCount = (int)lineCount;
+    stats->fileCount = (int)fileCount;
+    stats->nodeCount = (int)nodeCount;
+    stats->inlineCount = (int)inlineCount;
+    stats->stringSize = strs.size;
+  }
+
+  free( ranges );
+  free( unbound );
+  free( cus );
+  free( files );
+  free( nodes );
+  free( inlines );
+  free( strs.data );
+  free( strs.slots );
+
+  return( ok );
+}
+
+int dwstWriteIndex(
+    dwstImage *image,const char *name,dwstIndexStats *stats )
+{
+  wchar_t *nameW = dwst_ansi2wide( name );
+  int ret = 0;
+  if( nameW || !name )
+    ret = dwstWriteIndexExt( image,nameW,stats );
+  free( nameW );
+  return( ret );
+}
+
+int dwstWriteIndexW(
+    dwstImage *image,const wchar_t *name,dwstIndexStats *stats )
+{
+  return( dwstWriteIndexExt(image,name,stats) );
+}
+
+
+int dwstOfFileExt(
+    const char *name,const wchar_t *nameW,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !nameW || !addr || !count || (!callbackFunc && !callbackFuncW) )
+    return( 0 );
+
+  dwstImage *image = dwstOpenFileExt( name,nameW,1 );
+  if( !image ) return( 0 );
+
+  int ret = dwstOfImageExt( image,imageBase,addr,count,
+      callbackFunc,callbackFuncW,callbackContext );
+
+  // the handle was only used for this call, so its totals include opening
+  dwstImageStats( image,&lastStats );
+
+  dwstCloseImage( image );
+
+  return( ret );
 }
 
 int dwstOfFile(
@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include "dwst_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+int dwstOfImageExt(
+    dwstImage *image,uint64_t imageBase,
+    uint64_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext );
+
+
+// lookup of the unique addresses of all samples
+typedef int fold_resolve(
+    void *resolveContext,uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext );
+
+// unique address, with the names of its (inlined) functions,
+// from the innermost one
+typedef struct fold_addr
+{
+  uint64_t addr;
+  int first,count;
+} fold_addr;
+
+typedef struct fold_name
+{
+  uint64_t hash;
+  size_t offs;
+} fold_name;
+
+// unique folded stack, with the names from the outermost one
+typedef struct fold_key
+{
+  uint64_t hash;
+  uint64_t weight;
+  int first,len;
+} fold_key;
+
+typedef struct fold_state
+{
+  fold_addr *addrs;
+  int addrQty,addrAlloc;
+  int *addrNames;
+  int addrNameQty,addrNameAlloc;
+
+  fold_name *names;
+  int nameQty,nameAlloc;
+  char *strings;
+  size_t stringSize,stringAlloc;
+
+  fold_key *keys;
+  int keyQty,keyAlloc;
+  int *keyNames;
+  int keyNameQty,keyNameAlloc;
+
+  // open addressing, with -1 as empty slot,
+  // the sizes are powers of 2, and at most half used
+  int *addrHash;
+  int addrHashSize;
+  int *nameHash;
+  int nameHashSize;
+  int *keyHash;
+  int keyHashSize;
+
+  // state of the resolving
+  int current;
+  int failed;
+} fold_state;
+
+// slot of the address in addrHash
+static int findAddr( fold_state *state,uint64_t addr )
+{
+  int mask = state->addrHashSize - 1;
+  int slot = (int)( dwst_hash_mix(0,addr)&mask );
+  int a;
+  while( (a=state->addrHash[slot])>=0 && state->addrs[a].addr!=addr )
+    slot = ( slot + 1 )&mask;
+  return( slot );
+}
+
+static int internAddr( fold_state *state,uint64_t addr )
+{
+  if( (state->addrQty+1)*2>state->addrHashSize )
+  {
+    // the addresses have no stored hash
+    int newSize = state->addrHashSize ? state->addrHashSize*2 : 256;
+    int *newArr = malloc( newSize*sizeof(int) );
+    if( !newArr ) return( 0 );
+
+    int i;
+    for( i=0; i<newSize; i++ ) newArr[i] = -1;
+    free( state->addrHash );
+    state->addrHash = newArr;
+    state->addrHashSize = newSize;
+    for( i=0; i<state->addrQty; i++ )
+      state->addrHash[findAddr(state,state->addrs[i].addr)] = i;
+  }
+
+  int slot = findAddr( state,addr );
+  if( state->addrHash[slot]>=0 ) return( 1 );
+
+  if( !dwst_grow_array((void**)&state->addrs,&state->addrAlloc,
+        state->addrQty+1,sizeof(fold_addr)) )
+    return( 0 );
+
+  fold_addr *entry = &state->addrs[state->addrQty];
+  entry->addr = addr;
+  entry->first = 0;
+  entry->count = 0;
+  state->addrHash[slot] = state->addrQty++;
+
+  return( 1 );
+}
+
+// ';' separates the frames of the folded stacks
+static char foldChar( char c )
+{
+  return( c==';' ? ':' : c );
+}
+
+static int sameName( const char *s,const char *str,size_t len )
+{
+  size_t i;
+  for( i=0; i<len && s[i]==foldChar(str[i]); i++ );
+  return( i==len && !s[len] );
+}
+
+// id of the name, added if it's new, or -1 on failure
+static int internName( fold_state *state,const char *str,size_t len )
+{
+  if( (state->nameQty+1)*2>state->nameHashSize &&
+      !dwst_grow_hash(&state->nameHash,&state->nameHashSize,
+        state->names,sizeof(fold_name),offsetof(fold_name,hash),
+        state->nameQty) )
+    return( -1 );
+
+  uint64_t hash = dwst_hash_bytes( str,len );
+  int mask = state->nameHashSize - 1;
+  int slot = (int)( hash&mask );
+  int n;
+  while( (n=state->nameHash[slot])>=0 )
+  {
+    const fold_name *name = &state->names[n];
+    const char *s = state->strings + name->offs;
+    if( name->hash==hash && sameName(s,str,len) )
+      return( n );
+    slot = ( slot + 1 )&mask;
+  }
+
+  if( !dwst_grow_array((void**)&state->names,&state->nameAlloc,
+        state->nameQty+1,sizeof(fold_name)) )
+    return( -1 );
+  if( state->stringSize+len+1>state->stringAlloc )
+  {
+    size_t newAlloc = state->stringAlloc ? state->stringAlloc*2 : 4096;
+    while( newAlloc<state->stringSize+len+1 ) newAlloc *= 2;
+    char *newStrings = realloc( state->strings,newAlloc );
+    if( !newStrings ) return( -1 );
+    state->strings = newStrings;
+    state->stringAlloc = newAlloc;
+  }
+
+  char *s = state->strings + state->stringSize;
+  size_t i;
+  for( i=0; i<len; i++ )
+    s[i] = foldChar( str[i] );
+  s[len] = 0;
+
+  n = state->nameQty++;
+  state->names[n].hash = hash;
+  state->names[n].offs = state->stringSize;
+  state->stringSize += len + 1;
+  state->nameHash[slot] = n;
+
+  return( n );
+}
+
+// the name of a frame without function name is its module,
+// which is known for frames without debug information
+static int frameName( fold_state *state,
+    const char *filename,int lineno,const char *funcname )
+{
+  if( funcname ) return( internName(state,funcname,strlen(funcname)) );
+
+  if( lineno>=0 || !filename )
+    return( internName(state,"[unknown]",9) );
+
+  const char *base = filename;
+  const char *ptr;
+  for( ptr=filename; *ptr; ptr++ )
+    if( *ptr=='/' || *ptr=='\\' ) base = ptr + 1;
+
+  size_t len = strlen( base );
+  char *bracketed = malloc( len+2 );
+  if( !bracketed ) return( -1 );
+  bracketed[0] = '[';
+  memcpy( bracketed+1,base,len );
+  bracketed[len+1] = ']';
+  int n = internName( state,bracketed,len+2 );
+  free( bracketed );
+  return( n );
+}
+
+static void recordFoldFrame(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  fold_state *state = context;
+  (void)columnno;
+  if( state->failed ) return;
+
+  // the first callback of each address has it,
+  // the inlined callers which follow have none
+  if( addr )
+  {
+    int a = state->addrHash[findAddr(state,addr)];
+    if( a>state->current )
+    {
+      state->current = a;
+      state->addrs[a].first = state->addrNameQty;
+    }
+    else if( lineno==DWST_BASE_ADDR && !funcname )
+      return;
+  }
+  if( state->current<0 ) return;
+
+  int n = frameName( state,filename,lineno,funcname );
+  if( n<0 ||
+      !dwst_grow_array((void**)&state->addrNames,&state->addrNameAlloc,
+        state->addrNameQty+1,sizeof(int)) )
+  {
+    state->failed = 1;
+    return;
+  }
+  state->addrNames[state->addrNameQty++] = n;
+  state->addrs[state->current].count++;
+}
+
+static int addKey( fold_state *state,const int *names,int len,
+    uint64_t weight )
+{
+  uint64_t hash = dwst_hash_mix( 0,len );
+  int i;
+  for( i=0; i<len; i++ )
+    hash = dwst_hash_mix( hash,names[i] );
+
+  if( (state->keyQty+1)*2>state->keyHashSize &&
+      !dwst_grow_hash(&state->keyHash,&state->keyHashSize,
+        state->keys,sizeof(fold_key),offsetof(fold_key,hash),
+        state->keyQty) )
+    return( 0 );
+
+  int mask = state->keyHashSize - 1;
+  int slot = (int)( hash&mask );
+  int k;
+  while( (k=state->keyHash[slot])>=0 )
+  {
+    fold_key *key = &state->keys[k];
+    if( key->hash==hash && key->len==len &&
+        !memcmp(state->keyNames+key->first,names,len*sizeof(int)) )
+    {
+      key->weight += weight;
+      return( 1 );
+    }
+    slot = ( slot + 1 )&mask;
+  }
+
+  if( !dwst_grow_array((void**)&state->keys,&state->keyAlloc,
+        state->keyQty+1,sizeof(fold_key)) ||
+      !dwst_grow_array((void**)&state->keyNames,&state->keyNameAlloc,
+        state->keyNameQty+len,sizeof(int)) )
+    return( 0 );
+
+  k = state->keyQty++;
+  fold_key *key = &state->keys[k];
+  key->hash = hash;
+  key->weight = weight;
+  key->first = state->keyNameQty;
+  key->len = len;
+  memcpy( state->keyNames+key->first,names,len*sizeof(int) );
+  state->keyNameQty += len;
+  state->keyHash[slot] = k;
+
+  return( 1 );
+}
+
+// fold the samples, from the outermost frame to the innermost one
+static int foldKeys( fold_state *state,
+    const dwstSample *samples,int count )
+{
+  int unknown = internName( state,"[unknown]",9 );
+  if( unknown<0 ) return( 0 );
+
+  int *names = NULL;
+  int nameAlloc = 0;
+  int s;
+  for( s=0; s<count; s++ )
+  {
+    const dwstSample *sample = &samples[s];
+    if( !sample->count ) continue;
+
+    int len = 0;
+    int i;
+    for( i=sample->count-1; i>=0; i-- )
+    {
+      const fold_addr *entry =
+        &state->addrs[state->addrHash[findAddr(state,sample->addr[i])]];
+      int c = entry->count ? entry->count : 1;
+      if( !dwst_grow_array((void**)&names,&nameAlloc,len+c,sizeof(int)) )
+      {
+        free( names );
+        return( 0 );
+      }
+
+      // frames of modules which can't be opened have no callbacks
+      if( !entry->count )
+        names[len++] = unknown;
+      for( c=entry->count-1; c>=0; c-- )
+        names[len++] = state->addrNames[entry->first+c];
+    }
+
+    if( !addKey(state,names,len,sample->weight) )
+    {
+      free( names );
+      return( 0 );
+    }
+  }
+  free( names );
+
+  return( 1 );
+}
+
+static int emitKeys( fold_state *state,
+    dwstFoldCallback *callbackFunc,void *callbackContext )
+{
+  char *line = NULL;
+  size_t lineAlloc = 0;
+  int k;
+  for( k=0; k<state->keyQty; k++ )
+  {
+    const fold_key *key = &state->keys[k];
+    const int *names = state->keyNames + key->first;
+    size_t size = 1;
+    int i;
+    for( i=0; i<key->len; i++ )
+      size += strlen( state->strings+state->names[names[i]].offs ) + 1;
+
+    if( size>lineAlloc )
+    {
+      size_t newAlloc = lineAlloc ? lineAlloc : 256;
+      while( newAlloc<size ) newAlloc *= 2;
+      char *newLine = realloc( line,newAlloc );
+      if( !newLine )
+      {
+        free( line );
+        return( k );
+      }
+      line = newLine;
+      lineAlloc = newAlloc;
+    }
+
+    size_t pos = 0;
+    for( i=0; i<key->len; i++ )
+    {
+      const char *name = state->strings + state->names[names[i]].offs;
+      size_t len = strlen( name );
+      if( i ) line[pos++] = ';';
+      memcpy( line+pos,name,len );
+      pos += len;
+    }
+    line[pos] = 0;
+
+    callbackFunc( line,key->weight,callbackContext );
+  }
+  free( line );
+
+  return( k );
+}
+
+static void freeState( fold_state *state )
+{
+  free( state->addrs );
+  free( state->addrNames );
+  free( state->names );
+  free( state->strings );
+  free( state->keys );
+  free( state->keyNames );
+  free( state->addrHash );
+  free( state->nameHash );
+  free( state->keyHash );
+}
+
+int foldSamples(
+    const dwstSample *samples,int count,
+    fold_resolve *resolveFunc,void *resolveContext,
+    dwstFoldCallback *callbackFunc,void *callbackContext )
+{
+  if( !samples || count<=0 || !callbackFunc ) return( 0 );
+
+  fold_state state;
+  memset( &state,0,sizeof(fold_state) );
+  state.current = -1;
+
+  int s;
+  for( s=0; s<count; s++ )
+  {
+    const dwstSample *sample = &samples[s];
+    if( sample->count<0 || (sample->count && !sample->addr) ) break;
+
+    int i;
+    for( i=0; i<sample->count && internAddr(&state,sample->addr[i]); i++ );
+    if( i<sample->count ) break;
+  }
+
+  // each address is looked up only once, for all samples together
+  uint64_t *addr = NULL;
+  if( s==count && state.addrQty )
+  {
+    addr = malloc( state.addrQty*sizeof(uint64_t) );
+    if( addr )
+    {
+      int a;
+      for( a=0; a<state.addrQty; a++ )
+        addr[a] = state.addrs[a].addr;
+      resolveFunc( resolveContext,addr,state.addrQty,
+          recordFoldFrame,&state );
+    }
+  }
+
+  int ret = 0;
+  if( s==count && (addr || !state.addrQty) && !state.failed &&
+      foldKeys(&state,samples,count) )
+    ret = emitKeys( &state,callbackFunc,callbackContext );
+
+  free( addr );
+  freeState( &state );
+
+  return( ret );
+}
+
+typedef struct image_resolve
+{
+  dwstImage *image;
+  uint64_t imageBase;
+} image_resolve;
+
+static int resolveImage(
+    void *resolveContext,uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext )
+{
+  image_resolve *resolve = resolveContext;
+  return( dwstOfImageExt(resolve->image,resolve->imageBase,addr,count,
+        callbackFunc,NULL,callbackContext) );
+}
+
+int dwstFoldImage(
+    dwstImage *image,uint64_t imageBase,
+    const dwstSample *samples,int count,
+    dwstFoldCallback *callbackFunc,void *callbackContext )
+{
+  if( !image ) return( 0 );
+
+  image_resolve resolve = { image,imageBase };
+  return( foldSamples(samples,count,resolveImage,&resolve,
+        callbackFunc,callbackContext) );
+}
@@ -19,6 +19,8 @@
 
 #include "dwarfstack.h"
 
+#include "dwarf_pe.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
@@ -37,21 +39,38 @@ int dwstOfProcessExt(
     dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
     void *callbackContext );
 
-static int dwstOfLocationExt(
-    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
-    void *callbackContext )
+void captureModules( dwstRawStack *stack );
+
+dwstRingRecord *ringReserve( dwstRing *ring );
+void ringCommit( dwstRingRecord *record );
+
+static CaptureStackBackTraceFunc *getCaptureStackBackTrace( void )
 {
-  uintptr_t frames[MAX_FRAMES];
+  static CaptureStackBackTraceFunc *volatile CaptureStackBackTrace;
+  static volatile LONG initialized;
+
+  // every thread finds the same function, so the race is harmless
+  if( !initialized )
+  {
+    HANDLE kernel32 = GetModuleHandle( "kernel32.dll" );
+    if( kernel32 )
+      CaptureStackBackTrace = (CaptureStackBackTraceFunc*)GetProcAddress(
+          kernel32,"RtlCaptureStackBackTrace" );
+    initialized = 1;
+  }
+  return( CaptureStackBackTrace );
+}
 
+// inlined, so the frame of the caller is the first one skipped
+static inline __attribute__((always_inline)) int captureLocation(
+    uintptr_t *frames,int size )
+{
   int count;
-  HANDLE kernel32 = GetModuleHandle( "kernel32.dll" );
-  CaptureStackBackTraceFunc *CaptureStackBackTrace = NULL;
-  if( kernel32 )
-    CaptureStackBackTrace = (CaptureStackBackTraceFunc*)GetProcAddress(
-        kernel32,"RtlCaptureStackBackTrace" );
+  CaptureStackBackTraceFunc *CaptureStackBackTrace =
+    getCaptureStackBackTrace();
   if( CaptureStackBackTrace )
   {
-    count = CaptureStackBackTrace( 1,MAX_FRAMES,(PVOID*)frames,NULL );
+    count = CaptureStackBackTrace( 1,size,(PVOID*)frames,NULL );
 
     int i;
     for( i=0; i<count; i++ )
@@ -63,13 +82,24 @@ static int dwstOfLocationExt(
 #ifdef NO_DBGHELP
     ULONG_PTR *sp = __builtin_frame_address( 0 );
 
-    count = captureStackTrace( sp,frames,MAX_FRAMES );
+    count = captureStackTrace( sp,frames,size );
 #else
     frames[0] = (uintptr_t)__builtin_return_address( 0 ) - 1;
     count = 1;
 #endif
   }
 
+  return( count );
+}
+
+static int dwstOfLocationExt(
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  uintptr_t frames[MAX_FRAMES];
+
+  int count = captureLocation( frames,MAX_FRAMES );
+
   return( dwstOfProcessExt(frames,count,
         callbackFunc,callbackFuncW,callbackContext) );
 }
@@ -84,3 +114,30 @@ int dwstOfLocationW(
 {
   return( dwstOfLocationExt(NULL,callbackFunc,callbackContext) );
 }
+
+int dwstCaptureLocation( dwstRawStack *stack )
+{
+  if( !stack ) return( 0 );
+
+  stack->count = captureLocation( stack->addr,DWST_MAX_FRAMES );
+  captureModules( stack );
+
+  return( stack->count );
+}
+
+int dwstRingCapture( dwstRing *ring )
+{
+  if( !ring ) return( 0 );
+
+  dwstRingRecord *record = ringReserve( ring );
+  if( !record ) return( 0 );
+
+  record->threadId = GetCurrentThreadId();
+  record->time = dwst_time_ns();
+  int count = captureLocation( record->stack.addr,DWST_MAX_FRAMES );
+  record->stack.count = count;
+  captureModules( &record->stack );
+  ringCommit( record );
+
+  return( count );
+}
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include <string.h>
+
+
+// unwinding with the x86-64 unwind codes of PE32+ images
+// (RUNTIME_FUNCTION entries of .pdata, UNWIND_INFO of .xdata)
+
+#define MACHINE_AMD64 0x8664
+#define PE32PLUS_MAGIC 0x20b
+#define DIRECTORY_EXCEPTION 3
+
+#define RUNTIME_FUNCTION_SIZE 12
+
+#define UNW_FLAG_CHAININFO 4
+
+#define UWOP_PUSH_NONVOL     0
+#define UWOP_ALLOC_LARGE     1
+#define UWOP_ALLOC_SMALL     2
+#define UWOP_SET_FPREG       3
+#define UWOP_SAVE_NONVOL     4
+#define UWOP_SAVE_NONVOL_FAR 5
+#define UWOP_EPILOG          6
+#define UWOP_SPARE_CODE      7
+#define UWOP_SAVE_XMM128     8
+#define UWOP_SAVE_XMM128_FAR 9
+#define UWOP_PUSH_MACHFRAME  10
+
+// chained unwind info is followed at most this often
+#define MAX_CHAIN 32
+
+// all unwind codes of the prolog were executed
+#define PROLOG_DONE 0xffffffff
+
+// DWARF register numbers of the registers in the unwind codes
+static const uint8_t dwarfRegs[16] = {
+  0,2,1,3,7,6,4,5,8,9,10,11,12,13,14,15 };
+#define REG_RSP 7
+
+typedef struct pdata_image
+{
+  uint64_t base;
+  dwstReadMemory *readFunc;
+  void *readContext;
+} pdata_image;
+
+typedef struct runtime_function
+{
+  uint32_t begin,end;
+  uint32_t unwindData;
+} runtime_function;
+
+
+static uint16_t getU16( const uint8_t *p )
+{
+  return( p[0] | p[1]<<8 );
+}
+
+static uint32_t getU32( const uint8_t *p )
+{
+  return( p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24 );
+}
+
+static int readImage( const pdata_image *image,uint32_t rva,
+    void *buffer,size_t size )
+{
+  return( image->readFunc(image->base+rva,buffer,size,
+        image->readContext) );
+}
+
+static int readStack( uint64_t addr,uint64_t *value,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  uint8_t bytes[8];
+  if( !readFunc(addr,bytes,8,readContext) ) return( 0 );
+  *value = getU32( bytes ) | (uint64_t)getU32( bytes+4 )<<32;
+  return( 1 );
+}
+
+// location of the RUNTIME_FUNCTION entries
+static int exceptionDirectory( const pdata_image *image,
+    uint32_t *dirRva,uint32_t *dirSize )
+{
+  uint8_t dos[64];
+  if( !readImage(image,0,dos,sizeof(dos)) ||
+      dos[0]!='M' || dos[1]!='Z' )
+    return( 0 );
+  uint32_t ntRva = getU32( dos+0x3c );
+
+  // signature, file header, and the optional header up to
+  // the exception directory
+  uint8_t nt[24+112+(DIRECTORY_EXCEPTION+1)*8];
+  if( !readImage(image,ntRva,nt,sizeof(nt)) ||
+      memcmp(nt,"PE\0\0",4) ||
+      getU16(nt+4)!=MACHINE_AMD64 ||
+      getU16(nt+20)<sizeof(nt)-24 ||
+      getU16(nt+24)!=PE32PLUS_MAGIC ||
+      getU32(nt+24+108)<=DIRECTORY_EXCEPTION )
+    return( 0 );
+
+  const uint8_t *dir = nt + 24 + 112 + DIRECTORY_EXCEPTION*8;
+  *dirRva = getU32( dir );
+  *dirSize = getU32( dir+4 );
+  return( *dirRva && *dirSize>=RUNTIME_FUNCTION_SIZE );
+}
+
+// binary search of the entries, which are sorted by address
+static int findFunction( const pdata_image *image,
+    uint32_t dirRva,uint32_t dirSize,uint32_t rva,runtime_function *func )
+{
+  uint32_t low = 0,high = dirSize/RUNTIME_FUNCTION_SIZE;
+  while( low<high )
+  {
+    uint32_t middle = low + ( high - low )/2;
+    uint8_t entry[RUNTIME_FUNCTION_SIZE];
+    if( !readImage(image,dirRva+middle*RUNTIME_FUNCTION_SIZE,
+          entry,sizeof(entry)) )
+      return( 0 );
+
+    uint32_t begin = getU32( entry );
+    uint32_t end = getU32( entry+4 );
+    if( rva<begin )
+      high = middle;
+    else if( rva>=end )
+      low = middle + 1;
+    else
+    {
+      func->begin = begin;
+      func->end = end;
+      func->unwindData = getU32( entry+8 );
+      return( 1 );
+    }
+  }
+  return( 0 );
+}
+
+// number of code slots of an unwind operation, or 0 if it's unknown
+static int opSlots( int op,int info )
+{
+  switch( op )
+  {
+    case UWOP_PUSH_NONVOL:
+    case UWOP_ALLOC_SMALL:
+    case UWOP_SET_FPREG:
+    case UWOP_PUSH_MACHFRAME:
+      return( 1 );
+    case UWOP_ALLOC_LARGE:
+      return( info ? 3 : 2 );
+    case UWOP_SAVE_NONVOL:
+    case UWOP_EPILOG:
+    case UWOP_SAVE_XMM128:
+      return( 2 );
+    case UWOP_SAVE_NONVOL_FAR:
+    case UWOP_SPARE_CODE:
+    case UWOP_SAVE_XMM128_FAR:
+      return( 3 );
+  }
+  return( 0 );
+}
+
+static int restoreReg( dwstUnwindRegs *regs,int reg,uint64_t addr,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  int r = dwarfRegs[reg];
+  if( !readStack(addr,&regs->reg[r],readFunc,readContext) ) return( 0 );
+  regs->valid |= 1U<<r;
+  return( 1 );
+}
+
+// revert the prolog with its unwind codes, the ones after offset
+// were not executed yet,
+// *machFrame is set if the return address was already restored
+static int applyCodes( const pdata_image *image,uint32_t unwindRva,
+    uint32_t offset,dwstUnwindRegs *regs,int *machFrame,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  int chain;
+  for( chain=0; chain<MAX_CHAIN; chain++ )
+  {
+    uint8_t header[4];
+    if( !readImage(image,unwindRva,header,sizeof(header)) ) return( 0 );
+    int version = header[0]&7;
+    int flags = header[0]>>3;
+    uint32_t prologSize = header[1];
+    int count = header[2];
+    int frameReg = header[3]&15;
+    uint64_t frameOffset = ( header[3]>>4 )*16;
+    if( version!=1 && version!=2 ) return( 0 );
+
+    // the slots are aligned to 4 bytes, then the chained entry follows
+    uint8_t codes[256*2+RUNTIME_FUNCTION_SIZE];
+    size_t codeSize = ( (count+1)&~1 )*2;
+    size_t size = codeSize +
+      ( flags&UNW_FLAG_CHAININFO ? RUNTIME_FUNCTION_SIZE : 0 );
+    if( size && !readImage(image,unwindRva+4,codes,size) ) return( 0 );
+
+    if( offset>=prologSize ) offset = PROLOG_DONE;
+
+    // the saved registers are relative to the frame register,
+    // once it's set
+    uint64_t frame = regs->reg[REG_RSP];
+    int i = 0;
+    while( frameReg && i<count )
+    {
+      int op = codes[i*2+1]&15;
+      int slots = opSlots( op,codes[i*2+1]>>4 );
+      if( !slots ) return( 0 );
+      if( op==UWOP_SET_FPREG && codes[i*2]<=offset )
+      {
+        int r = dwarfRegs[frameReg];
+        if( !(regs->valid&(1U<<r)) ) return( 0 );
+        frame = regs->reg[r] - frameOffset;
+        break;
+      }
+      i += slots;
+    }
+
+    for( i=0; i<count; )
+    {
+      int op = codes[i*2+1]&15;
+      int info = codes[i*2+1]>>4;
+      int slots = opSlots( op,info );
+      if( !slots || i+slots>count ) return( 0 );
+
+      if( codes[i*2]<=offset )
+      {
+        const uint8_t *arg = codes + ( i + 1 )*2;
+        uint64_t *rsp = &regs->reg[REG_RSP];
+        switch( op )
+        {
+          case UWOP_PUSH_NONVOL:
+            if( !restoreReg(regs,info,*rsp,readFunc,readContext) )
+              return( 0 );
+            *rsp += 8;
+            break;
+
+          case UWOP_ALLOC_LARGE:
+            *rsp += info ? getU32( arg ) : getU16( arg )*8U;
+            break;
+
+          case UWOP_ALLOC_SMALL:
+            *rsp += info*8 + 8;
+            break;
+
+          case UWOP_SET_FPREG:
+            *rsp = frame;
+            break;
+
+          case UWOP_SAVE_NONVOL:
+            if( !restoreReg(regs,info,frame+getU16(arg)*8U,
+                  readFunc,readContext) )
+              return( 0 );
+            break;
+
+          case UWOP_SAVE_NONVOL_FAR:
+            if( !restoreReg(regs,info,frame+getU32(arg),
+                  readFunc,readContext) )
+              return( 0 );
+            break;
+
+          case UWOP_PUSH_MACHFRAME:
+            // interrupt frame: optional error code, rip, cs, eflags, rsp
+            if( info ) *rsp += 8;
+            if( !readStack(*rsp,&regs->pc,readFunc,readContext) ||
+                !readStack(*rsp+24,rsp,readFunc,readContext) )
+              return( 0 );
+            *machFrame = 1;
+            break;
+
+          // the xmm registers are not tracked
+        }
+      }
+      i += slots;
+    }
+
+    if( !(flags&UNW_FLAG_CHAININFO) ) return( 1 );
+
+    // the codes of the chained entry were all executed
+    unwindRva = getU32( codes+codeSize+8 );
+    offset = PROLOG_DONE;
+  }
+
+  return( 0 );
+}
+
+// the interrupted frame may be inside an epilog, which only consists
+// of add rsp / lea rsp, pops, and ret, and is emulated then,
+// returns 1 if it was, 0 if it's no epilog, or -1 on failure
+static int unwindEpilog( const pdata_image *image,uint32_t rva,
+    uint32_t end,dwstUnwindRegs *regs,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  uint8_t code[32];
+  size_t size = end - rva;
+  if( size>sizeof(code) ) size = sizeof(code);
+  if( !size || !readImage(image,rva,code,size) ) return( 0 );
+
+  uint64_t rsp = regs->reg[REG_RSP];
+  size_t p = 0;
+  if( size>=4 && code[0]==0x48 && code[1]==0x83 && code[2]==0xc4 )
+  {
+    // add rsp,imm8
+    rsp += (int8_t)code[3];
+    p = 4;
+  }
+  else if( size>=7 && code[0]==0x48 && code[1]==0x81 && code[2]==0xc4 )
+  {
+    // add rsp,imm32
+    rsp += (int32_t)getU32( code+3 );
+    p = 7;
+  }
+  else if( size>=4 && (code[0]&0xfe)==0x48 && code[1]==0x8d &&
+      (code[2]&0x38)==0x20 && (code[2]&7)!=4 &&
+      ((code[2]>>6)==1 || (code[2]>>6)==2) )
+  {
+    // lea rsp,[reg+disp]
+    int r = dwarfRegs[( code[2]&7 ) | ( code[0]&1 )<<3];
+    if( !(regs->valid&(1U<<r)) ) return( 0 );
+    if( (code[2]>>6)==1 )
+    {
+      rsp = regs->reg[r] + (int8_t)code[3];
+      p = 4;
+    }
+    else if( size>=7 )
+    {
+      rsp = regs->reg[r] + (int32_t)getU32( code+3 );
+      p = 7;
+    }
+    else
+      return( 0 );
+  }
+
+  int pops[16];
+  int popCount = 0;
+  while( popCount<16 )
+  {
+    if( p<size && code[p]>=0x58 && code[p]<=0x5f )
+    {
+      pops[popCount++] = code[p] - 0x58;
+      p++;
+    }
+    else if( p+1<size && code[p]==0x41 &&
+        code[p+1]>=0x58 && code[p+1]<=0x5f )
+    {
+      pops[popCount++] = code[p+1] - 0x58 + 8;
+      p += 2;
+    }
+    else
+      break;
+  }
+
+  // ret, or rep ret
+  if( !(p<size && code[p]==0xc3) &&
+      !(p+1<size && code[p]==0xf3 && code[p+1]==0xc3) )
+    return( 0 );
+
+  dwstUnwindRegs caller = *regs;
+  int i;
+  for( i=0; i<popCount; i++ )
+  {
+    if( !restoreReg(&caller,pops[i],rsp,readFunc,readContext) )
+      return( -1 );
+    rsp += 8;
+  }
+  caller.reg[REG_RSP] = rsp;
+
+  *regs = caller;
+  return( 1 );
+}
+
+// returns 1 if unwound, 0 on failure, or -1 if the address has no
+// RUNTIME_FUNCTION entry (and leaf is not set)
+int unwindPdata( dwstUnwindRegs *regs,int caller,uint64_t imageBase,
+    dwstReadMemory *imageFunc,void *imageContext,
+    dwstReadMemory *readFunc,void *readContext,int leaf )
+{
+  pdata_image image;
+  image.base = imageBase;
+  image.readFunc = imageFunc;
+  image.readContext = imageContext;
+
+  uint32_t dirRva,dirSize;
+  if( !exceptionDirectory(&image,&dirRva,&dirSize) ) return( -1 );
+
+  // a return address can be the start of the next function
+  uint64_t pc = regs->pc;
+  if( caller ) pc--;
+  if( pc<imageBase || pc-imageBase>0xffffffff ) return( -1 );
+  uint32_t rva = (uint32_t)( pc - imageBase );
+  if( !(regs->valid&(1U<<REG_RSP)) ) return( 0 );
+
+  dwstUnwindRegs callerRegs = *regs;
+  int machFrame = 0;
+  runtime_function func;
+  if( !findFunction(&image,dirRva,dirSize,rva,&func) )
+  {
+    // only leaf functions have no entry,
+    // they don't change the stack pointer or other registers
+    if( !leaf ) return( -1 );
+  }
+  else
+  {
+    // the entry may refer to the one with the unwind info
+    if( func.unwindData&1 )
+    {
+      uint8_t entry[RUNTIME_FUNCTION_SIZE];
+      if( !readImage(&image,func.unwindData-1,entry,sizeof(entry)) )
+        return( 0 );
+      func.unwindData = getU32( entry+8 );
+    }
+
+    int epilog = 0;
+    if( !caller )
+    {
+      epilog = unwindEpilog( &image,rva,func.end,&callerRegs,
+          readFunc,readContext );
+      if( epilog<0 ) return( 0 );
+    }
+    if( !epilog &&
+        !applyCodes(&image,func.unwindData,rva-func.begin,&callerRegs,
+          &machFrame,readFunc,readContext) )
+      return( 0 );
+  }
+
+  uint64_t *rsp = &callerRegs.reg[REG_RSP];
+  if( !machFrame )
+  {
+    if( !readStack(*rsp,&callerRegs.pc,readFunc,readContext) )
+      return( 0 );
+    *rsp += 8;
+  }
+
+  // without a return address this is the outermost frame,
+  // and the stack has to grow, or it could unwind forever
+  if( !callerRegs.pc || *rsp<=regs->reg[REG_RSP] ) return( 0 );
+
+  *regs = callerRegs;
+  return( 1 );
+}
@@ -19,25 +19,322 @@
 
 #include "dwarfstack.h"
 
+#include "dwarf_pe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
 
-int dwstOfFileExt(
-    const char *name,const wchar_t *nameW,uint64_t imageBase,
+int dwstOfImageExt(
+    dwstImage *image,uint64_t imageBase,
     uint64_t *addr,int count,
     dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
     void *callbackContext );
 
-int dwstOfProcessExt(
+typedef int fold_resolve(
+    void *resolveContext,uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext );
+
+int foldSamples(
+    const dwstSample *samples,int count,
+    fold_resolve *resolveFunc,void *resolveContext,
+    dwstFoldCallback *callbackFunc,void *callbackContext );
+
+
+// opened handle of a loaded module
+typedef struct module_entry
+{
+  void *base;
+  uint32_t timestamp;
+  uint32_t sizeOfImage;
+  dwstImage *image;
+  // running lookups, the handle is closed after the last one
+  int users;
+  // the module was unloaded, or replaced by another one
+  int stale;
+} module_entry;
+
+// lookups between checks for unloaded modules
+#define MODULE_CHECK_INTERVAL 1024
+
+// handles of all modules, reused by every stack lookup,
+// changed with moduleLock
+static module_entry *moduleArr;
+static int moduleQty,moduleAlloc;
+static int lookupsUnchecked;
+static dwst_lock *volatile moduleLock;
+
+static dwst_lock *getModuleLock( void )
+{
+  if( !moduleLock )
+  {
+    // the loser of a race frees its own lock
+    dwst_lock *lock = dwst_lock_new();
+    if( lock && InterlockedCompareExchangePointer(
+          (PVOID volatile*)&moduleLock,lock,NULL) )
+      dwst_lock_free( lock );
+  }
+  return( moduleLock );
+}
+
+// TimeDateStamp and SizeOfImage of the loaded module,
+// they tell a different image at the same base apart
+static int moduleIdentity( void *base,
+    uint32_t *timestamp,uint32_t *sizeOfImage )
+{
+  const IMAGE_DOS_HEADER *dos = base;
+  if( dos->e_magic!=IMAGE_DOS_SIGNATURE ) return( 0 );
+
+  const IMAGE_NT_HEADERS *nt =
+    (const IMAGE_NT_HEADERS*)( (const char*)base + dos->e_lfanew );
+  if( nt->Signature!=IMAGE_NT_SIGNATURE ) return( 0 );
+
+  *timestamp = nt->FileHeader.TimeDateStamp;
+  *sizeOfImage = nt->OptionalHeader.SizeOfImage;
+  return( 1 );
+}
+
+typedef PVOID WINAPI PcToFileHeaderFunc( PVOID,PVOID* );
+
+static PcToFileHeaderFunc *getPcToFileHeader( void )
+{
+  static PcToFileHeaderFunc *volatile PcToFileHeader;
+  static volatile LONG initialized;
+
+  // every thread finds the same function, so the race is harmless
+  if( !initialized )
+  {
+    HMODULE ntdll = GetModuleHandle( "ntdll.dll" );
+    if( ntdll )
+      PcToFileHeader = (PcToFileHeaderFunc*)GetProcAddress(
+          ntdll,"RtlPcToFileHeader" );
+    initialized = 1;
+  }
+  return( PcToFileHeader );
+}
+
+// load address of the module of a code address, or NULL
+static void *moduleBase( uintptr_t ptr )
+{
+  PcToFileHeaderFunc *PcToFileHeader = getPcToFileHeader();
+  void *base = NULL;
+  if( PcToFileHeader )
+    return( PcToFileHeader((PVOID)ptr,&base) ? base : NULL );
+
+  // fallback for older systems
+  MEMORY_BASIC_INFORMATION mbi;
+  if( !VirtualQuery((void*)ptr,&mbi,sizeof(MEMORY_BASIC_INFORMATION)) ||
+      mbi.State!=MEM_COMMIT || mbi.Type!=MEM_IMAGE )
+    return( NULL );
+  return( mbi.AllocationBase );
+}
+
+// record the modules of the captured addresses,
+// the modules are loaded, since their code is on the stack
+void captureModules( dwstRawStack *stack )
+{
+  int moduleCount = 0;
+  int i,m;
+  for( i=0; i<stack->count; i++ )
+  {
+    uintptr_t ptr = stack->addr[i];
+
+    for( m=0; m<moduleCount && (ptr<stack->modules[m].base ||
+          ptr-stack->modules[m].base>=stack->modules[m].sizeOfImage); m++ );
+    if( m==moduleCount )
+    {
+      dwstModuleId *id = &stack->modules[m];
+      void *base = moduleBase( ptr );
+      if( !base || !moduleIdentity(base,&id->timestamp,&id->sizeOfImage) )
+      {
+        stack->module[i] = DWST_NO_MODULE;
+        continue;
+      }
+      id->base = (uintptr_t)base;
+      moduleCount++;
+    }
+
+    stack->module[i] = m;
+  }
+  stack->moduleCount = moduleCount;
+}
+
+// mark the handles of modules which are no longer loaded,
+// needs moduleLock
+static void checkModules( void )
+{
+  int m;
+  for( m=0; m<moduleQty; m++ )
+  {
+    module_entry *entry = &moduleArr[m];
+    if( entry->stale ) continue;
+
+    MEMORY_BASIC_INFORMATION mbi;
+    uint32_t timestamp,sizeOfImage;
+    if( !VirtualQuery(entry->base,&mbi,sizeof(MEMORY_BASIC_INFORMATION)) ||
+        mbi.State!=MEM_COMMIT || mbi.Type!=MEM_IMAGE ||
+        mbi.AllocationBase!=entry->base ||
+        !moduleIdentity(entry->base,&timestamp,&sizeOfImage) ||
+        timestamp!=entry->timestamp || sizeOfImage!=entry->sizeOfImage )
+      entry->stale = 1;
+  }
+  lookupsUnchecked = 0;
+}
+
+// remove a stale handle without running lookups, needs moduleLock,
+// returns the handle to close after releasing the lock, or NULL
+static dwstImage *takeStaleModule( void )
+{
+  int m;
+  for( m=0; m<moduleQty; m++ )
+  {
+    module_entry *entry = &moduleArr[m];
+    if( !entry->stale || entry->users ) continue;
+
+    dwstImage *image = entry->image;
+    *entry = moduleArr[--moduleQty];
+    return( image );
+  }
+
+  return( NULL );
+}
+
+static void closeStaleModules( dwst_lock *lock )
+{
+  while( 1 )
+  {
+    dwst_lock_enter( lock );
+    dwstImage *image = takeStaleModule();
+    dwst_lock_leave( lock );
+    if( !image ) break;
+
+    dwstCloseImage( image );
+  }
+}
+
+// find the cached handle of the module, needs moduleLock
+static module_entry *findModule( void *base,
+    uint32_t timestamp,uint32_t sizeOfImage )
+{
+  int m;
+  for( m=0; m<moduleQty; m++ )
+  {
+    module_entry *entry = &moduleArr[m];
+    if( entry->base!=base || entry->stale ) continue;
+
+    if( entry->timestamp==timestamp && entry->sizeOfImage==sizeOfImage )
+      return( entry );
+
+    // another image was loaded at the same base
+    entry->stale = 1;
+  }
+
+  return( NULL );
+}
+
+// get the handle of the loaded module, opening it on first use,
+// it stays valid until releaseModule()
+static dwstImage *acquireModule( void *base )
+{
+  dwst_lock *lock = getModuleLock();
+  uint32_t timestamp,sizeOfImage;
+  if( !lock || !moduleIdentity(base,&timestamp,&sizeOfImage) )
+    return( NULL );
+
+  dwst_lock_enter( lock );
+  module_entry *entry = findModule( base,timestamp,sizeOfImage );
+  dwstImage *image = NULL;
+  if( entry )
+  {
+    entry->users++;
+    image = entry->image;
+  }
+  int check = !entry || ++lookupsUnchecked>=MODULE_CHECK_INTERVAL;
+  if( check ) checkModules();
+  dwst_lock_leave( lock );
+
+  if( check ) closeStaleModules( lock );
+  if( image ) return( image );
+
+  // the module name needs the loader lock, so it's not read with moduleLock
+  wchar_t name[MAX_PATH];
+  if( !GetModuleFileNameW(base,name,MAX_PATH) )
+    return( NULL );
+  image = dwstOpenFileW( name );
+  if( !image ) return( NULL );
+
+  // another thread may have opened it in the meantime
+  dwstImage *unused = NULL;
+  dwst_lock_enter( lock );
+  entry = findModule( base,timestamp,sizeOfImage );
+  if( entry )
+  {
+    unused = image;
+    image = entry->image;
+    entry->users++;
+  }
+  else
+  {
+    if( moduleQty>=moduleAlloc )
+    {
+      int newAlloc = moduleAlloc ? moduleAlloc*2 : 16;
+      module_entry *newArr = realloc( moduleArr,
+          newAlloc*sizeof(module_entry) );
+      if( newArr )
+      {
+        moduleArr = newArr;
+        moduleAlloc = newAlloc;
+      }
+    }
+
+    // without a free entry the handle is only used for this lookup
+    if( moduleQty<moduleAlloc )
+    {
+      entry = &moduleArr[moduleQty++];
+      entry->base = base;
+      entry->timestamp = timestamp;
+      entry->sizeOfImage = sizeOfImage;
+      entry->image = image;
+      entry->users = 1;
+      entry->stale = 0;
+    }
+  }
+  dwst_lock_leave( lock );
+
+  if( unused ) dwstCloseImage( unused );
+  return( image );
+}
+
+static void releaseModule( dwstImage *image )
+{
+  dwst_lock *lock = moduleLock;
+
+  dwst_lock_enter( lock );
+  int m;
+  for( m=0; m<moduleQty && moduleArr[m].image!=image; m++ );
+  int cached = m<moduleQty;
+  int stale = cached && --moduleArr[m].users==0 && moduleArr[m].stale;
+  dwst_lock_leave( lock );
+
+  // the handle was not cached, or it became stale during the lookup
+  if( !cached )
+    dwstCloseImage( image );
+  else if( stale )
+    closeStaleModules( lock );
+}
+
+// resolve consecutive frames of the same module together,
+// used if the memory of the grouped lookup is not available
+static int dwstOfRuns(
     uintptr_t *addr,int count,
     dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
     void *callbackContext )
 {
-  if( !addr || !count || (!callbackFunc && !callbackFuncW) ) return( 0 );
-
   MEMORY_BASIC_INFORMATION mbi;
-  wchar_t name[MAX_PATH];
   int s;
   int converted = 0;
   for( s=0; s<count; s++ )
@@ -52,8 +349,6 @@ int dwstOfProcessExt(
       continue;
 
     void *base = mbi.AllocationBase;
-    if( !GetModuleFileNameW(base,name,MAX_PATH) )
-      continue;
 
     int c;
     for( c=1; s+c<count; c++ )
@@ -76,15 +371,429 @@ int dwstOfProcessExt(
     uint64_t *addrPos = addr + s;
 #endif
 
-    converted += dwstOfFileExt(
-        NULL,name,(uintptr_t)base,addrPos,c,
-        callbackFunc,callbackFuncW,callbackContext );
+    dwstImage *image = acquireModule( base );
+    if( image )
+    {
+      converted += dwstOfImageExt(
+          image,(uintptr_t)base,addrPos,c,
+          callbackFunc,callbackFuncW,callbackContext );
+      releaseModule( image );
+    }
     s += c - 1;
   }
 
   return( converted );
 }
 
+// recorded callback of a grouped lookup
+typedef struct stack_record
+{
+  uint64_t addr;
+  // offset of the copied source file in the strings
+  size_t filename;
+  // valid until the handle is released
+  const char *funcname;
+  int lineno;
+  int columnno;
+} stack_record;
+
+typedef struct stack_recorder
+{
+  stack_record *records;
+  int count,alloc;
+  char *strings;
+  size_t stringSize,stringAlloc;
+  int failed;
+} stack_recorder;
+
+// the source file is only valid during the callback, so it's copied
+static void addRecord( stack_recorder *recorder,
+    uint64_t addr,const void *filename,size_t filenameSize,int lineno,
+    const char *funcname,int columnno )
+{
+  if( recorder->failed ) return;
+
+  if( recorder->count>=recorder->alloc )
+  {
+    int newAlloc = recorder->alloc ? recorder->alloc*2 : 256;
+    stack_record *newArr = realloc( recorder->records,
+        newAlloc*sizeof(stack_record) );
+    if( !newArr )
+    {
+      recorder->failed = 1;
+      return;
+    }
+    recorder->records = newArr;
+    recorder->alloc = newAlloc;
+  }
+
+  // aligned for wide strings
+  size_t offs = ( recorder->stringSize + sizeof(wchar_t) - 1 ) &
+    ~( sizeof(wchar_t) - 1 );
+  if( offs+filenameSize>recorder->stringAlloc )
+  {
+    size_t newAlloc = recorder->stringAlloc ? recorder->stringAlloc*2 : 4096;
+    while( newAlloc<offs+filenameSize ) newAlloc *= 2;
+    char *newStrings = realloc( recorder->strings,newAlloc );
+    if( !newStrings )
+    {
+      recorder->failed = 1;
+      return;
+    }
+    recorder->strings = newStrings;
+    recorder->stringAlloc = newAlloc;
+  }
+  memcpy( recorder->strings+offs,filename,filenameSize );
+  recorder->stringSize = offs + filenameSize;
+
+  stack_record *record = &recorder->records[recorder->count++];
+  record->addr = addr;
+  record->filename = offs;
+  record->funcname = funcname;
+  record->lineno = lineno;
+  record->columnno = columnno;
+}
+
+static void recordStackFrame(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  if( !filename ) filename = "";
+  addRecord( context,addr,filename,strlen(filename)+1,lineno,
+      funcname,columnno );
+}
+
+static void recordStackFrameW(
+    uint64_t addr,const wchar_t *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  if( !filename ) filename = L"";
+  addRecord( context,addr,filename,(wcslen(filename)+1)*sizeof(wchar_t),
+      lineno,funcname,columnno );
+}
+
+static void replayRecord( const stack_recorder *recorder,int r,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  const stack_record *record = &recorder->records[r];
+  const char *filename = recorder->strings + record->filename;
+  if( callbackFunc )
+    callbackFunc( record->addr,filename,record->lineno,record->funcname,
+        callbackContext,record->columnno );
+  else
+    callbackFuncW( record->addr,(const wchar_t*)filename,record->lineno,
+        record->funcname,callbackContext,record->columnno );
+}
+
+// module of frames of a grouped lookup
+typedef struct stack_module
+{
+  void *base;
+  // last queried code region
+  uintptr_t regionStart,regionEnd;
+  dwstImage *image;
+  // the DWST_BASE_ADDR callback, or -1
+  int baseRecord;
+  // position of the frames in the frame order
+  int first,count;
+} stack_module;
+
+// frame of a grouped lookup
+typedef struct stack_frame
+{
+  // index of the module, or -1 if it's not in a loaded module
+  int module;
+  // recorded callbacks
+  int first,count;
+} stack_frame;
+
+// find the module of each frame, and order the frames by module,
+// returns the number of modules
+static int groupFrames( uintptr_t *addr,int count,
+    stack_frame *frames,stack_module *modules,int *order )
+{
+  int moduleCount = 0;
+  int s,m;
+
+  // frames in a known code region of a module need no VirtualQuery
+  MEMORY_BASIC_INFORMATION mbi;
+  for( s=0; s<count; s++ )
+  {
+    uintptr_t ptr = addr[s];
+    frames[s].count = 0;
+
+    for( m=0; m<moduleCount &&
+        (ptr<modules[m].regionStart || ptr>=modules[m].regionEnd); m++ );
+    if( m==moduleCount )
+    {
+      if( !VirtualQuery((void*)ptr,
+            &mbi,sizeof(MEMORY_BASIC_INFORMATION)) ||
+          mbi.State!=MEM_COMMIT ||
+          !(mbi.Protect&(PAGE_EXECUTE|PAGE_EXECUTE_READ)) ||
+          mbi.Type!=MEM_IMAGE )
+      {
+        frames[s].module = -1;
+        continue;
+      }
+
+      for( m=0; m<moduleCount && modules[m].base!=mbi.AllocationBase; m++ );
+      if( m==moduleCount )
+      {
+        modules[m].base = mbi.AllocationBase;
+        modules[m].image = NULL;
+        modules[m].baseRecord = -1;
+        modules[m].count = 0;
+        moduleCount++;
+      }
+      modules[m].regionStart = (uintptr_t)mbi.BaseAddress;
+      modules[m].regionEnd = modules[m].regionStart + mbi.RegionSize;
+    }
+
+    frames[s].module = m;
+    modules[m].count++;
+  }
+
+  int pos = 0;
+  for( m=0; m<moduleCount; m++ )
+  {
+    modules[m].first = pos;
+    pos += modules[m].count;
+    modules[m].count = 0;
+  }
+  for( s=0; s<count; s++ )
+  {
+    m = frames[s].module;
+    if( m<0 ) continue;
+
+    stack_module *module = &modules[m];
+    order[module->first+module->count++] = s;
+  }
+
+  return( moduleCount );
+}
+
+// look up all frames of the module, and record their callbacks,
+// returns 0 if the recording failed
+static int recordModule( stack_module *module,uintptr_t *addr,
+    stack_frame *frames,const int *frameIdx,uint64_t *addr64,
+    int wide,stack_recorder *recorder,int *converted )
+{
+  module->image = acquireModule( module->base );
+  if( !module->image ) return( 1 );
+
+  int i;
+  for( i=0; i<module->count; i++ )
+    addr64[i] = addr[frameIdx[i]];
+
+  int r = recorder->count;
+  *converted += dwstOfImageExt(
+      module->image,(uintptr_t)module->base,addr64,module->count,
+      wide?NULL:recordStackFrame,wide?recordStackFrameW:NULL,recorder );
+  if( recorder->failed ) return( 0 );
+
+  if( r<recorder->count && recorder->records[r].lineno==DWST_BASE_ADDR )
+    module->baseRecord = r++;
+
+  // the first callback of each frame has its address,
+  // the inlined callers which follow have none,
+  // and frames without a covering function have no callbacks
+  int current = -1;
+  for( ; r<recorder->count; r++ )
+  {
+    uint64_t frameAddr = recorder->records[r].addr;
+    if( frameAddr )
+    {
+      int c;
+      for( c=current+1; c<module->count && addr64[c]!=frameAddr; c++ );
+      if( c<module->count )
+      {
+        current = c;
+        frames[frameIdx[c]].first = r;
+      }
+    }
+    if( current>=0 ) frames[frameIdx[current]].count++;
+  }
+
+  return( 1 );
+}
+
+// resolve all frames of each module with a single lookup,
+// and replay the callbacks in the original order
+//   (a stack alternating between modules would otherwise
+//    look up each module once for every run of its frames)
+static int dwstOfGroups(
+    uintptr_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext,int *converted )
+{
+  stack_frame *frames = malloc( count*sizeof(stack_frame) );
+  stack_module *modules = malloc( count*sizeof(stack_module) );
+  int *order = malloc( count*sizeof(int) );
+  uint64_t *addr64 = malloc( count*sizeof(uint64_t) );
+  int ok = 0;
+
+  if( frames && modules && order && addr64 )
+  {
+    stack_recorder recorder = { NULL,0,0,NULL,0,0,0 };
+    int moduleCount = groupFrames( addr,count,frames,modules,order );
+    int m;
+
+    // the handles stay acquired until the replay,
+    // since the function names are part of them
+    ok = 1;
+    for( m=0; m<moduleCount && ok; m++ )
+      ok = recordModule( &modules[m],addr,frames,order+modules[m].first,
+          addr64,!callbackFunc,&recorder,converted );
+
+    // like a lookup of each run of frames of the same module
+    int s;
+    for( s=0; s<count && ok; s++ )
+    {
+      stack_frame *frame = &frames[s];
+      m = frame->module;
+      if( m<0 ) continue;
+
+      if( (!s || frames[s-1].module!=m) && modules[m].baseRecord>=0 )
+        replayRecord( &recorder,modules[m].baseRecord,
+            callbackFunc,callbackFuncW,callbackContext );
+
+      int r;
+      for( r=0; r<frame->count; r++ )
+        replayRecord( &recorder,frame->first+r,
+            callbackFunc,callbackFuncW,callbackContext );
+    }
+
+    for( m=0; m<moduleCount; m++ )
+      if( modules[m].image ) releaseModule( modules[m].image );
+
+    free( recorder.records );
+    free( recorder.strings );
+  }
+
+  free( addr64 );
+  free( order );
+  free( modules );
+  free( frames );
+
+  return( ok );
+}
+
+int dwstOfProcessExt(
+    uintptr_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !addr || !count || (!callbackFunc && !callbackFuncW) ) return( 0 );
+
+  int converted = 0;
+  if( dwstOfGroups(addr,count,
+        callbackFunc,callbackFuncW,callbackContext,&converted) )
+    return( converted );
+
+  return( dwstOfRuns(addr,count,
+        callbackFunc,callbackFuncW,callbackContext) );
+}
+
+// the module is still loaded at the same base
+int moduleLoaded( const dwstModuleId *id )
+{
+  MEMORY_BASIC_INFORMATION mbi;
+  uint32_t timestamp,sizeOfImage;
+  return( VirtualQuery((void*)id->base,&mbi,
+        sizeof(MEMORY_BASIC_INFORMATION)) &&
+      mbi.State==MEM_COMMIT && mbi.Type==MEM_IMAGE &&
+      (uintptr_t)mbi.AllocationBase==id->base &&
+      moduleIdentity((void*)id->base,&timestamp,&sizeOfImage) &&
+      timestamp==id->timestamp && sizeOfImage==id->sizeOfImage );
+}
+
+static int readProcess( uint64_t addr,void *buffer,size_t size,void *context )
+{
+  (void)context;
+
+  if( IsBadReadPtr((void*)(uintptr_t)addr,size) ) return( 0 );
+  memcpy( buffer,(void*)(uintptr_t)addr,size );
+  return( 1 );
+}
+
+#if defined(_WIN64) && !defined(__aarch64__) && !defined(_M_ARM64)
+int unwindPdata( dwstUnwindRegs *regs,int caller,uint64_t imageBase,
+    dwstReadMemory *imageFunc,void *imageContext,
+    dwstReadMemory *readFunc,void *readContext,int leaf );
+#endif
+
+// unwind with the unwind codes or the call frame information
+// of the module of the frame
+int unwindModule( dwstUnwindRegs *regs,int caller )
+{
+  void *base = moduleBase( (uintptr_t)(caller ? regs->pc-1 : regs->pc) );
+  if( !base ) return( 0 );
+
+#if defined(_WIN64) && !defined(__aarch64__) && !defined(_M_ARM64)
+  // the unwind codes are read from the loaded module, so this also
+  // works for modules without debug information, like the system DLLs
+  int unwound = unwindPdata( regs,caller,(uintptr_t)base,
+      readProcess,NULL,readProcess,NULL,!caller );
+  if( unwound>=0 ) return( unwound );
+#endif
+
+  dwstImage *image = acquireModule( base );
+  if( !image ) return( 0 );
+
+  int ok = dwstUnwindImage( image,(uintptr_t)base,regs,caller,
+      readProcess,NULL );
+  releaseModule( image );
+
+  return( ok );
+}
+
+int dwstOfRawStackExt(
+    const dwstRawStack *stack,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !stack || (!callbackFunc && !callbackFuncW) ) return( 0 );
+
+  int count = stack->count;
+  int moduleCount = stack->moduleCount;
+  if( count>DWST_MAX_FRAMES ) count = DWST_MAX_FRAMES;
+  if( moduleCount>DWST_MAX_FRAMES ) moduleCount = DWST_MAX_FRAMES;
+
+  int loaded[DWST_MAX_FRAMES];
+  int m;
+  for( m=0; m<moduleCount; m++ )
+    loaded[m] = moduleLoaded( &stack->modules[m] );
+
+  uintptr_t addr[DWST_MAX_FRAMES];
+  int validCount = 0;
+  int i;
+  for( i=0; i<count; i++ )
+  {
+    m = stack->module[i];
+    if( m<moduleCount && loaded[m] )
+      addr[validCount++] = stack->addr[i];
+  }
+  if( !validCount ) return( 0 );
+
+  return( dwstOfProcessExt(addr,validCount,
+        callbackFunc,callbackFuncW,callbackContext) );
+}
+
+int dwstOfRawStack(
+    const dwstRawStack *stack,
+    dwstCallback *callbackFunc,void *callbackContext )
+{
+  return( dwstOfRawStackExt(stack,callbackFunc,NULL,callbackContext) );
+}
+
+int dwstOfRawStackW(
+    const dwstRawStack *stack,
+    dwstCallbackW *callbackFunc,void *callbackContext )
+{
+  return( dwstOfRawStackExt(stack,NULL,callbackFunc,callbackContext) );
+}
+
 int dwstOfProcess(
     uintptr_t *addr,int count,
     dwstCallback *callbackFunc,void *callbackContext )
@@ -98,3 +807,30 @@ int dwstOfProcessW(
 {
   return( dwstOfProcessExt(addr,count,NULL,callbackFunc,callbackContext) );
 }
+
+static int resolveProcess(
+    void *resolveContext,uint64_t *addr,int count,
+    dwstCallback *callbackFunc,void *callbackContext )
+{
+  (void)resolveContext;
+
+  uintptr_t *ptrs = malloc( count*sizeof(uintptr_t) );
+  if( !ptrs ) return( 0 );
+
+  int i;
+  for( i=0; i<count; i++ )
+    ptrs[i] = (uintptr_t)addr[i];
+  int ret = dwstOfProcessExt( ptrs,count,
+      callbackFunc,NULL,callbackContext );
+  free( ptrs );
+
+  return( ret );
+}
+
+int dwstFoldProcess(
+    const dwstSample *samples,int count,
+    dwstFoldCallback *callbackFunc,void *callbackContext )
+{
+  return( foldSamples(samples,count,resolveProcess,NULL,
+        callbackFunc,callbackContext) );
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+
+int dwstOfRawStackExt(
+    const dwstRawStack *stack,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext );
+
+
+typedef struct queue_entry
+{
+  dwstRawStack stack;
+  void *callbackContext;
+} queue_entry;
+
+struct dwstQueue
+{
+  dwstCallback *callbackFunc;
+  dwstCallbackW *callbackFuncW;
+
+  // the stacks are added to pending, and swapped with the resolved
+  // ones, so pushing allocates only while the queue grows
+  CRITICAL_SECTION lock;
+  queue_entry *pending;
+  int pendingQty,pendingAlloc;
+  queue_entry *resolved;
+  int resolvedAlloc;
+
+  // only one batch is resolved at a time
+  CRITICAL_SECTION resolveLock;
+
+  HANDLE thread;
+  HANDLE event;
+  atomic_int stop;
+};
+
+// resolve all stacks added until now
+static int resolveQueue( dwstQueue *queue )
+{
+  EnterCriticalSection( &queue->resolveLock );
+
+  EnterCriticalSection( &queue->lock );
+  queue_entry *entries = queue->pending;
+  int count = queue->pendingQty;
+  queue->pending = queue->resolved;
+  queue->pendingQty = 0;
+  queue->resolved = entries;
+  int alloc = queue->pendingAlloc;
+  queue->pendingAlloc = queue->resolvedAlloc;
+  queue->resolvedAlloc = alloc;
+  LeaveCriticalSection( &queue->lock );
+
+  int i;
+  for( i=0; i<count; i++ )
+    dwstOfRawStackExt( &entries[i].stack,
+        queue->callbackFunc,queue->callbackFuncW,entries[i].callbackContext );
+
+  LeaveCriticalSection( &queue->resolveLock );
+
+  return( count );
+}
+
+static DWORD WINAPI queueThread( LPVOID arg )
+{
+  dwstQueue *queue = arg;
+
+  while( !atomic_load(&queue->stop) )
+  {
+    WaitForSingleObject( queue->event,INFINITE );
+    resolveQueue( queue );
+  }
+
+  return( 0 );
+}
+
+static dwstQueue *dwstQueueCreateExt(
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,int worker )
+{
+  if( !callbackFunc && !callbackFuncW ) return( NULL );
+
+  dwstQueue *queue = calloc( 1,sizeof(dwstQueue) );
+  if( !queue ) return( NULL );
+
+  queue->callbackFunc = callbackFunc;
+  queue->callbackFuncW = callbackFuncW;
+  InitializeCriticalSection( &queue->lock );
+  InitializeCriticalSection( &queue->resolveLock );
+
+  if( worker )
+  {
+    queue->event = CreateEvent( NULL,FALSE,FALSE,NULL );
+    if( queue->event )
+      queue->thread = CreateThread( NULL,0,queueThread,queue,0,NULL );
+    if( !queue->thread )
+    {
+      if( queue->event ) CloseHandle( queue->event );
+      DeleteCriticalSection( &queue->resolveLock );
+      DeleteCriticalSection( &queue->lock );
+      free( queue );
+      return( NULL );
+    }
+  }
+
+  return( queue );
+}
+
+dwstQueue *dwstQueueCreate( dwstCallback *callbackFunc,int worker )
+{
+  return( dwstQueueCreateExt(callbackFunc,NULL,worker) );
+}
+
+dwstQueue *dwstQueueCreateW( dwstCallbackW *callbackFunc,int worker )
+{
+  return( dwstQueueCreateExt(NULL,callbackFunc,worker) );
+}
+
+int dwstQueuePush(
+    dwstQueue *queue,const dwstRawStack *stack,void *callbackContext )
+{
+  if( !queue || !stack ) return( 0 );
+
+  EnterCriticalSection( &queue->lock );
+
+  if( queue->pendingQty>=queue->pendingAlloc )
+  {
+    int newAlloc = queue->pendingAlloc ? queue->pendingAlloc*2 : 64;
+    queue_entry *newArr = realloc( queue->pending,
+        newAlloc*sizeof(queue_entry) );
+    if( !newArr )
+    {
+      LeaveCriticalSection( &queue->lock );
+      return( 0 );
+    }
+    queue->pending = newArr;
+    queue->pendingAlloc = newAlloc;
+  }
+
+  queue_entry *entry = &queue->pending[queue->pendingQty++];
+  entry->stack = *stack;
+  entry->callbackContext = callbackContext;
+
+  // the worker is only woken up for the first stack of a batch
+  int wake = queue->pendingQty==1;
+
+  LeaveCriticalSection( &queue->lock );
+
+  if( wake && queue->event ) SetEvent( queue->event );
+
+  return( 1 );
+}
+
+int dwstQueueFlush( dwstQueue *queue )
+{
+  if( !queue ) return( 0 );
+
+  return( resolveQueue(queue) );
+}
+
+void dwstQueueFree( dwstQueue *queue )
+{
+  if( !queue ) return;
+
+  if( queue->thread )
+  {
+    atomic_store( &queue->stop,1 );
+    SetEvent( queue->event );
+    WaitForSingleObject( queue->thread,INFINITE );
+    CloseHandle( queue->thread );
+    CloseHandle( queue->event );
+  }
+
+  resolveQueue( queue );
+
+  DeleteCriticalSection( &queue->resolveLock );
+  DeleteCriticalSection( &queue->lock );
+  free( queue->pending );
+  free( queue->resolved );
+  free( queue );
+}
+
+// records of the ring resolved at once
+#define RING_BATCH 8
+
+static int dwstRingResolveExt( dwstRing *ring,int maxCount,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW )
+{
+  if( !ring || (!callbackFunc && !callbackFuncW) ) return( 0 );
+
+  dwstRingRecord records[RING_BATCH];
+  int resolved = 0;
+  while( !maxCount || resolved<maxCount )
+  {
+    int size = RING_BATCH;
+    if( maxCount && maxCount-resolved<size ) size = maxCount - resolved;
+
+    int count = dwstRingDrain( ring,records,size );
+    int i;
+    for( i=0; i<count; i++ )
+      dwstOfRawStackExt( &records[i].stack,
+          callbackFunc,callbackFuncW,&records[i] );
+    resolved += count;
+
+    if( count<size ) break;
+  }
+
+  return( resolved );
+}
+
+int dwstRingResolve( dwstRing *ring,int maxCount,dwstCallback *callbackFunc )
+{
+  return( dwstRingResolveExt(ring,maxCount,callbackFunc,NULL) );
+}
+
+int dwstRingResolveW(
+    dwstRing *ring,int maxCount,dwstCallbackW *callbackFunc )
+{
+  return( dwstRingResolveExt(ring,maxCount,NULL,callbackFunc) );
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// the sequence of a slot tells its state for the position pos:
+//   pos      free for a producer
+//   pos+1    written, ready for the consumer
+//   the next round starts with pos+capacity
+typedef struct ring_slot
+{
+  atomic_size_t seq;
+  dwstRingRecord record;
+} ring_slot;
+
+// producers and consumer change their positions on separate cache lines
+struct dwstRing
+{
+  ring_slot *slots;
+  size_t mask;
+  char pad1[64];
+  atomic_size_t head;
+  atomic_ullong dropped;
+  char pad2[64];
+  atomic_size_t tail;
+  char pad3[64];
+};
+
+dwstRing *dwstRingCreate( int capacity )
+{
+  if( capacity<1 || capacity>(1<<30) ) return( NULL );
+
+  size_t size = 2;
+  while( size<(size_t)capacity ) size *= 2;
+
+  dwstRing *ring = calloc( 1,sizeof(dwstRing) );
+  if( !ring ) return( NULL );
+  ring->slots = malloc( size*sizeof(ring_slot) );
+  if( !ring->slots )
+  {
+    free( ring );
+    return( NULL );
+  }
+
+  size_t i;
+  for( i=0; i<size; i++ )
+    atomic_init( &ring->slots[i].seq,i );
+  ring->mask = size - 1;
+  atomic_init( &ring->head,0 );
+  atomic_init( &ring->tail,0 );
+  atomic_init( &ring->dropped,0 );
+
+  return( ring );
+}
+
+// only the used part of the stack is copied
+static void copyRecord( dwstRingRecord *dst,const dwstRingRecord *src )
+{
+  int count = src->stack.count;
+  int moduleCount = src->stack.moduleCount;
+  if( count<0 ) count = 0;
+  if( count>DWST_MAX_FRAMES ) count = DWST_MAX_FRAMES;
+  if( moduleCount<0 ) moduleCount = 0;
+  if( moduleCount>DWST_MAX_FRAMES ) moduleCount = DWST_MAX_FRAMES;
+
+  dst->threadId = src->threadId;
+  dst->time = src->time;
+  dst->stack.count = count;
+  dst->stack.moduleCount = moduleCount;
+  memcpy( dst->stack.addr,src->stack.addr,count*sizeof(uintptr_t) );
+  memcpy( dst->stack.module,src->stack.module,count );
+  memcpy( dst->stack.modules,src->stack.modules,
+      moduleCount*sizeof(dwstModuleId) );
+}
+
+// claim the next free slot, returns NULL if the ring is full
+dwstRingRecord *ringReserve( dwstRing *ring )
+{
+  size_t pos = atomic_load_explicit( &ring->head,memory_order_relaxed );
+  while( 1 )
+  {
+    ring_slot *slot = &ring->slots[pos&ring->mask];
+    size_t seq = atomic_load_explicit( &slot->seq,memory_order_acquire );
+    intptr_t diff = (intptr_t)( seq - pos );
+
+    if( !diff )
+    {
+      if( atomic_compare_exchange_weak_explicit(&ring->head,&pos,pos+1,
+            memory_order_relaxed,memory_order_relaxed) )
+        return( &slot->record );
+    }
+    else if( diff<0 )
+    {
+      // the slot of the last round wasn't drained yet
+      atomic_fetch_add_explicit( &ring->dropped,1,memory_order_relaxed );
+      return( NULL );
+    }
+    else
+      pos = atomic_load_explicit( &ring->head,memory_order_relaxed );
+  }
+}
+
+// publish the written record of ringReserve()
+void ringCommit( dwstRingRecord *record )
+{
+  ring_slot *slot = (ring_slot*)( (char*)record -
+      offsetof(ring_slot,record) );
+  size_t seq = atomic_load_explicit( &slot->seq,memory_order_relaxed );
+  atomic_store_explicit( &slot->seq,seq+1,memory_order_release );
+}
+
+int dwstRingPush( dwstRing *ring,const dwstRingRecord *record )
+{
+  if( !ring || !record ) return( 0 );
+
+  dwstRingRecord *slotRecord = ringReserve( ring );
+  if( !slotRecord ) return( 0 );
+
+  copyRecord( slotRecord,record );
+  ringCommit( slotRecord );
+
+  return( 1 );
+}
+
+int dwstRingDrain( dwstRing *ring,dwstRingRecord *records,int size )
+{
+  if( !ring || !records ) return( 0 );
+
+  size_t pos = atomic_load_explicit( &ring->tail,memory_order_relaxed );
+  int count;
+  for( count=0; count<size; count++,pos++ )
+  {
+    // stops at a record which is still written
+    ring_slot *slot = &ring->slots[pos&ring->mask];
+    size_t seq = atomic_load_explicit( &slot->seq,memory_order_acquire );
+    if( seq!=pos+1 ) break;
+
+    copyRecord( &records[count],&slot->record );
+    atomic_store_explicit( &slot->seq,pos+ring->mask+1,
+        memory_order_release );
+  }
+  atomic_store_explicit( &ring->tail,pos,memory_order_relaxed );
+
+  return( count );
+}
+
+uint64_t dwstRingDropped( dwstRing *ring )
+{
+  if( !ring ) return( 0 );
+
+  return( atomic_load_explicit(&ring->dropped,memory_order_relaxed) );
+}
+
+void dwstRingFree( dwstRing *ring )
+{
+  if( !ring ) return;
+
+  free( ring->slots );
+  free( ring );
+}
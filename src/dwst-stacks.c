@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include "dwst_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+
+int dwstOfProcessExt(
+    uintptr_t *addr,int count,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext );
+
+int moduleLoaded( const dwstModuleId *id );
+
+
+// the callbacks are kept separately for dwstStackTableFrames()
+// and dwstStackTableFramesW()
+#define FLAVORS 2
+
+#define NO_STRING ((size_t)-1)
+
+// recorded callback of a frame
+typedef struct frame_record
+{
+  uint64_t addr;
+  // offsets in the strings, or NO_STRING
+  size_t filename;
+  size_t funcname;
+  int lineno;
+  int columnno;
+} frame_record;
+
+typedef struct table_module
+{
+  dwstModuleId id;
+  // the DWST_BASE_ADDR callback, or -1
+  int baseRecord[FLAVORS];
+} table_module;
+
+// address of a module, shared by all stacks which contain it
+typedef struct table_frame
+{
+  uint64_t hash;
+  uintptr_t addr;
+  // index of the module, or -1 if it's not in a loaded module
+  int module;
+  // recorded callbacks
+  int first[FLAVORS],count[FLAVORS];
+} table_frame;
+
+typedef struct table_stack
+{
+  uint64_t hash;
+  uint64_t count;
+  // indexes of the frames in stackFrames
+  int first,len;
+} table_stack;
+
+struct dwstStackTable
+{
+  table_stack *stacks;
+  int stackQty,stackAlloc;
+  int *stackFrames;
+  int stackFrameQty,stackFrameAlloc;
+
+  table_frame *frames;
+  int frameQty,frameAlloc;
+  // frames are only added, so the resolved ones are the first ones
+  int resolved[FLAVORS];
+
+  table_module *modules;
+  int moduleQty,moduleAlloc;
+
+  frame_record *records[FLAVORS];
+  int recordQty[FLAVORS],recordAlloc[FLAVORS];
+
+  // the file and function names, each only once
+  char *strings;
+  size_t stringSize,stringAlloc;
+
+  // open addressing, with -1 (or NO_STRING) as empty slot,
+  // the sizes are powers of 2, and at most half used
+  int *stackHash;
+  int stackHashSize;
+  int *frameHash;
+  int frameHashSize;
+  size_t *stringHash;
+  int stringHashSize,stringQty;
+};
+
+dwstStackTable *dwstStackTableCreate( void )
+{
+  return( calloc(1,sizeof(dwstStackTable)) );
+}
+
+static int findModule( dwstStackTable *table,const dwstModuleId *id )
+{
+  int m;
+  for( m=0; m<table->moduleQty; m++ )
+  {
+    const dwstModuleId *mid = &table->modules[m].id;
+    if( mid->base==id->base && mid->timestamp==id->timestamp &&
+        mid->sizeOfImage==id->sizeOfImage )
+      return( m );
+  }
+
+  if( !dwst_grow_array((void**)&table->modules,&table->moduleAlloc,
+        table->moduleQty+1,sizeof(table_module)) )
+    return( -2 );
+
+  table_module *module = &table->modules[table->moduleQty];
+  module->id = *id;
+  for( m=0; m<FLAVORS; m++ )
+    module->baseRecord[m] = -1;
+
+  return( table->moduleQty++ );
+}
+
+static uint64_t frameHashOf( uintptr_t addr,const dwstModuleId *id )
+{
+  uint64_t hash = dwst_hash_mix( 0,addr );
+  if( id )
+  {
+    hash = dwst_hash_mix( hash,id->base );
+    hash = dwst_hash_mix( hash,(uint64_t)id->timestamp<<32 | id->sizeOfImage );
+  }
+  return( hash );
+}
+
+static int sameModule( dwstStackTable *table,int m,const dwstModuleId *id )
+{
+  if( m<0 || !id ) return( m<0 && !id );
+
+  const dwstModuleId *mid = &table->modules[m].id;
+  return( mid->base==id->base && mid->timestamp==id->timestamp &&
+      mid->sizeOfImage==id->sizeOfImage );
+}
+
+static const dwstModuleId *frameModule( const dwstRawStack *stack,int i )
+{
+  int m = stack->module[i];
+  if( m>=stack->moduleCount || m>=DWST_MAX_FRAMES ) return( NULL );
+  return( &stack->modules[m] );
+}
+
+// index of the frame, added if it's new, or -1 on failure
+static int internFrame( dwstStackTable *table,
+    uintptr_t addr,const dwstModuleId *id )
+{
+  if( (table->frameQty+1)*2>table->frameHashSize &&
+      !dwst_grow_hash(&table->frameHash,&table->frameHashSize,
+        table->frames,sizeof(table_frame),offsetof(table_frame,hash),
+        table->frameQty) )
+    return( -1 );
+
+  uint64_t hash = frameHashOf( addr,id );
+  int mask = table->frameHashSize - 1;
+  int slot = (int)( hash&mask );
+  int f;
+  while( (f=table->frameHash[slot])>=0 )
+  {
+    table_frame *frame = &table->frames[f];
+    if( frame->hash==hash && frame->addr==addr &&
+        sameModule(table,frame->module,id) )
+      return( f );
+    slot = ( slot + 1 )&mask;
+  }
+
+  int m = id ? findModule( table,id ) : -1;
+  if( m<-1 ||
+      !dwst_grow_array((void**)&table->frames,&table->frameAlloc,
+        table->frameQty+1,sizeof(table_frame)) )
+    return( -1 );
+
+  f = table->frameQty++;
+  table_frame *frame = &table->frames[f];
+  frame->hash = hash;
+  frame->addr = addr;
+  frame->module = m;
+  int v;
+  for( v=0; v<FLAVORS; v++ )
+  {
+    frame->first[v] = 0;
+    frame->count[v] = 0;
+  }
+  table->frameHash[slot] = f;
+
+  return( f );
+}
+
+int dwstStackTableAdd( dwstStackTable *table,const dwstRawStack *stack )
+{
+  if( !table || !stack ) return( -1 );
+
+  int count = stack->count;
+  if( count<0 ) count = 0;
+  if( count>DWST_MAX_FRAMES ) count = DWST_MAX_FRAMES;
+
+  uint64_t hash = dwst_hash_mix( 0,count );
+  int i;
+  for( i=0; i<count; i++ )
+    hash = dwst_hash_mix( hash,
+        frameHashOf(stack->addr[i],frameModule(stack,i)) );
+
+  if( (table->stackQty+1)*2>table->stackHashSize &&
+      !dwst_grow_hash(&table->stackHash,&table->stackHashSize,
+        table->stacks,sizeof(table_stack),offsetof(table_stack,hash),
+        table->stackQty) )
+    return( -1 );
+
+  int mask = table->stackHashSize - 1;
+  int slot = (int)( hash&mask );
+  int s;
+  while( (s=table->stackHash[slot])>=0 )
+  {
+    table_stack *entry = &table->stacks[s];
+    if( entry->hash==hash && entry->len==count )
+    {
+      const int *frameIdx = table->stackFrames + entry->first;
+      for( i=0; i<count; i++ )
+      {
+        const table_frame *frame = &table->frames[frameIdx[i]];
+        if( frame->addr!=stack->addr[i] ||
+            !sameModule(table,frame->module,frameModule(stack,i)) )
+          break;
+      }
+      if( i==count )
+      {
+        entry->count++;
+        return( s );
+      }
+    }
+    slot = ( slot + 1 )&mask;
+  }
+
+  if( !dwst_grow_array((void**)&table->stacks,&table->stackAlloc,
+        table->stackQty+1,sizeof(table_stack)) ||
+      !dwst_grow_array((void**)&table->stackFrames,&table->stackFrameAlloc,
+        table->stackFrameQty+count,sizeof(int)) )
+    return( -1 );
+
+  int first = table->stackFrameQty;
+  for( i=0; i<count; i++ )
+  {
+    int f = internFrame( table,stack->addr[i],frameModule(stack,i) );
+    if( f<0 ) return( -1 );
+    table->stackFrames[first+i] = f;
+  }
+  table->stackFrameQty += count;
+
+  s = table->stackQty++;
+  table_stack *entry = &table->stacks[s];
+  entry->hash = hash;
+  entry->count = 1;
+  entry->first = first;
+  entry->len = count;
+  table->stackHash[slot] = s;
+
+  return( s );
+}
+
+int dwstStackTableCounts(
+    dwstStackTable *table,dwstStackCount *counts,int size )
+{
+  if( !table ) return( 0 );
+
+  int s;
+  for( s=0; counts && s<size && s<table->stackQty; s++ )
+  {
+    counts[s].id = s;
+    counts[s].count = table->stacks[s].count;
+  }
+
+  return( table->stackQty );
+}
+
+// offset of the string, added if it's new, or NO_STRING on failure
+static size_t internString( dwstStackTable *table,
+    const void *str,size_t size )
+{
+  if( (table->stringQty+1)*2>table->stringHashSize )
+  {
+    int newSize = table->stringHashSize ? table->stringHashSize*2 : 256;
+    size_t *newArr = malloc( newSize*sizeof(size_t) );
+    if( !newArr ) return( NO_STRING );
+
+    int i;
+    for( i=0; i<newSize; i++ ) newArr[i] = NO_STRING;
+    for( i=0; i<table->stringHashSize; i++ )
+    {
+      size_t offs = table->stringHash[i];
+      if( offs==NO_STRING ) continue;
+
+      size_t len;
+      memcpy( &len,table->strings+offs-sizeof(size_t),sizeof(size_t) );
+      int slot = (int)( dwst_hash_bytes(table->strings+offs,len)&(newSize-1) );
+      while( newArr[slot]!=NO_STRING ) slot = ( slot + 1 )&( newSize - 1 );
+      newArr[slot] = offs;
+    }
+
+    free( table->stringHash );
+    table->stringHash = newArr;
+    table->stringHashSize = newSize;
+  }
+
+  int mask = table->stringHashSize - 1;
+  int slot = (int)( dwst_hash_bytes(str,size)&mask );
+  size_t offs;
+  while( (offs=table->stringHash[slot])!=NO_STRING )
+  {
+    size_t len;
+    memcpy( &len,table->strings+offs-sizeof(size_t),sizeof(size_t) );
+    if( len==size && !memcmp(table->strings+offs,str,size) )
+      return( offs );
+    slot = ( slot + 1 )&mask;
+  }
+
+  // the size is stored before the string, aligned for wide strings
+  offs = ( table->stringSize + sizeof(size_t) + sizeof(size_t) - 1 ) &
+    ~( sizeof(size_t) - 1 );
+  if( offs+size>table->stringAlloc )
+  {
+    size_t newAlloc = table->stringAlloc ? table->stringAlloc*2 : 4096;
+    while( newAlloc<offs+size ) newAlloc *= 2;
+    char *newStrings = realloc( table->strings,newAlloc );
+    if( !newStrings ) return( NO_STRING );
+    table->strings = newStrings;
+    table->stringAlloc = newAlloc;
+  }
+  memcpy( table->strings+offs-sizeof(size_t),&size,sizeof(size_t) );
+  memcpy( table->strings+offs,str,size );
+  table->stringSize = offs + size;
+  table->stringHash[slot] = offs;
+  table->stringQty++;
+
+  return( offs );
+}
+
+// state of a resolving of new frames
+typedef struct table_resolver
+{
+  dwstStackTable *table;
+  int flavor;
+  // modules which are still the same
+  const int *loaded;
+  // resolved frames, in the order of the addresses
+  const int *frameIdx;
+  int frameCount;
+  int current;
+  int failed;
+} table_resolver;
+
+static void recordFrame( table_resolver *resolver,
+    uint64_t addr,const void *filename,size_t filenameSize,int lineno,
+    const char *funcname,int columnno )
+{
+  dwstStackTable *table = resolver->table;
+  int v = resolver->flavor;
+  if( resolver->failed ) return;
+
+  if( !dwst_grow_array((void**)&table->records[v],&table->recordAlloc[v],
+        table->recordQty[v]+1,sizeof(frame_record)) )
+  {
+    resolver->failed = 1;
+    return;
+  }
+
+  size_t filenameOffs = NO_STRING;
+  size_t funcnameOffs = NO_STRING;
+  if( filename )
+    filenameOffs = internString( table,filename,filenameSize );
+  if( funcname )
+    funcnameOffs = internString( table,funcname,strlen(funcname)+1 );
+  if( (filename && filenameOffs==NO_STRING) ||
+      (funcname && funcnameOffs==NO_STRING) )
+  {
+    resolver->failed = 1;
+    return;
+  }
+
+  int r = table->recordQty[v]++;
+  frame_record *record = &table->records[v][r];
+  record->addr = addr;
+  record->filename = filenameOffs;
+  record->funcname = funcnameOffs;
+  record->lineno = lineno;
+  record->columnno = columnno;
+
+  // the module base is never the address of a frame
+  int m;
+  if( lineno==DWST_BASE_ADDR )
+  {
+    for( m=0; m<table->moduleQty &&
+        (resolver->loaded[m]!=1 || table->modules[m].id.base!=addr); m++ );
+    if( m<table->moduleQty )
+    {
+      table->modules[m].baseRecord[v] = r;
+      return;
+    }
+  }
+
+  // the first callback of each frame has its address,
+  // the inlined callers which follow have none,
+  // and frames of modules which can't be opened have no callbacks
+  if( addr )
+  {
+    int c;
+    for( c=resolver->current+1; c<resolver->frameCount &&
+        table->frames[resolver->frameIdx[c]].addr!=addr; c++ );
+    if( c<resolver->frameCount )
+    {
+      resolver->current = c;
+      table->frames[resolver->frameIdx[c]].first[v] = r;
+    }
+  }
+  if( resolver->current>=0 )
+    table->frames[resolver->frameIdx[resolver->current]].count[v]++;
+}
+
+static void recordTableFrame(
+    uint64_t addr,const char *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  recordFrame( context,addr,filename,filename?strlen(filename)+1:0,
+      lineno,funcname,columnno );
+}
+
+static void recordTableFrameW(
+    uint64_t addr,const wchar_t *filename,int lineno,const char *funcname,
+    void *context,int columnno )
+{
+  recordFrame( context,addr,filename,
+      filename?(wcslen(filename)+1)*sizeof(wchar_t):0,
+      lineno,funcname,columnno );
+}
+
+// resolve the frames added since the last resolving, all at once
+static int resolveFrames( dwstStackTable *table,int v )
+{
+  int first = table->resolved[v];
+  int count = table->frameQty - first;
+  if( !count ) return( 1 );
+
+  int *frameIdx = malloc( count*sizeof(int) );
+  uintptr_t *addr = malloc( count*sizeof(uintptr_t) );
+  int *loaded = malloc( (table->moduleQty+1)*sizeof(int) );
+  int ok = 0;
+  if( frameIdx && addr && loaded )
+  {
+    // only modules which are still the same are looked up
+    int m;
+    for( m=0; m<table->moduleQty; m++ )
+      loaded[m] = -1;
+
+    int addrCount = 0;
+    int f;
+    for( f=first; f<table->frameQty; f++ )
+    {
+      m = table->frames[f].module;
+      if( m<0 ) continue;
+      if( loaded[m]<0 )
+        loaded[m] = moduleLoaded( &table->modules[m].id );
+      if( !loaded[m] ) continue;
+
+      frameIdx[addrCount] = f;
+      addr[addrCount++] = table->frames[f].addr;
+    }
+
+    table_resolver resolver = { table,v,loaded,frameIdx,addrCount,-1,0 };
+    if( addrCount )
+      dwstOfProcessExt( addr,addrCount,
+          v?NULL:recordTableFrame,v?recordTableFrameW:NULL,&resolver );
+    ok = !resolver.failed;
+  }
+
+  free( loaded );
+  free( addr );
+  free( frameIdx );
+
+  if( ok ) table->resolved[v] = table->frameQty;
+  return( ok );
+}
+
+static void replayRecord( dwstStackTable *table,int v,int r,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  const frame_record *record = &table->records[v][r];
+  const char *filename = record->filename==NO_STRING ? NULL :
+    table->strings + record->filename;
+  const char *funcname = record->funcname==NO_STRING ? NULL :
+    table->strings + record->funcname;
+  if( callbackFunc )
+    callbackFunc( record->addr,filename,record->lineno,funcname,
+        callbackContext,record->columnno );
+  else
+    callbackFuncW( record->addr,(const wchar_t*)filename,record->lineno,
+        funcname,callbackContext,record->columnno );
+}
+
+static int dwstStackTableFramesExt(
+    dwstStackTable *table,int id,
+    dwstCallback *callbackFunc,dwstCallbackW *callbackFuncW,
+    void *callbackContext )
+{
+  if( !table || id<0 || id>=table->stackQty ||
+      (!callbackFunc && !callbackFuncW) )
+    return( 0 );
+
+  int v = callbackFunc ? 0 : 1;
+  if( table->resolved[v]<table->frameQty && !resolveFrames(table,v) )
+    return( 0 );
+
+  // like a lookup of the stack with dwstOfRawStack()
+  const table_stack *entry = &table->stacks[id];
+  const int *frameIdx = table->stackFrames + entry->first;
+  int lastModule = -1;
+  int converted = 0;
+  int i;
+  for( i=0; i<entry->len; i++ )
+  {
+    const table_frame *frame = &table->frames[frameIdx[i]];
+    if( !frame->count[v] ) continue;
+
+    int m = frame->module;
+    if( m!=lastModule && table->modules[m].baseRecord[v]>=0 )
+      replayRecord( table,v,table->modules[m].baseRecord[v],
+          callbackFunc,callbackFuncW,callbackContext );
+    lastModule = m;
+
+    int r;
+    for( r=0; r<frame->count[v]; r++ )
+      replayRecord( table,v,frame->first[v]+r,
+          callbackFunc,callbackFuncW,callbackContext );
+    converted++;
+  }
+
+  return( converted );
+}
+
+int dwstStackTableFrames(
+    dwstStackTable *table,int id,
+    dwstCallback *callbackFunc,void *callbackContext )
+{
+  return( dwstStackTableFramesExt(table,id,
+        callbackFunc,NULL,callbackContext) );
+}
+
+int dwstStackTableFramesW(
+    dwstStackTable *table,int id,
+    dwstCallbackW *callbackFunc,void *callbackContext )
+{
+  return( dwstStackTableFramesExt(table,id,
+        NULL,callbackFunc,callbackContext) );
+}
+
+void dwstStackTableFree( dwstStackTable *table )
+{
+  if( !table ) return;
+
+  int v;
+  for( v=0; v<FLAVORS; v++ )
+    free( table->records[v] );
+  free( table->stringHash );
+  free( table->strings );
+  free( table->frameHash );
+  free( table->frames );
+  free( table->modules );
+  free( table->stackHash );
+  free( table->stackFrames );
+  free( table->stacks );
+  free( table );
+}
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2013-2025 Hannes Domani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "dwarfstack.h"
+
+#include "dwarf_pe.h"
+#include "dwst_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct image_frames image_frames;
+
+Dwarf_Debug enterImageDbg( dwstImage *image,
+    Dwarf_Addr *imageBase_dbg,image_frames ***frames );
+
+void leaveImageDbg( dwstImage *image );
+
+int unwindPdata( dwstUnwindRegs *regs,int caller,uint64_t imageBase,
+    dwstReadMemory *imageFunc,void *imageContext,
+    dwstReadMemory *readFunc,void *readContext,int leaf );
+
+
+#define MACHINE_I386  0x014c
+#define MACHINE_AMD64 0x8664
+#define MACHINE_ARM64 0xaa64
+
+// the FDEs of .eh_frame and .debug_frame
+#define FRAME_SECTIONS 2
+
+// rule of a register which doesn't keep its value
+#define RULE_UNDEFINED  0
+#define RULE_OFFSET     1  // saved at CFA+offset
+#define RULE_VAL_OFFSET 2  // value is CFA+offset
+#define RULE_REGISTER   3  // saved in another register
+
+typedef struct unwind_rule
+{
+  int64_t offset;
+  uint8_t reg;
+  uint8_t type;
+  uint8_t source;
+} unwind_rule;
+
+// row of the rules, valid until the next row
+typedef struct unwind_row
+{
+  uint64_t pc;
+  int64_t cfaOffset;
+  // register of the CFA, or -1 if it's not a register with offset
+  int cfaReg;
+  int firstRule,ruleCount;
+} unwind_row;
+
+// compiled rules of an FDE, rows and rules are in the same allocation,
+// an FDE which can't be unwound has no rows
+typedef struct unwind_fde
+{
+  uint64_t lowpc,highpc;
+  uint64_t lastUse;
+  size_t size;
+  int raReg;
+  int rowCount;
+  unwind_row *rows;
+  unwind_rule *rules;
+} unwind_fde;
+
+struct image_frames
+{
+  Dwarf_Cie *cies[FRAME_SECTIONS];
+  Dwarf_Signed cieCount[FRAME_SECTIONS];
+  // sorted by address
+  Dwarf_Fde *fdes[FRAME_SECTIONS];
+  Dwarf_Signed fdeCount[FRAME_SECTIONS];
+  // the stack pointer is the CFA of the caller
+  int spReg;
+  int addrSize;
+  // x86-64 images have unwind codes in .pdata
+  int pdata;
+  // rules of the current row, only used with the image lock
+  Dwarf_Regtable_Entry3 rules[DWST_UNWIND_REGS];
+
+  // compiled FDEs, sorted by address
+  unwind_fde **cache;
+  int cacheQty,cacheAlloc;
+  size_t cacheSize;
+  // maximum size of the cache, 0 means no limit
+  size_t budget;
+  uint64_t useTick;
+  dwstUnwindStats stats;
+};
+
+// needs the image lock
+static image_frames *readFrames( Dwarf_Debug dbg )
+{
+  image_frames *frames = calloc( 1,sizeof(image_frames) );
+  if( !frames ) return( NULL );
+
+  switch( dwarf_pe_machine(dbg) )
+  {
+    case MACHINE_I386:
+      frames->spReg = 4;
+      frames->addrSize = 4;
+      break;
+    case MACHINE_AMD64:
+      frames->spReg = 7;
+      frames->addrSize = 8;
+      frames->pdata = 1;
+      break;
+    case MACHINE_ARM64:
+      frames->spReg = 31;
+      frames->addrSize = 8;
+      break;
+    default:
+      // unwinding is not possible, but the handle stays valid
+      frames->spReg = -1;
+      return( frames );
+  }
+
+  if( dwarf_get_fde_list_eh(dbg,&frames->cies[0],&frames->cieCount[0],
+        &frames->fdes[0],&frames->fdeCount[0],NULL)!=DW_DLV_OK )
+    frames->fdeCount[0] = 0;
+  if( dwarf_get_fde_list(dbg,&frames->cies[1],&frames->cieCount[1],
+        &frames->fdes[1],&frames->fdeCount[1],NULL)!=DW_DLV_OK )
+    frames->fdeCount[1] = 0;
+
+  return( frames );
+}
+
+void freeImageFrames( Dwarf_Debug dbg,image_frames *frames )
+{
+  if( !frames ) return;
+
+  int i;
+  for( i=0; i<frames->cacheQty; i++ )
+    free( frames->cache[i] );
+  free( frames->cache );
+
+  int s;
+  for( s=0; s<FRAME_SECTIONS; s++ )
+  {
+    if( frames->fdeCount[s] )
+      dwarf_dealloc_fde_cie_list( dbg,frames->cies[s],frames->cieCount[s],
+          frames->fdes[s],frames->fdeCount[s] );
+  }
+  free( frames );
+}
+
+static Dwarf_Fde findFde( image_frames *frames,Dwarf_Addr pc,
+    Dwarf_Addr *lowpc,Dwarf_Addr *highpc )
+{
+  int s;
+  for( s=0; s<FRAME_SECTIONS; s++ )
+  {
+    Dwarf_Fde fde;
+    if( frames->fdeCount[s] &&
+        dwarf_get_fde_at_pc(frames->fdes[s],pc,&fde,lowpc,highpc,
+          NULL)==DW_DLV_OK )
+      return( fde );
+  }
+  return( NULL );
+}
+
+// the rules of the registers which don't keep their value
+static int compileRules( image_frames *frames,unwind_rule *rules )
+{
+  int count = 0;
+  int r;
+  for( r=0; r<DWST_UNWIND_REGS; r++ )
+  {
+    const Dwarf_Regtable_Entry3 *entry = &frames->rules[r];
+    if( entry->dw_regnum==DW_FRAME_SAME_VAL ) continue;
+
+    unwind_rule *rule = &rules[count++];
+    rule->offset = (Dwarf_Signed)entry->dw_offset;
+    rule->reg = r;
+    rule->source = 0;
+
+    // expressions are not supported
+    if( entry->dw_regnum==DW_FRAME_UNDEFINED_VAL )
+      rule->type = RULE_UNDEFINED;
+    else if( entry->dw_value_type==DW_EXPR_OFFSET &&
+        entry->dw_offset_relevant )
+      rule->type = RULE_OFFSET;
+    else if( entry->dw_value_type==DW_EXPR_OFFSET &&
+        entry->dw_regnum<DWST_UNWIND_REGS )
+    {
+      rule->type = RULE_REGISTER;
+      rule->source = entry->dw_regnum;
+    }
+    else if( entry->dw_value_type==DW_EXPR_VAL_OFFSET )
+      rule->type = RULE_VAL_OFFSET;
+    else
+      rule->type = RULE_UNDEFINED;
+  }
+  return( count );
+}
+
+// run the instructions of the FDE once for each of its rows,
+// needs the image lock
+static unwind_fde *compileFde( image_frames *frames,Dwarf_Fde fde,
+    Dwarf_Addr lowpc,Dwarf_Addr highpc )
+{
+  unwind_row *rows = NULL;
+  int rowQty = 0,rowAlloc = 0;
+  unwind_rule *rules = NULL;
+  int ruleQty = 0,ruleAlloc = 0;
+
+  Dwarf_Cie cie;
+  Dwarf_Unsigned cieSize;
+  Dwarf_Half raReg = DWST_UNWIND_REGS;
+  if( dwarf_get_cie_of_fde(fde,&cie,NULL)!=DW_DLV_OK ||
+      dwarf_get_cie_info_b(cie,&cieSize,NULL,NULL,NULL,NULL,&raReg,
+        NULL,NULL,NULL,NULL)!=DW_DLV_OK )
+    raReg = DWST_UNWIND_REGS;
+
+  Dwarf_Regtable3 table;
+  table.rt3_reg_table_size = DWST_UNWIND_REGS;
+  table.rt3_rules = frames->rules;
+  Dwarf_Addr pc = lowpc;
+  int ok = 1;
+  while( raReg<DWST_UNWIND_REGS )
+  {
+    Dwarf_Small valueType;
+    Dwarf_Unsigned offsetRelevant,reg,offset;
+    Dwarf_Block block;
+    Dwarf_Addr rowPc;
+    Dwarf_Bool moreRows = 0;
+    Dwarf_Addr nextPc = 0;
+    if( dwarf_get_fde_info_for_cfa_reg3_b(fde,pc,&valueType,
+          &offsetRelevant,&reg,&offset,&block,&rowPc,&moreRows,&nextPc,
+          NULL)!=DW_DLV_OK ||
+        dwarf_get_fde_info_for_all_regs3(fde,pc,&table,NULL,
+          NULL)!=DW_DLV_OK )
+      break;
+
+    if( !dwst_grow_array((void**)&rows,&rowAlloc,rowQty+1,sizeof(unwind_row)) ||
+        !dwst_grow_array((void**)&rules,&ruleAlloc,ruleQty+DWST_UNWIND_REGS,
+          sizeof(unwind_rule)) )
+    {
+      ok = 0;
+      break;
+    }
+
+    // only a register with offset is supported for the CFA,
+    // expressions are mostly used in PLT entries
+    const Dwarf_Regtable_Entry3 *cfaRule = &table.rt3_cfa_rule;
+    unwind_row *row = &rows[rowQty++];
+    row->pc = pc;
+    row->cfaReg = -1;
+    row->cfaOffset = 0;
+    if( cfaRule->dw_value_type==DW_EXPR_OFFSET &&
+        cfaRule->dw_regnum<DWST_UNWIND_REGS )
+    {
+      row->cfaReg = cfaRule->dw_regnum;
+      if( cfaRule->dw_offset_relevant )
+        row->cfaOffset = (Dwarf_Signed)cfaRule->dw_offset;
+    }
+    row->firstRule = ruleQty;
+    row->ruleCount = compileRules( frames,rules+ruleQty );
+    ruleQty += row->ruleCount;
+
+    if( !moreRows || nextPc<=pc || nextPc>highpc ) break;
+    pc = nextPc;
+  }
+
+  size_t size = sizeof(unwind_fde) + rowQty*sizeof(unwind_row) +
+    ruleQty*sizeof(unwind_rule);
+  unwind_fde *compiled = ok ? malloc( size ) : NULL;
+  if( compiled )
+  {
+    compiled->lowpc = lowpc;
+    compiled->highpc = highpc + 1;
+    compiled->lastUse = 0;
+    compiled->size = size;
+    compiled->raReg = raReg;
+    compiled->rowCount = rowQty;
+    compiled->rows = (unwind_row*)( compiled + 1 );
+    compiled->rules = (unwind_rule*)( compiled->rows + rowQty );
+    if( rowQty )
+      memcpy( compiled->rows,rows,rowQty*sizeof(unwind_row) );
+    if( ruleQty )
+      memcpy( compiled->rules,rules,ruleQty*sizeof(unwind_rule) );
+  }
+
+  free( rows );
+  free( rules );
+
+  return( compiled );
+}
+
+// index of the last cached FDE starting at or before pc, or -1
+static int findCached( image_frames *frames,uint64_t pc )
+{
+  int low = 0,high = frames->cacheQty - 1;
+  int found = -1;
+  while( low<=high )
+  {
+    int middle = ( low + high )/2;
+    if( frames->cache[middle]->lowpc<=pc )
+    {
+      found = middle;
+      low = middle + 1;
+    }
+    else
+      high = middle - 1;
+  }
+  return( found );
+}
+
+// free the least recently used FDEs until size fits into the budget
+static void trimCache( image_frames *frames,size_t size )
+{
+  while( frames->budget && frames->cacheQty &&
+      frames->cacheSize+size>frames->budget )
+  {
+    int oldest = 0;
+    int i;
+    for( i=1; i<frames->cacheQty; i++ )
+    {
+      if( frames->cache[i]->lastUse<frames->cache[oldest]->lastUse )
+        oldest = i;
+    }
+
+    frames->cacheSize -= frames->cache[oldest]->size;
+    free( frames->cache[oldest] );
+    frames->cacheQty--;
+    memmove( frames->cache+oldest,frames->cache+oldest+1,
+        (frames->cacheQty-oldest)*sizeof(unwind_fde*) );
+    frames->stats.evictions++;
+  }
+}
+
+// compiled FDE of the address, *owned is set if it's not in the cache,
+// needs the image lock
+static unwind_fde *lookupFde( image_frames *frames,uint64_t pc,int *owned )
+{
+  *owned = 0;
+
+  int i = findCached( frames,pc );
+  if( i>=0 && pc<frames->cache[i]->highpc )
+  {
+    frames->stats.hits++;
+    frames->cache[i]->lastUse = ++frames->useTick;
+    return( frames->cache[i] );
+  }
+
+  Dwarf_Addr lowpc,highpc;
+  Dwarf_Fde fde = findFde( frames,pc,&lowpc,&highpc );
+  if( !fde ) return( NULL );
+
+  unwind_fde *compiled = compileFde( frames,fde,lowpc,highpc );
+  if( !compiled ) return( NULL );
+  frames->stats.misses++;
+  compiled->lastUse = ++frames->useTick;
+
+  // an FDE larger than the budget is used only once
+  trimCache( frames,compiled->size );
+  if( (frames->budget && compiled->size>frames->budget) ||
+      !dwst_grow_array((void**)&frames->cache,&frames->cacheAlloc,
+        frames->cacheQty+1,sizeof(unwind_fde*)) )
+  {
+    *owned = 1;
+    return( compiled );
+  }
+
+  i = findCached( frames,compiled->lowpc ) + 1;
+  memmove( frames->cache+i+1,frames->cache+i,
+      (frames->cacheQty-i)*sizeof(unwind_fde*) );
+  frames->cache[i] = compiled;
+  frames->cacheQty++;
+  frames->cacheSize += compiled->size;
+
+  return( compiled );
+}
+
+static int readAddr( image_frames *frames,uint64_t addr,uint64_t *value,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  if( frames->addrSize==4 )
+  {
+    uint32_t value32;
+    if( !readFunc(addr,&value32,4,readContext) ) return( 0 );
+    *value = value32;
+  }
+  else if( !readFunc(addr,value,8,readContext) )
+    return( 0 );
+  return( 1 );
+}
+
+// compute the registers of the caller with the rules of the row
+static int applyRow( image_frames *frames,const unwind_fde *compiled,
+    uint64_t pc,dwstUnwindRegs *regs,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  int low = 0,high = compiled->rowCount - 1;
+  const unwind_row *row = NULL;
+  while( low<=high )
+  {
+    int middle = ( low + high )/2;
+    if( compiled->rows[middle].pc<=pc )
+    {
+      row = &compiled->rows[middle];
+      low = middle + 1;
+    }
+    else
+      high = middle - 1;
+  }
+
+  if( !row || row->cfaReg<0 || !(regs->valid&(1U<<row->cfaReg)) )
+    return( 0 );
+
+  uint64_t cfa = regs->reg[row->cfaReg] + row->cfaOffset;
+  if( frames->addrSize==4 ) cfa = (uint32_t)cfa;
+
+  // registers without a rule keep their value
+  dwstUnwindRegs caller = *regs;
+  int i;
+  for( i=0; i<row->ruleCount; i++ )
+  {
+    const unwind_rule *rule = &compiled->rules[row->firstRule+i];
+    uint64_t value = 0;
+    int known = 0;
+    switch( rule->type )
+    {
+      case RULE_OFFSET:
+        known = readAddr( frames,cfa+rule->offset,&value,
+            readFunc,readContext );
+        break;
+      case RULE_VAL_OFFSET:
+        value = cfa + rule->offset;
+        known = 1;
+        break;
+      case RULE_REGISTER:
+        value = regs->reg[rule->source];
+        known = ( regs->valid&(1U<<rule->source) )!=0;
+        break;
+    }
+
+    if( known )
+    {
+      caller.reg[rule->reg] = value;
+      caller.valid |= 1U<<rule->reg;
+    }
+    else
+    {
+      caller.reg[rule->reg] = 0;
+      caller.valid &= ~( 1U<<rule->reg );
+    }
+  }
+
+  // without a return address this is the outermost frame
+  int raReg = compiled->raReg;
+  if( !(caller.valid&(1U<<raReg)) || !caller.reg[raReg] ) return( 0 );
+  caller.pc = caller.reg[raReg];
+
+  // the stack has to grow, or it could unwind forever
+  // (at the entry of an arm64 function, the CFA is still the same)
+  int sp = frames->spReg;
+  if( (regs->valid&(1U<<sp)) && (cfa<regs->reg[sp] ||
+        (cfa==regs->reg[sp] && caller.pc==regs->pc)) )
+    return( 0 );
+  caller.reg[sp] = cfa;
+  caller.valid |= 1U<<sp;
+
+  *regs = caller;
+  return( 1 );
+}
+
+// call frame information of the image, with the image lock entered,
+// or NULL (without the lock)
+static image_frames *enterFrames( dwstImage *image,
+    Dwarf_Debug *dbg,Dwarf_Addr *imageBase_dbg )
+{
+  image_frames **framesPtr;
+  *dbg = enterImageDbg( image,imageBase_dbg,&framesPtr );
+  if( !*dbg ) return( NULL );
+
+  if( !*framesPtr ) *framesPtr = readFrames( *dbg );
+  if( !*framesPtr )
+  {
+    leaveImageDbg( image );
+    return( NULL );
+  }
+  return( *framesPtr );
+}
+
+typedef struct image_reader
+{
+  Dwarf_Debug dbg;
+  uint64_t imageBase;
+} image_reader;
+
+// read the image data out of the file, for the unwind codes
+static int readImageFile( uint64_t addr,void *buffer,size_t size,
+    void *context )
+{
+  image_reader *reader = context;
+  return( dwarf_pe_read_image(reader->dbg,addr-reader->imageBase,
+        buffer,size) );
+}
+
+int dwstUnwindImage(
+    dwstImage *image,uint64_t imageBase,
+    dwstUnwindRegs *regs,int caller,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  if( !image || !regs || !readFunc ) return( 0 );
+
+  Dwarf_Debug dbg;
+  Dwarf_Addr imageBase_dbg;
+  image_frames *frames = enterFrames( image,&dbg,&imageBase_dbg );
+  if( !frames ) return( 0 );
+  if( frames->spReg<0 )
+  {
+    leaveImageDbg( image );
+    return( 0 );
+  }
+
+  frames->stats.frames++;
+
+  // the unwind codes describe all x86-64 functions which aren't leafs,
+  // the call frame information is used for the others
+  image_reader reader;
+  reader.dbg = dbg;
+  reader.imageBase = imageBase ? imageBase : imageBase_dbg;
+  int ok = -1;
+  if( frames->pdata )
+    ok = unwindPdata( regs,caller,reader.imageBase,readImageFile,&reader,
+        readFunc,readContext,0 );
+
+  if( ok<0 )
+  {
+    // a return address can be the start of the next function
+    uint64_t pc = regs->pc;
+    if( caller ) pc--;
+    if( imageBase && imageBase_dbg )
+      pc += imageBase_dbg - imageBase;
+
+    int owned;
+    unwind_fde *compiled = lookupFde( frames,pc,&owned );
+    if( compiled )
+      ok = applyRow( frames,compiled,pc,regs,readFunc,readContext );
+    else if( frames->pdata && !caller )
+      ok = unwindPdata( regs,caller,reader.imageBase,
+          readImageFile,&reader,readFunc,readContext,1 );
+    if( owned ) free( compiled );
+  }
+
+  leaveImageDbg( image );
+
+  return( ok>0 );
+}
+
+int dwstUnwindCacheStats( dwstImage *image,dwstUnwindStats *stats )
+{
+  if( !image || !stats ) return( 0 );
+
+  memset( stats,0,sizeof(dwstUnwindStats) );
+
+  Dwarf_Debug dbg;
+  Dwarf_Addr imageBase_dbg;
+  image_frames *frames = enterFrames( image,&dbg,&imageBase_dbg );
+  if( !frames ) return( 0 );
+
+  *stats = frames->stats;
+  stats->fdes = frames->cacheQty;
+  stats->cacheSize = frames->cacheSize;
+
+  leaveImageDbg( image );
+
+  return( 1 );
+}
+
+void dwstSetUnwindBudget( dwstImage *image,size_t budget )
+{
+  if( !image ) return;
+
+  Dwarf_Debug dbg;
+  Dwarf_Addr imageBase_dbg;
+  image_frames *frames = enterFrames( image,&dbg,&imageBase_dbg );
+  if( !frames ) return;
+
+  frames->budget = budget;
+  trimCache( frames,0 );
+
+  leaveImageDbg( image );
+}
+
+int dwstUnwindStack(
+    dwstImage *image,uint64_t imageBase,
+    const dwstUnwindRegs *regs,
+    uint64_t *addr,int size,
+    dwstReadMemory *readFunc,void *readContext )
+{
+  if( !image || !regs || !addr || size<=0 || !readFunc ) return( 0 );
+
+  dwstUnwindRegs frame = *regs;
+  int count = 0;
+  addr[count++] = frame.pc;
+  while( count<size &&
+      dwstUnwindImage(image,imageBase,&frame,count>1,readFunc,readContext) )
+    addr[count++] = frame.pc - 1;
+
+  return( count );
+}